@@ -29,10 +29,33 @@ win32 {
 
 unix {
     DESTDIR = /opt/sdrnode/addons
+    LIBS += -lrt
 }
 
 SOURCES += \
     entrypoint.cpp \
+    rtltcp_client.cpp \
+    rtltcp_server.cpp \
+    shm_ring.cpp \
+    udp_stream.cpp \
+    stream_engine.cpp \
+    worker_pool.cpp \
+    thread_tuning.cpp \
+    numa_placement.cpp \
+    watchdog.cpp \
+    hotplug.cpp \
+    backpressure.cpp \
+    reblock.cpp \
+    log_queue.cpp \
+    dsp.cpp \
+    sim_backend.cpp \
+    latency_hist.cpp \
+    metrics.cpp \
+    trace.cpp \
+    ctl_cache.cpp \
+    hop_schedule.cpp \
+    ppm_correction.cpp \
+    iq_balance.cpp \
     jansson/dump.c \
     jansson/error.c \
     jansson/hashtable.c \
@@ -48,6 +71,31 @@ SOURCES += \
 HEADERS +=\
     external_hardware_def.h \
     entrypoint.h \
+    rx_device.h \
+    rtltcp_client.h \
+    rtltcp_server.h \
+    shm_ring.h \
+    shm_ring_format.h \
+    udp_stream.h \
+    udp_stream_format.h \
+    stream_engine.h \
+    worker_pool.h \
+    thread_tuning.h \
+    numa_placement.h \
+    watchdog.h \
+    hotplug.h \
+    backpressure.h \
+    reblock.h \
+    log_queue.h \
+    dsp.h \
+    sim_backend.h \
+    latency_hist.h \
+    metrics.h \
+    trace.h \
+    ctl_cache.h \
+    hop_schedule.h \
+    ppm_correction.h \
+    iq_balance.h \
     jansson/hashtable.h \
     jansson/jansson.h \
     jansson/jansson_config.h \
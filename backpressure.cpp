@@ -0,0 +1,304 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "backpressure.h"
+#include "dsp.h"
+#include "latency_hist.h"
+
+#define MAX_QUEUE    (64)
+#define MAX_SKIP     (16)
+#define STALE_MS     (1000) // drop_oldest : queued blocks older than this are not worth pushing
+
+struct t_queued {
+    TYPECPX *samples ;
+    int count ;
+    struct ext_Context ctx ; // when captured
+};
+
+struct t_backpressure {
+    int device_id ;
+    int policy ;
+    double slow_factor ;
+    int recover_blocks ;
+    int queue_blocks ;
+    int max_decimation ;
+    int spectrum_every ;
+
+    bool active ;
+    int good ;                 // consecutive fast accepted pushes while active
+    int skip ;                 // drop_newest : blocks still to drop ; spectrum_only : position in the cycle
+    int skip_run ;             // drop_newest : current run length
+    int decimation ;
+    bool lost ;                // samples dropped since the last push
+    int64_t last_push_ms ;
+    int64_t since_ms ;
+    struct t_queued queue[MAX_QUEUE] ;
+    int queue_head ;
+    int queue_count ;
+    struct ext_Context ctx ;   // what SDRNode gets, rate reflects the decimation
+    long version_bump ;
+
+    struct t_push_counters counters ;
+    struct t_push_counters at_start ; // counters when the episode started
+};
+
+static const char *policy_names[] = { "drop_newest", "drop_oldest", "decimate", "spectrum_only" };
+
+static void parse( json_t *obj, struct t_backpressure *bp ) {
+    if( !json_is_object(obj) ) {
+        return ;
+    }
+    json_t *v = json_object_get( obj, "policy" );
+    if( json_is_string(v) ) {
+        for( int k=0 ; k < 4 ; k++ ) {
+            if( strcmp( json_string_value(v), policy_names[k] ) == 0 ) bp->policy = k ;
+        }
+    }
+    v = json_object_get( obj, "slow_factor" );
+    if( json_is_number(v) && (json_number_value(v) > 0) ) bp->slow_factor = json_number_value(v);
+    v = json_object_get( obj, "recover_blocks" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 1) ) bp->recover_blocks = (int)json_integer_value(v);
+    v = json_object_get( obj, "queue_blocks" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 1) && (json_integer_value(v) <= MAX_QUEUE) ) bp->queue_blocks = (int)json_integer_value(v);
+    v = json_object_get( obj, "max_decimation" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 2) && (json_integer_value(v) <= 64) ) bp->max_decimation = (int)json_integer_value(v);
+    v = json_object_get( obj, "spectrum_every" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 2) ) bp->spectrum_every = (int)json_integer_value(v);
+}
+
+struct t_backpressure* backpressure_attach( struct t_rx_device *dev, int device_id, json_t *root ) {
+    json_t *conf = json_object_get( root, "backpressure" );
+    char index[16] ;
+    if( !json_is_object(conf) ) {
+        return(NULL);
+    }
+    struct t_backpressure *bp = (struct t_backpressure *)calloc( 1, sizeof(struct t_backpressure));
+    if( bp == NULL ) {
+        return(NULL);
+    }
+    bp->device_id = device_id ;
+    bp->policy = BP_DROP_NEWEST ;
+    bp->slow_factor = 1.0 ;
+    bp->recover_blocks = 8 ;
+    bp->queue_blocks = 4 ;
+    bp->max_decimation = 8 ;
+    bp->spectrum_every = 8 ;
+    bp->decimation = 1 ;
+    parse( conf, bp );
+    json_t *devices = json_object_get( conf, "devices" );
+    if( json_is_object(devices) ) {
+        snprintf( index, sizeof(index), "%d", device_id );
+        json_t *d = json_object_get( devices, dev->device_serial_number );
+        parse( d != NULL ? d : json_object_get( devices, index ), bp );
+    }
+    return(bp);
+}
+
+static void enter( struct t_backpressure *bp ) {
+    char msg[256] ;
+    if( bp->active ) {
+        bp->good = 0 ;
+        return ;
+    }
+    bp->active = true ;
+    bp->good = 0 ;
+    bp->since_ms = rx_now_ms();
+    bp->at_start = bp->counters ;
+    bp->counters.episodes++ ;
+    snprintf( msg, sizeof(msg), "backpressure: SDRNode is late, %s", policy_names[bp->policy] );
+    log_class( bp->device_id, 0, LOG_BACKPRESSURE, msg );
+}
+
+static void leave( struct t_backpressure *bp ) {
+    char msg[256] ;
+    bp->active = false ;
+    bp->skip = 0 ;
+    bp->skip_run = 0 ;
+    snprintf( msg, sizeof(msg), "backpressure: cleared after %d ms, %d refused, %d slow, %d dropped, %d decimated",
+              (int)(rx_now_ms() - bp->since_ms),
+              (int)(bp->counters.refused - bp->at_start.refused), (int)(bp->counters.slow - bp->at_start.slow),
+              (int)(bp->counters.dropped - bp->at_start.dropped), (int)(bp->counters.decimated - bp->at_start.decimated) );
+    log_class( bp->device_id, 0, LOG_BACKPRESSURE, msg );
+}
+
+bool backpressure_admit( struct t_backpressure *bp ) {
+    if( (bp == NULL) || !bp->active ) {
+        return(true);
+    }
+    switch( bp->policy ) {
+    case BP_DROP_NEWEST:
+        if( bp->skip > 0 ) {
+            bp->skip-- ;
+            break ;
+        }
+        return(true);
+    case BP_SPECTRUM_ONLY:
+        bp->skip = (bp->skip + 1) % bp->spectrum_every ;
+        if( bp->skip != 0 ) {
+            break ;
+        }
+        return(true);
+    default:
+        return(true);
+    }
+    bp->counters.dropped++ ;
+    bp->lost = true ;
+    return(false);
+}
+
+/**
+ * @brief push_one hands one block to SDRNode and tells whether it was accepted. Refused blocks are
+ *        still ours, slow pushes are reported through slow. ctx is the context of the samples
+ */
+static bool push_one( struct t_rx_device *dev, struct t_backpressure *bp, TYPECPX *samples, int sample_count,
+                      const struct ext_Context *ctx, int rate, bool *slow ) {
+    bp->ctx.ctx_version = ctx->ctx_version + bp->version_bump ;
+    bp->ctx.center_freq = ctx->center_freq ;
+    bp->ctx.sample_rate = rate ;
+    bp->ctx.discontinuity = dev->context.discontinuity ;
+    bp->ctx.hop_index = ctx->hop_index ;
+    if( bp->lost ) {
+        dev->context.discontinuity++ ;
+        bp->ctx.discontinuity = dev->context.discontinuity ;
+        bp->lost = false ;
+    }
+
+    int64_t start = rx_now_us();
+    int rc = latency_push( dev, samples, sample_count, &bp->ctx );
+    int64_t elapsed = rx_now_us() - start ;
+    *slow = (rate > 0) && (elapsed > bp->slow_factor * 1e6 * sample_count / rate) ;
+    if( *slow ) {
+        bp->counters.slow++ ;
+    }
+    if( rc <= 0 ) {
+        bp->counters.refused++ ;
+        return(false);
+    }
+    bp->counters.pushed++ ;
+    return(true);
+}
+
+void backpressure_push( struct t_rx_device *dev, TYPECPX *samples, int sample_count, struct ext_Context *ctx ) {
+    struct t_backpressure *bp = dev->backpressure ;
+    bool slow = false ;
+
+    if( bp == NULL ) {
+        // push samples to SDRNode callback function
+        // we only manage one channel per device
+        if( latency_push( dev, samples, sample_count, ctx ) <= 0 ) {
+            free(samples);
+        }
+        return ;
+    }
+
+    int rate = ctx->sample_rate ;
+    int64_t now = rx_now_ms();
+    bool accepted ;
+    if( (bp->queue_count > 0) && (now - bp->last_push_ms > STALE_MS) ) {
+        // left from a previous run
+        while( bp->queue_count > 0 ) {
+            free( bp->queue[bp->queue_head].samples );
+            bp->queue_head = (bp->queue_head + 1) % MAX_QUEUE ;
+            bp->queue_count-- ;
+            bp->counters.dropped++ ;
+        }
+        bp->lost = true ;
+    }
+    bp->last_push_ms = now ;
+    if( bp->policy == BP_DROP_OLDEST ) {
+        // queued blocks first, in order, stop at the first refusal
+        accepted = true ;
+        while( (bp->queue_count > 0) && accepted ) {
+            struct t_queued *q = &bp->queue[bp->queue_head] ;
+            accepted = push_one( dev, bp, q->samples, q->count, &q->ctx, q->ctx.sample_rate, &slow );
+            if( accepted ) {
+                bp->queue_head = (bp->queue_head + 1) % MAX_QUEUE ;
+                bp->queue_count-- ;
+            }
+        }
+        if( accepted ) {
+            accepted = push_one( dev, bp, samples, sample_count, ctx, rate, &slow );
+        }
+        if( !accepted ) {
+            if( bp->queue_count == bp->queue_blocks ) {
+                free( bp->queue[bp->queue_head].samples );
+                bp->queue_head = (bp->queue_head + 1) % MAX_QUEUE ;
+                bp->queue_count-- ;
+                bp->counters.dropped++ ;
+                bp->lost = true ;
+            }
+            struct t_queued *q = &bp->queue[(bp->queue_head + bp->queue_count) % MAX_QUEUE] ;
+            q->samples = samples ;
+            q->count = sample_count ;
+            q->ctx = *ctx ;
+            bp->queue_count++ ;
+        }
+    } else {
+        int factor = (bp->policy == BP_DECIMATE) ? bp->decimation : 1 ;
+        if( factor > 1 ) {
+            sample_count = dsp_decimate( samples, sample_count, factor );
+            rate /= factor ;
+            bp->counters.decimated++ ;
+        }
+        accepted = push_one( dev, bp, samples, sample_count, ctx, rate, &slow );
+        if( !accepted ) {
+            free(samples);
+            bp->counters.dropped++ ;
+            bp->lost = true ;
+        }
+    }
+
+    if( !accepted || slow ) {
+        enter( bp );
+        if( bp->policy == BP_DROP_NEWEST ) {
+            bp->skip_run = (bp->skip_run == 0) ? 1 : bp->skip_run * 2 ;
+            if( bp->skip_run > MAX_SKIP ) bp->skip_run = MAX_SKIP ;
+            bp->skip = bp->skip_run ;
+        } else if( (bp->policy == BP_DECIMATE) && (bp->decimation * 2 <= bp->max_decimation) ) {
+            bp->decimation *= 2 ; // powers of 2, never above max_decimation
+            bp->version_bump++ ;
+        }
+        return ;
+    }
+    bp->skip_run = 0 ;
+    if( bp->active && (++bp->good >= bp->recover_blocks) ) {
+        if( (bp->policy == BP_DECIMATE) && (bp->decimation > 1) ) {
+            // one step back at a time
+            bp->decimation /= 2 ;
+            bp->version_bump++ ;
+            bp->good = 0 ;
+            if( bp->decimation > 1 ) {
+                return ;
+            }
+        }
+        if( (bp->policy != BP_DROP_OLDEST) || (bp->queue_count == 0) ) {
+            leave( bp );
+        }
+    }
+}
+
+void backpressure_counters( struct t_backpressure *bp, struct t_push_counters *out ) {
+    if( bp == NULL ) {
+        memset( out, 0, sizeof(struct t_push_counters));
+        return ;
+    }
+    *out = bp->counters ;
+}
@@ -0,0 +1,72 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BACKPRESSURE_H
+#define BACKPRESSURE_H
+
+#include "rx_device.h"
+
+/*
+ * Backpressure : what the driver pushes when SDRNode cannot keep up.
+ *
+ *   { "backpressure" : { "policy" : "drop_oldest",  // drop_newest (default) | drop_oldest | decimate | spectrum_only
+ *                        "slow_factor" : 1.0,       // a push taking longer than slow_factor x block duration is slow
+ *                        "recover_blocks" : 8,      // fast accepted pushes before going back to normal
+ *                        "queue_blocks" : 4,        // drop_oldest : refused blocks kept for a retry
+ *                        "max_decimation" : 8,      // decimate : highest factor
+ *                        "spectrum_every" : 8,      // spectrum_only : one block pushed out of this many
+ *                        "devices" : { "00000001" : { "policy" : "decimate" } } } } // by serial or index
+ *
+ * A push refused by SDRNode (pushSamples returns <= 0) or slow is a backpressure signal. Until
+ * recover_blocks pushes in a row are accepted and fast :
+ *   drop_newest   : incoming blocks are dropped before conversion, 1 then 2, 4... up to 16 between two tries
+ *   drop_oldest   : refused blocks are queued and pushed first next time, the oldest dropped when full
+ *   decimate      : samples are averaged by 2, 4... up to max_decimation, the pushed context carries the rate
+ *   spectrum_only : one whole block out of spectrum_every is pushed, enough to keep a spectrum alive
+ * ext_Context.discontinuity is incremented whenever samples were dropped. Episodes are logged with counters.
+ */
+
+#define BP_DROP_NEWEST   (0)
+#define BP_DROP_OLDEST   (1)
+#define BP_DECIMATE      (2)
+#define BP_SPECTRUM_ONLY (3)
+
+struct t_push_counters {
+    uint64_t pushed ;     // blocks accepted by SDRNode
+    uint64_t refused ;    // pushSamples returned <= 0
+    uint64_t slow ;       // pushes slower than slow_factor x block duration
+    uint64_t dropped ;    // blocks never pushed
+    uint64_t decimated ;  // blocks pushed at a reduced rate
+    uint32_t episodes ;   // backpressure episodes
+};
+
+struct t_backpressure ;
+
+// per device state, NULL if no "backpressure" section : samples are pushed as they come
+struct t_backpressure* backpressure_attach( struct t_rx_device *dev, int device_id, json_t *root );
+
+// false if the block shall be dropped before conversion
+bool backpressure_admit( struct t_backpressure *bp );
+
+// pushes a converted block according to the policy. Takes ownership of samples (malloc'd), ctx is
+// the context they were captured under : queued blocks keep a copy
+void backpressure_push( struct t_rx_device *dev, TYPECPX *samples, int sample_count, struct ext_Context *ctx );
+
+// copy of the counters of the device
+void backpressure_counters( struct t_backpressure *bp, struct t_push_counters *out );
+
+#endif // BACKPRESSURE_H
@@ -0,0 +1,322 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * dsp_bench : runs each sample path kernel of dsp.h, in each of its variants, over several block
+ * sizes and reports Msps and cycles per complex sample. The input is a synthetic tone with noise
+ * and DC offset, or a raw rtl_sdr capture (u8 IQ) given with -f. Results are printed and, with -o,
+ * written as JSON so runs can be compared over time.
+ *
+ * usage : dsp_bench [-f capture.u8] [-o results.json] [-t seconds_per_case]
+ *
+ * Cycles come from the time stamp counter on x86 (reference cycles, not core cycles when the
+ * clock scales), they are null elsewhere.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../dsp.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC (1)
+#endif
+
+#define MAX_BLOCK (131072) // complex samples
+
+static const int block_sizes[] = { 256, 2048, 16384, 131072 };
+
+struct t_case {
+    const char *kernel ;
+    const char *variant ;
+    void (*run)( const unsigned char *in, TYPECPX *out, int count );
+};
+
+static TYPECPX xn_1, yn_1 ;
+static TYPECPX nco_phasor = { 1, 0 } ;
+static TYPECPX nco_step ;
+
+static void run_convert_table( const unsigned char *in, TYPECPX *out, int count ) {
+    dsp_u8_to_cf32( in, out, count );
+}
+static void run_convert_scalar( const unsigned char *in, TYPECPX *out, int count ) {
+    dsp_u8_to_cf32_scalar( in, out, count );
+}
+#ifdef __SSE2__
+static void run_convert_sse2( const unsigned char *in, TYPECPX *out, int count ) {
+    dsp_u8_to_cf32_sse2( in, out, count );
+}
+#endif
+static void run_dc_block( const unsigned char *in, TYPECPX *out, int count ) {
+    (void)in ;
+    dsp_dc_block( out, count, &xn_1, &yn_1 );
+}
+static void run_convert_dc_table( const unsigned char *in, TYPECPX *out, int count ) {
+    dsp_convert_dc( in, out, count, &xn_1, &yn_1 );
+}
+static void run_convert_dc_scalar( const unsigned char *in, TYPECPX *out, int count ) {
+    dsp_convert_dc_scalar( in, out, count, &xn_1, &yn_1 );
+}
+// coefficients set in main() : a few percent and degrees of imbalance
+static struct t_iq_balance iq ;
+
+static void run_convert_iq_scalar( const unsigned char *in, TYPECPX *out, int count ) {
+    dsp_convert_iq_scalar( in, out, count, &iq );
+}
+static void run_convert_dc_iq_scalar( const unsigned char *in, TYPECPX *out, int count ) {
+    dsp_convert_dc_iq_scalar( in, out, count, &xn_1, &yn_1, &iq );
+}
+#ifdef __SSE2__
+static void run_convert_iq_sse2( const unsigned char *in, TYPECPX *out, int count ) {
+    dsp_convert_iq( in, out, count, &iq );
+}
+static void run_convert_dc_iq_sse2( const unsigned char *in, TYPECPX *out, int count ) {
+    dsp_convert_dc_iq( in, out, count, &xn_1, &yn_1, &iq );
+}
+#endif
+static void run_decimate( const unsigned char *in, TYPECPX *out, int count ) {
+    (void)in ;
+    dsp_decimate( out, count, 2 ); // in place, the output is not reloaded between calls
+}
+static void run_nco( const unsigned char *in, TYPECPX *out, int count ) {
+    (void)in ;
+    dsp_nco( out, count, &nco_phasor, nco_step ); // in place, unit phasor : the level does not drift
+}
+// the FFT gains up to n per pass : the block is converted again first, as the ppm estimator does
+static void run_fft( const unsigned char *in, TYPECPX *out, int count ) {
+    dsp_u8_to_cf32( in, out, count );
+    dsp_fft( out, count );
+}
+
+static const struct t_case cases[] = {
+    { "u8_to_cf32", "table", run_convert_table },
+    { "u8_to_cf32", "scalar", run_convert_scalar },
+#ifdef __SSE2__
+    { "u8_to_cf32", "sse2", run_convert_sse2 },
+#endif
+    { "dc_block", "scalar", run_dc_block },
+    { "convert_dc", "table", run_convert_dc_table },   // the callback
+    { "convert_dc", "scalar", run_convert_dc_scalar },
+    { "convert_iq", "scalar", run_convert_iq_scalar },
+#ifdef __SSE2__
+    { "convert_iq", "sse2", run_convert_iq_sse2 },
+#endif
+    { "convert_dc_iq", "scalar", run_convert_dc_iq_scalar },
+#ifdef __SSE2__
+    { "convert_dc_iq", "sse2", run_convert_dc_iq_sse2 },       // the callback, IQ correction enabled
+#endif
+    { "decimate_2", "scalar", run_decimate },
+    { "nco", "scalar", run_nco },                 // ppm residual correction
+    { "u8_fft", "radix2", run_fft },              // ppm estimator, block size = FFT size
+};
+
+static double now() {
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( ts.tv_sec + ts.tv_nsec * 1e-9 );
+}
+
+static uint64_t ticks() {
+#ifdef HAVE_TSC
+    return( __rdtsc() );
+#else
+    return(0);
+#endif
+}
+
+// synthetic : tone at fs/8, noise, and the DC offset of a real dongle
+static void synthetic( unsigned char *buf, int count ) {
+    srand(1);
+    for( int i=0 ; i < count ; i++ ) {
+        double phase = 2 * M_PI * i / 8.0 ;
+        double noise_i = (rand() / (double)RAND_MAX - 0.5) * 8 ;
+        double noise_q = (rand() / (double)RAND_MAX - 0.5) * 8 ;
+        buf[2*i  ] = (unsigned char)(130 + 60 * cos(phase) + noise_i) ;
+        buf[2*i+1] = (unsigned char)(125 + 60 * sin(phase) + noise_q) ;
+    }
+}
+
+// the capture is repeated if shorter than the largest block
+static bool recorded( const char *path, unsigned char *buf, int count ) {
+    FILE *f = fopen( path, "rb" );
+    if( f == NULL ) {
+        return(false);
+    }
+    size_t got = fread( buf, 1, 2 * (size_t)count, f );
+    fclose(f);
+    got &= ~(size_t)1 ;
+    if( got == 0 ) {
+        return(false);
+    }
+    for( size_t k = got ; k < 2 * (size_t)count ; k++ ) {
+        buf[k] = buf[k % got] ;
+    }
+    return(true);
+}
+
+// largest difference between the variants of a kernel and its first variant, on the largest block
+static double check( const struct t_case *c, const struct t_case *ref, const unsigned char *in,
+                     TYPECPX *a, TYPECPX *b ) {
+    double err = 0 ;
+    dsp_u8_to_cf32( in, a, MAX_BLOCK );
+    memcpy( b, a, MAX_BLOCK * sizeof(TYPECPX));
+    xn_1.re = xn_1.im = yn_1.re = yn_1.im = 0 ;
+    nco_phasor.re = 1 ; nco_phasor.im = 0 ;
+    ref->run( in, a, MAX_BLOCK );
+    xn_1.re = xn_1.im = yn_1.re = yn_1.im = 0 ;
+    nco_phasor.re = 1 ; nco_phasor.im = 0 ;
+    c->run( in, b, MAX_BLOCK );
+    for( int i=0 ; i < MAX_BLOCK ; i++ ) {
+        double d = fmax( fabs( a[i].re - b[i].re ), fabs( a[i].im - b[i].im ));
+        err = fmax( err, d );
+    }
+    return(err);
+}
+
+int main( int argc, char **argv ) {
+    const char *input = NULL ;
+    const char *output = NULL ;
+    double seconds = 0.2 ;
+    int opt ;
+
+    while( (opt = getopt( argc, argv, "f:o:t:" )) != -1 ) {
+        switch( opt ) {
+        case 'f': input = optarg ; break ;
+        case 'o': output = optarg ; break ;
+        case 't': seconds = atof(optarg) ; break ;
+        default:
+            fprintf( stderr, "usage : %s [-f capture.u8] [-o results.json] [-t seconds_per_case]\n", argv[0] );
+            return(1);
+        }
+    }
+
+    dsp_init();
+    memset( &iq, 0, sizeof(iq));
+    iq.ci = -0.05f ;
+    iq.cq = 1.02f ;
+    nco_step.re = (float)cos( 2 * M_PI * 1e-3 ); // 1 ppm of 1 GHz at 1 Msps
+    nco_step.im = (float)sin( 2 * M_PI * 1e-3 );
+    unsigned char *in = (unsigned char *)malloc( 2 * MAX_BLOCK );
+    TYPECPX *out = (TYPECPX *)malloc( MAX_BLOCK * sizeof(TYPECPX));
+    TYPECPX *ref = (TYPECPX *)malloc( MAX_BLOCK * sizeof(TYPECPX));
+    if( (in == NULL) || (out == NULL) || (ref == NULL) ) {
+        return(1);
+    }
+    if( input != NULL ) {
+        if( !recorded( input, in, MAX_BLOCK )) {
+            fprintf( stderr, "cannot read %s\n", input );
+            return(1);
+        }
+    } else {
+        synthetic( in, MAX_BLOCK );
+    }
+
+    json_t *results = json_array();
+    json_t *isa = json_array();
+#ifdef __SSE2__
+    json_array_append_new( isa, json_string("sse2") );
+#endif
+#ifdef __AVX2__
+    json_array_append_new( isa, json_string("avx2") );
+#endif
+#ifdef __ARM_NEON
+    json_array_append_new( isa, json_string("neon") );
+#endif
+
+    printf("input: %s, %.2f s per case\n", input != NULL ? input : "synthetic", seconds );
+    printf("%-12s %-8s %8s %10s %12s %10s\n", "kernel", "variant", "block", "Msps", "cycles/spl", "max err" );
+    const int case_count = sizeof(cases)/sizeof(cases[0]) ;
+    for( int k=0 ; k < case_count ; k++ ) {
+        const struct t_case *c = &cases[k] ;
+        const struct t_case *first = c ;
+        while( (first > cases) && (strcmp( (first-1)->kernel, c->kernel ) == 0) ) {
+            first-- ;
+        }
+        double err = check( c, first, in, ref, out );
+
+        for( size_t b=0 ; b < sizeof(block_sizes)/sizeof(block_sizes[0]) ; b++ ) {
+            int count = block_sizes[b] ;
+            uint64_t samples = 0 ;
+            dsp_u8_to_cf32( in, out, MAX_BLOCK );
+            c->run( in, out, count ); // warm up
+            double start = now();
+            uint64_t t0 = ticks();
+            double elapsed ;
+            do {
+                // walks the input so large blocks are not served from L1 only
+                for( int off=0 ; off + count <= MAX_BLOCK ; off += count ) {
+                    c->run( in + 2*off, out + off, count );
+                    samples += count ;
+                }
+                elapsed = now() - start ;
+            } while( elapsed < seconds );
+            uint64_t t1 = ticks();
+            double msps = samples / elapsed / 1e6 ;
+            double cycles = (t1 - t0) / (double)samples ;
+
+            printf("%-12s %-8s %8d %10.1f ", c->kernel, c->variant, count, msps );
+#ifdef HAVE_TSC
+            printf("%12.2f ", cycles );
+#else
+            printf("%12s ", "-" );
+#endif
+            printf("%10.2g\n", err );
+            fflush(stdout);
+
+            json_t *r = json_object();
+            json_object_set_new( r, "kernel", json_string( c->kernel ));
+            json_object_set_new( r, "variant", json_string( c->variant ));
+            json_object_set_new( r, "block", json_integer( count ));
+            json_object_set_new( r, "msps", json_real( msps ));
+#ifdef HAVE_TSC
+            json_object_set_new( r, "cycles_per_sample", json_real( cycles ));
+#else
+            json_object_set_new( r, "cycles_per_sample", json_null());
+#endif
+            json_object_set_new( r, "max_error", json_real( err ));
+            json_array_append_new( results, r );
+        }
+    }
+
+    if( output != NULL ) {
+        char date[32] ;
+        time_t t = time(NULL);
+        strftime( date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime( &t ));
+        json_t *root = json_object();
+        json_object_set_new( root, "date", json_string( date ));
+        json_object_set_new( root, "cpus", json_integer( sysconf( _SC_NPROCESSORS_ONLN )));
+        json_object_set_new( root, "isa", isa );
+        json_object_set_new( root, "input", json_string( input != NULL ? input : "synthetic" ));
+        json_object_set_new( root, "seconds_per_case", json_real( seconds ));
+        json_object_set_new( root, "results", results );
+        if( json_dump_file( root, output, JSON_INDENT(2) | JSON_PRESERVE_ORDER ) != 0 ) {
+            fprintf( stderr, "cannot write %s\n", output );
+        }
+        json_decref( root );
+    } else {
+        json_decref( isa );
+        json_decref( results );
+    }
+    free( in );
+    free( out );
+    free( ref );
+    return(0);
+}
@@ -0,0 +1,231 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * hot_state_bench : one thread per simulated device, each pinned to its own cpu, runs the DC
+ * removal of the sample callback on a USB sized block. The filter state is placed :
+ *
+ *   legacy   : inside a contiguous array of the former t_rx_device layout
+ *   packed   : contiguous array of bare filter states (32 bytes stride, the naive split)
+ *   isolated : struct t_rx_hot, allocated per device and cache line aligned (the driver now)
+ *
+ * each with the former kernel (state written back at every sample) and the current one (state
+ * kept in locals, written once per block). Figures are aggregated Msps over all devices.
+ *
+ * usage : hot_state_bench [devices] [seconds]
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../rx_device.h"
+
+#define ALPHA_DC   (0.9996f)
+#define BLOCK_LEN  (16384)  // bytes per USB block, kept in L1/L2 so only the state lines matter
+
+// t_rx_device as it was before the hot state was split out (field order and sizes)
+struct legacy_rx_device {
+    const struct t_rx_backend *backend ;
+    rtlsdr_dev_t *rtlsdr_device ;
+    void *backend_ctx ;
+    char *device_name ;
+    char *device_serial_number ;
+    struct t_sample_rates* rates;
+    int current_sample_rate ;
+    int64_t min_frq_hz ;
+    int64_t max_frq_hz ;
+    int64_t center_frq_hz ;
+    float gain ;
+    float gain_min ;
+    float gain_max ;
+    int gain_size ;
+    int *gain_values;
+    char *uuid ;
+    bool running ;
+    bool acq_stop ;
+    sem_t mutex;
+    pthread_t receive_thread ;
+    struct t_thread_settings acq_settings ;
+    int numa_node ;
+    TYPECPX xn_1 ;
+    TYPECPX yn_1 ;
+    struct ext_Context context ;
+    void *tcp_server ;
+    void *shm ;
+    void *multicast ;
+    void *queue ;
+    char *early_log[EARLY_LOG_SIZE] ;
+    int early_log_level[EARLY_LOG_SIZE] ;
+    int early_log_count ;
+};
+
+struct packed_state {
+    TYPECPX xn_1 ;
+    TYPECPX yn_1 ;
+};
+
+struct t_worker {
+    pthread_t thread ;
+    int cpu ;
+    int per_sample ;
+    TYPECPX *xn_1 ;
+    TYPECPX *yn_1 ;
+    uint64_t samples ;
+};
+
+static volatile int stop_flag ;
+
+static double now() {
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( ts.tv_sec + ts.tv_nsec * 1e-9 );
+}
+
+// former callback loop : state written through the device pointer at every sample
+static void dc_per_sample( unsigned char *buf, int sample_count, TYPECPX *out, TYPECPX *xn_1, TYPECPX *yn_1 ) {
+    TYPECPX tmp ;
+    for( int i=0 ; i < sample_count ; i++ ) {
+        float I = ((int)buf[2*i] - 127) / 127.0f ;
+        float Q = ((int)buf[2*i+1] - 127) / 127.0f ;
+        tmp.re = I - xn_1->re + ALPHA_DC * yn_1->re ;
+        tmp.im = Q - xn_1->im + ALPHA_DC * yn_1->im ;
+        xn_1->re = I ;
+        xn_1->im = Q ;
+        yn_1->re = tmp.re ;
+        yn_1->im = tmp.im ;
+        out[i] = tmp ;
+    }
+}
+
+// current callback loop : state in locals, written once per block
+static void dc_per_block( unsigned char *buf, int sample_count, TYPECPX *out, TYPECPX *xn_1, TYPECPX *yn_1 ) {
+    TYPECPX x = *xn_1 ;
+    TYPECPX y = *yn_1 ;
+    TYPECPX tmp ;
+    for( int i=0 ; i < sample_count ; i++ ) {
+        float I = ((int)buf[2*i] - 127) / 127.0f ;
+        float Q = ((int)buf[2*i+1] - 127) / 127.0f ;
+        tmp.re = I - x.re + ALPHA_DC * y.re ;
+        tmp.im = Q - x.im + ALPHA_DC * y.im ;
+        x.re = I ;
+        x.im = Q ;
+        y = tmp ;
+        out[i] = tmp ;
+    }
+    *xn_1 = x ;
+    *yn_1 = y ;
+}
+
+static void* worker( void *params ) {
+    struct t_worker *w = (struct t_worker *)params ;
+    cpu_set_t set ;
+    CPU_ZERO( &set );
+    CPU_SET( w->cpu, &set );
+    pthread_setaffinity_np( pthread_self(), sizeof(set), &set );
+
+    unsigned char *buf = (unsigned char *)malloc( BLOCK_LEN );
+    TYPECPX *out = (TYPECPX *)malloc( BLOCK_LEN/2 * sizeof(TYPECPX));
+    for( int i=0 ; i < BLOCK_LEN ; i++ ) {
+        buf[i] = (unsigned char)(rand() & 0xff);
+    }
+    while( !stop_flag ) {
+        if( w->per_sample ) {
+            dc_per_sample( buf, BLOCK_LEN/2, out, w->xn_1, w->yn_1 );
+        } else {
+            dc_per_block( buf, BLOCK_LEN/2, out, w->xn_1, w->yn_1 );
+        }
+        w->samples += BLOCK_LEN/2 ;
+    }
+    free( buf );
+    free( out );
+    return(NULL);
+}
+
+static double run( const char *layout, int per_sample, int devices, double seconds ) {
+    struct t_worker *w = (struct t_worker *)calloc( devices, sizeof(struct t_worker));
+    struct legacy_rx_device *legacy = (struct legacy_rx_device *)calloc( devices, sizeof(struct legacy_rx_device));
+    struct packed_state *packed = (struct packed_state *)calloc( devices, sizeof(struct packed_state));
+    struct t_rx_hot **hot = (struct t_rx_hot **)calloc( devices, sizeof(struct t_rx_hot *));
+    int cpus = (int)sysconf( _SC_NPROCESSORS_ONLN );
+
+    for( int d=0 ; d < devices ; d++ ) {
+        w[d].cpu = d % cpus ;
+        w[d].per_sample = per_sample ;
+        if( strcmp( layout, "legacy" ) == 0 ) {
+            w[d].xn_1 = &legacy[d].xn_1 ;
+            w[d].yn_1 = &legacy[d].yn_1 ;
+        } else if( strcmp( layout, "packed" ) == 0 ) {
+            w[d].xn_1 = &packed[d].xn_1 ;
+            w[d].yn_1 = &packed[d].yn_1 ;
+        } else {
+            if( posix_memalign( (void **)&hot[d], CACHE_LINE_SIZE, sizeof(struct t_rx_hot)) != 0 ) {
+                exit(1);
+            }
+            memset( hot[d], 0, sizeof(struct t_rx_hot));
+            w[d].xn_1 = &hot[d]->xn_1 ;
+            w[d].yn_1 = &hot[d]->yn_1 ;
+        }
+    }
+
+    stop_flag = 0 ;
+    double start = now();
+    for( int d=0 ; d < devices ; d++ ) {
+        pthread_create( &w[d].thread, NULL, worker, &w[d] );
+    }
+    usleep( (useconds_t)(seconds * 1e6) );
+    stop_flag = 1 ;
+    uint64_t total = 0 ;
+    for( int d=0 ; d < devices ; d++ ) {
+        pthread_join( w[d].thread, NULL );
+        total += w[d].samples ;
+    }
+    double elapsed = now() - start ;
+
+    for( int d=0 ; d < devices ; d++ ) {
+        free( hot[d] );
+    }
+    free( hot );
+    free( packed );
+    free( legacy );
+    free( w );
+    return( total / elapsed / 1e6 );
+}
+
+int main( int argc, char **argv ) {
+    int cpus = (int)sysconf( _SC_NPROCESSORS_ONLN );
+    int devices = (argc > 1) ? atoi(argv[1]) : cpus ;
+    double seconds = (argc > 2) ? atof(argv[2]) : 2.0 ;
+    const char *layouts[] = { "legacy", "packed", "isolated" };
+
+    printf("devices: %d, cpus: %d, legacy stride: %d bytes, t_rx_hot: %d bytes\n",
+           devices, cpus, (int)sizeof(struct legacy_rx_device), (int)sizeof(struct t_rx_hot));
+    if( devices > cpus ) {
+        printf("more devices than cpus : threads share cores, false sharing is not measured\n");
+    }
+    printf("%-10s %-14s %-14s (Msps, all devices)\n", "layout", "per sample", "per block" );
+    for( int k=0 ; k < 3 ; k++ ) {
+        double a = run( layouts[k], 1, devices, seconds );
+        double b = run( layouts[k], 0, devices, seconds );
+        printf("%-10s %-14.1f %-14.1f\n", layouts[k], a, b );
+        fflush(stdout);
+    }
+    return(0);
+}
@@ -0,0 +1,134 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * numa_bench : measures the sample path (u8 -> float conversion + DC removal) with the USB blocks
+ * and the output buffer on each NUMA node, the thread running on each node.
+ * The diagonal is what the driver does since buffers follow the USB controller node, the other
+ * cells are the cross node traffic it used to pay when buffers were allocated anywhere.
+ *
+ * usage : numa_bench [buffer_MB] [passes]
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../numa_placement.h"
+
+#define ALPHA_DC (0.9996f)
+
+struct t_run {
+    int cpu_node ;
+    int mem_node ;
+    size_t bytes ;
+    int passes ;
+    double msps ;
+};
+
+static double now() {
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( ts.tv_sec + ts.tv_nsec * 1e-9 );
+}
+
+static int node_count() {
+    FILE *f = fopen( "/sys/devices/system/node/online", "r" );
+    int first = 0, last = 0 ;
+    if( f == NULL ) {
+        return(1);
+    }
+    if( fscanf( f, "%d-%d", &first, &last ) < 2 ) {
+        last = first ;
+    }
+    fclose(f);
+    return( last + 1 );
+}
+
+static void* run_thread( void *params ) {
+    struct t_run *r = (struct t_run *)params ;
+    struct t_thread_settings s ;
+    char report[256] ;
+
+    memset( &s, 0, sizeof(s));
+    if( numa_node_cpus( r->cpu_node, &s ) > 0 ) {
+        thread_settings_apply( pthread_self(), &s, -1, report, sizeof(report) );
+    }
+
+    // first touch from this thread does not matter : pages follow the node policy
+    size_t samples = r->bytes / 2 ;
+    unsigned char *in = (unsigned char *)numa_buffer_alloc( r->bytes, r->mem_node );
+    float *out = (float *)numa_buffer_alloc( samples * 2 * sizeof(float), r->mem_node );
+    for( size_t i=0 ; i < r->bytes ; i++ ) {
+        in[i] = (unsigned char)(rand() & 0xff);
+    }
+    memset( out, 0, samples * 2 * sizeof(float));
+
+    float xi = 0, xq = 0, yi = 0, yq = 0 ;
+    double start = now();
+    for( int p=0 ; p < r->passes ; p++ ) {
+        for( size_t i=0 ; i < samples ; i++ ) {
+            float I = ((int)in[2*i] - 127) / 127.0f ;
+            float Q = ((int)in[2*i+1] - 127) / 127.0f ;
+            yi = I - xi + ALPHA_DC * yi ;
+            yq = Q - xq + ALPHA_DC * yq ;
+            xi = I ;
+            xq = Q ;
+            out[2*i] = yi ;
+            out[2*i+1] = yq ;
+        }
+    }
+    double elapsed = now() - start ;
+    r->msps = (double)samples * r->passes / elapsed / 1e6 ;
+
+    numa_buffer_free( in, r->bytes );
+    numa_buffer_free( out, samples * 2 * sizeof(float));
+    return(NULL);
+}
+
+int main( int argc, char **argv ) {
+    size_t mb = (argc > 1) ? atoi(argv[1]) : 256 ;
+    int passes = (argc > 2) ? atoi(argv[2]) : 4 ;
+    int nodes = node_count();
+
+    printf("NUMA nodes: %d, buffer: %d MB, passes: %d\n", nodes, (int)mb, passes );
+    if( nodes < 2 ) {
+        printf("single node host : no cross node traffic to remove, local figure only\n");
+    }
+    printf("%-10s", "cpu\\mem" );
+    for( int m=0 ; m < nodes ; m++ ) printf(" node%-7d", m );
+    printf("  (Msps)\n");
+
+    for( int c=0 ; c < nodes ; c++ ) {
+        printf("node%-6d", c );
+        for( int m=0 ; m < nodes ; m++ ) {
+            struct t_run r ;
+            pthread_t thread ;
+            r.cpu_node = c ;
+            r.mem_node = m ;
+            r.bytes = mb * 1024 * 1024 ;
+            r.passes = passes ;
+            pthread_create( &thread, NULL, run_thread, &r );
+            pthread_join( thread, NULL );
+            printf(" %-11.1f", r.msps );
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    return(0);
+}
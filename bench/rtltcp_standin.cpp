@@ -0,0 +1,171 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * rtltcp_standin : a local rtl_tcp server without a dongle, to exercise the rtl_tcp backend of the
+ * driver. It sends the "RTL0" header, then u8 IQ samples of a tone paced at the sample rate the
+ * client sets, and prints every command it receives :
+ *
+ *   rtltcp_standin -p 1234 &
+ *   sdrnode_host -p '{"rtl_tcp":["127.0.0.1:1234"]}' -d 10 -s retune.txt
+ *
+ * usage : rtltcp_standin [-p port] [-t tuner_type] [-k seconds]
+ *
+ * -k closes each connection after that many seconds, the driver shall reconnect and replay its
+ * settings (stall watchdog enabled). One client at a time, like rtl_tcp.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define CHUNK (16384) // bytes per send
+
+static const char *command_names[] = { "?", "set_freq", "set_sample_rate", "set_gain_mode", "set_gain",
+                                       "set_freq_correction", "set_if_gain", "set_test_mode", "set_agc_mode",
+                                       "set_direct_sampling", "set_offset_tuning", "set_rtl_xtal",
+                                       "set_tuner_xtal", "set_gain_by_index", "set_bias_tee" };
+
+static double now() {
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( ts.tv_sec + ts.tv_nsec * 1e-9 );
+}
+
+// tone at rate / 8, phase kept across chunks
+static void tone( unsigned char *buf, int bytes, uint64_t *sample ) {
+    for( int i=0 ; i + 1 < bytes ; i += 2 ) {
+        double phase = 2 * M_PI * (*sample)++ / 8.0 ;
+        buf[i]   = (unsigned char)lrint( 127.5 + 60 * cos( phase ));
+        buf[i+1] = (unsigned char)lrint( 127.5 + 60 * sin( phase ));
+    }
+}
+
+static void serve( int sock, int tuner, double kill_after ) {
+    unsigned char header[12] = { 'R', 'T', 'L', '0' } ;
+    unsigned char cmd[5] ;
+    unsigned char chunk[CHUNK] ;
+    int cmd_fill = 0 ;
+    uint32_t rate = 2048000 ;
+    uint64_t sample = 0 ;
+    double start = now();
+    double sent = 0 ; // samples
+
+    header[4] = (tuner >> 24) & 0xff ;
+    header[5] = (tuner >> 16) & 0xff ;
+    header[6] = (tuner >> 8) & 0xff ;
+    header[7] = tuner & 0xff ;
+    header[11] = 29 ;
+    if( send( sock, header, sizeof(header), 0 ) != sizeof(header) ) {
+        return ;
+    }
+    for( ; ; ) {
+        double t = now() - start ;
+        if( (kill_after > 0) && (t > kill_after) ) {
+            printf("%.3f closing the connection\n", t );
+            return ;
+        }
+        struct pollfd pfd ;
+        pfd.fd = sock ;
+        pfd.events = POLLIN ;
+        if( poll( &pfd, 1, 1 ) > 0 ) {
+            ssize_t n = recv( sock, cmd + cmd_fill, sizeof(cmd) - cmd_fill, 0 );
+            if( n <= 0 ) {
+                printf("%.3f client left\n", t );
+                return ;
+            }
+            cmd_fill += n ;
+            if( cmd_fill == sizeof(cmd) ) {
+                uint32_t param = (cmd[1] << 24) | (cmd[2] << 16) | (cmd[3] << 8) | cmd[4] ;
+                const char *name = cmd[0] < sizeof(command_names)/sizeof(command_names[0]) ? command_names[cmd[0]] : "?" ;
+                printf("%.3f %s %d\n", t, name, (int32_t)param );
+                if( (cmd[0] == 0x02) && (param > 0) ) {
+                    rate = param ;
+                    start = now() - t ;
+                    sent = t * rate ;
+                }
+                cmd_fill = 0 ;
+            }
+        }
+        // paced at the sample rate
+        while( sent < (now() - start) * rate ) {
+            tone( chunk, CHUNK, &sample );
+            ssize_t n = send( sock, chunk, CHUNK, MSG_DONTWAIT );
+            if( n < 0 ) {
+                if( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) {
+                    break ; // the client is late, samples are lost like with a dongle
+                }
+                printf("%.3f client left\n", now() - start );
+                return ;
+            }
+            sent += CHUNK / 2 ;
+        }
+        fflush(stdout);
+    }
+}
+
+int main( int argc, char **argv ) {
+    int port = 1234 ;
+    int tuner = 5 ; // R820T
+    double kill_after = 0 ;
+    int opt ;
+
+    while( (opt = getopt( argc, argv, "p:t:k:" )) != -1 ) {
+        switch( opt ) {
+        case 'p': port = atoi(optarg) ; break ;
+        case 't': tuner = atoi(optarg) ; break ;
+        case 'k': kill_after = atof(optarg) ; break ;
+        default:
+            fprintf( stderr, "usage : %s [-p port] [-t tuner_type] [-k seconds]\n", argv[0] );
+            return(1);
+        }
+    }
+    signal( SIGPIPE, SIG_IGN );
+    int listener = socket( AF_INET, SOCK_STREAM, 0 );
+    int on = 1 ;
+    setsockopt( listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr ;
+    memset( &addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET ;
+    addr.sin_port = htons( port );
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    if( (bind( listener, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen( listener, 1 ) != 0) ) {
+        fprintf( stderr, "cannot listen on port %d\n", port );
+        return(1);
+    }
+    printf("listening on 127.0.0.1:%d\n", port );
+    fflush(stdout);
+    for( ; ; ) {
+        int sock = accept( listener, NULL, NULL );
+        if( sock < 0 ) {
+            continue ;
+        }
+        printf("client connected\n");
+        serve( sock, tuner, kill_after );
+        close( sock );
+    }
+    return(0);
+}
@@ -0,0 +1,29 @@
+# *
+# * Adds RTLSDR Dongles capability to SDRNode
+# * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+# *
+# * This program is free software: you can redistribute it and/or modify
+# * it under the terms of the GNU General Public License as published by
+# * the Free Software Foundation, either version 2 of the License, or
+# * (at your option) any later version.
+# *
+# * This program is distributed in the hope that it will be useful,
+# * but WITHOUT ANY WARRANTY; without even the implied warranty of
+# * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# * GNU General Public License for more details.
+# *
+# * You should have received a copy of the GNU General Public License
+# * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#
+# rtl_tcp stand-in : serves a synthetic tone like rtl_tcp, prints the commands received
+
+QT       -= core gui
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TARGET = rtltcp_standin
+TEMPLATE = app
+
+SOURCES += \
+    rtltcp_standin.cpp
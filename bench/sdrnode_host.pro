@@ -0,0 +1,44 @@
+# *
+# * Adds RTLSDR Dongles capability to SDRNode
+# * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+# *
+# * This program is free software: you can redistribute it and/or modify
+# * it under the terms of the GNU General Public License as published by
+# * the Free Software Foundation, either version 2 of the License, or
+# * (at your option) any later version.
+# *
+# * This program is distributed in the hope that it will be useful,
+# * but WITHOUT ANY WARRANTY; without even the implied warranty of
+# * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# * GNU General Public License for more details.
+# *
+# * You should have received a copy of the GNU General Public License
+# * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# SDRNode host emulator : loads the driver like SDRNode does and measures what it delivers
+
+QT       -= core gui
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TARGET = sdrnode_host
+TEMPLATE = app
+
+LIBS += -ldl -lpthread
+
+SOURCES += \
+    sdrnode_host.cpp \
+    ../jansson/dump.c \
+    ../jansson/error.c \
+    ../jansson/hashtable.c \
+    ../jansson/hashtable_seed.c \
+    ../jansson/load.c \
+    ../jansson/memory.c \
+    ../jansson/pack_unpack.c \
+    ../jansson/strbuffer.c \
+    ../jansson/strconv.c \
+    ../jansson/utf.c \
+    ../jansson/value.c
+
+HEADERS += \
+    ../entrypoint.h
@@ -0,0 +1,182 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * udp_listen : receives the multicast IQ stream of one device and checks it against the layout of
+ * udp_stream_format.h. Works on loopback with the simulated boards :
+ *
+ *   udp_listen -g 239.255.10.1 -p 5000 -d 10 &
+ *   sdrnode_host -p '{"simulated":[{}],"multicast":{"group":"239.255.10.1","port":5000,"interface":"127.0.0.1"}}' -d 10
+ *
+ * usage : udp_listen [-g group] [-p port] [-i interface] [-d seconds]
+ *
+ * Prints one line per second (datagrams, lost datagrams, received rate) and the context changes,
+ * then a summary. Exits with 1 if a datagram is malformed or the sample index does not follow
+ * the sequence number, 2 if nothing was received.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../udp_stream_format.h"
+
+#define MAX_DATAGRAM (65536)
+
+static double now() {
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( ts.tv_sec + ts.tv_nsec * 1e-9 );
+}
+
+static int bytes_per_sample( int format ) {
+    return( format == UDP_IQ_FORMAT_S16 ? 4 : 2 );
+}
+
+int main( int argc, char **argv ) {
+    const char *group = "239.255.10.1" ;
+    const char *itf = "127.0.0.1" ;
+    int port = 5000 ;
+    double duration = 10 ;
+    int opt ;
+
+    while( (opt = getopt( argc, argv, "g:p:i:d:" )) != -1 ) {
+        switch( opt ) {
+        case 'g': group = optarg ; break ;
+        case 'p': port = atoi(optarg) ; break ;
+        case 'i': itf = optarg ; break ;
+        case 'd': duration = atof(optarg) ; break ;
+        default:
+            fprintf( stderr, "usage : %s [-g group] [-p port] [-i interface] [-d seconds]\n", argv[0] );
+            return(1);
+        }
+    }
+
+    int sock = socket( AF_INET, SOCK_DGRAM, 0 );
+    int on = 1 ;
+    int rcvbuf = 8*1024*1024 ;
+    setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt( sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr ;
+    memset( &addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET ;
+    addr.sin_port = htons( port );
+    addr.sin_addr.s_addr = htonl( INADDR_ANY );
+    if( bind( sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ) {
+        fprintf( stderr, "cannot bind port %d\n", port );
+        return(1);
+    }
+    struct ip_mreq mreq ;
+    mreq.imr_multiaddr.s_addr = inet_addr( group );
+    mreq.imr_interface.s_addr = inet_addr( itf );
+    if( setsockopt( sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0 ) {
+        fprintf( stderr, "cannot join %s on %s\n", group, itf );
+        return(1);
+    }
+    struct timeval tv = { 0, 200000 } ;
+    setsockopt( sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    printf("listening on %s:%d\n", group, port );
+    fflush(stdout);
+
+    static unsigned char buf[MAX_DATAGRAM] ;
+    struct udp_iq_header last ;
+    memset( &last, 0, sizeof(last));
+    bool first = true ;
+    uint64_t datagrams = 0, lost = 0, samples = 0, malformed = 0, index_errors = 0, reordered = 0 ;
+    uint64_t second_datagrams = 0, second_lost = 0, second_samples = 0 ;
+    double start = now();
+    double tick = start + 1 ;
+
+    for( ; ; ) {
+        double t = now();
+        if( t >= tick ) {
+            printf("%.0f s : %llu datagrams, %llu lost, %.0f sps\n", tick - start,
+                   (unsigned long long)second_datagrams, (unsigned long long)second_lost, (double)second_samples );
+            fflush(stdout);
+            second_datagrams = second_lost = second_samples = 0 ;
+            tick += 1 ;
+        }
+        if( t - start >= duration ) {
+            break ;
+        }
+        ssize_t n = recv( sock, buf, sizeof(buf), 0 );
+        if( n < 0 ) {
+            continue ; // timeout, or EINTR
+        }
+
+        struct udp_iq_header h ;
+        if( n < (ssize_t)sizeof(h) ) {
+            malformed++ ;
+            continue ;
+        }
+        memcpy( &h, buf, sizeof(h));
+        if( (h.magic != UDP_IQ_MAGIC) || (h.version != UDP_IQ_VERSION) || (h.header_size < sizeof(h)) ||
+            (n != (ssize_t)(h.header_size + h.sample_count * bytes_per_sample( h.format ))) ) {
+            malformed++ ;
+            continue ;
+        }
+
+        if( !first ) {
+            if( h.seq == last.seq + 1 ) {
+                if( h.sample_index != last.sample_index + last.sample_count ) {
+                    index_errors++ ;
+                }
+            } else if( (int32_t)(h.seq - last.seq) > 0 ) {
+                second_lost += h.seq - last.seq - 1 ;
+                lost += h.seq - last.seq - 1 ;
+                if( h.sample_index <= last.sample_index ) {
+                    index_errors++ ;
+                }
+            } else {
+                reordered++ ;
+                continue ;
+            }
+            if( (h.ctx_version != last.ctx_version) || (h.center_freq != last.center_freq) ||
+                (h.sample_rate != last.sample_rate) ) {
+                printf("%.3f context %u : %llu Hz, %u sps\n", t - start, h.ctx_version,
+                       (unsigned long long)h.center_freq, h.sample_rate );
+            }
+        } else {
+            printf("%.3f first datagram : seq %u, format %s, %u samples, context %u : %llu Hz, %u sps\n",
+                   t - start, h.seq, h.format == UDP_IQ_FORMAT_S16 ? "s16" : "u8", h.sample_count,
+                   h.ctx_version, (unsigned long long)h.center_freq, h.sample_rate );
+            first = false ;
+        }
+        last = h ;
+        datagrams++ ;
+        second_datagrams++ ;
+        samples += h.sample_count ;
+        second_samples += h.sample_count ;
+    }
+
+    printf("datagrams %llu, lost %llu (%.3f%%), reordered %llu, malformed %llu, sample index errors %llu, samples %llu\n",
+           (unsigned long long)datagrams, (unsigned long long)lost,
+           datagrams + lost > 0 ? 100.0 * lost / (datagrams + lost) : 0.0,
+           (unsigned long long)reordered, (unsigned long long)malformed,
+           (unsigned long long)index_errors, (unsigned long long)samples );
+    close( sock );
+    if( (malformed > 0) || (index_errors > 0) ) {
+        return(1);
+    }
+    return( datagrams > 0 ? 0 : 2 );
+}
@@ -0,0 +1,145 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ctl_cache.h"
+#include "rx_device.h"
+
+static void count( uint64_t *counter ) {
+    // single writer under ctl_lock, the metrics endpoint reads
+    __atomic_store_n( counter, *counter + 1, __ATOMIC_RELAXED );
+}
+
+void ctl_cache_reset( struct t_rx_device *dev ) {
+    struct t_ctl_cache *c = &dev->ctl ;
+    c->center_freq = -1 ;
+    c->sample_rate = -1 ;
+    c->agc_mode = -1 ;
+    c->gain_mode = -1 ;
+    c->gain_known = 0 ;
+    c->ppm_known = 0 ;
+}
+
+int ctl_set_sample_rate( struct t_rx_device *dev, int rate ) {
+    struct t_ctl_cache *c = &dev->ctl ;
+    if( c->sample_rate == rate ) {
+        count( &c->avoided );
+        return(0);
+    }
+    count( &c->transfers );
+    int rc = dev->backend->set_sample_rate( dev, rate );
+    c->sample_rate = (rc == 0) ? rate : -1 ;
+    return(rc);
+}
+
+int ctl_set_center_freq( struct t_rx_device *dev, int64_t freq ) {
+    struct t_ctl_cache *c = &dev->ctl ;
+    if( c->center_freq == freq ) {
+        count( &c->avoided );
+        return(0);
+    }
+    count( &c->transfers );
+    int rc = dev->backend->set_center_freq( dev, (uint32_t)freq );
+    c->center_freq = (rc == 0) ? freq : -1 ;
+    return(rc);
+}
+
+int ctl_set_agc_mode( struct t_rx_device *dev, int on ) {
+    struct t_ctl_cache *c = &dev->ctl ;
+    if( c->agc_mode == on ) {
+        count( &c->avoided );
+        return(0);
+    }
+    count( &c->transfers );
+    int rc = dev->backend->set_agc_mode( dev, on );
+    c->agc_mode = (rc == 0) ? on : -1 ;
+    return(rc);
+}
+
+int ctl_set_gain_mode( struct t_rx_device *dev, int manual ) {
+    struct t_ctl_cache *c = &dev->ctl ;
+    if( c->gain_mode == manual ) {
+        count( &c->avoided );
+        return(0);
+    }
+    count( &c->transfers );
+    int rc = dev->backend->set_tuner_gain_mode( dev, manual );
+    c->gain_mode = (rc == 0) ? manual : -1 ;
+    if( manual == 0 ) {
+        c->gain_known = 0 ; // the tuner picks it
+    }
+    return(rc);
+}
+
+int ctl_set_freq_correction( struct t_rx_device *dev, int ppm ) {
+    struct t_ctl_cache *c = &dev->ctl ;
+    if( c->ppm_known && (c->ppm == ppm) ) {
+        count( &c->avoided );
+        return(0);
+    }
+    count( &c->transfers );
+    int rc = dev->backend->set_freq_correction( dev, ppm );
+    c->ppm = ppm ;
+    c->ppm_known = (rc == 0) ;
+    return(rc);
+}
+
+int ctl_set_gain( struct t_rx_device *dev, int tenthdb ) {
+    struct t_ctl_cache *c = &dev->ctl ;
+    int rc = ctl_set_gain_mode( dev, 1 );
+    if( rc != 0 ) {
+        return(rc);
+    }
+    if( c->gain_known && (c->gain == tenthdb) ) {
+        count( &c->avoided );
+        return(0);
+    }
+    count( &c->transfers );
+    rc = dev->backend->set_tuner_gain( dev, tenthdb );
+    c->gain = tenthdb ;
+    c->gain_known = (rc == 0) ;
+    return(rc);
+}
+
+int64_t ctl_get_center_freq( struct t_rx_device *dev ) {
+    struct t_ctl_cache *c = &dev->ctl ;
+    if( c->center_freq >= 0 ) {
+        count( &c->avoided );
+        return( c->center_freq );
+    }
+    count( &c->transfers );
+    int64_t freq = (int64_t)dev->backend->get_center_freq( dev );
+    if( freq > 0 ) {
+        c->center_freq = freq ;
+    }
+    return(freq);
+}
+
+int ctl_get_gain( struct t_rx_device *dev ) {
+    struct t_ctl_cache *c = &dev->ctl ;
+    if( c->gain_known ) {
+        count( &c->avoided );
+        return( c->gain );
+    }
+    count( &c->transfers );
+    int gain = dev->backend->get_tuner_gain( dev );
+    if( (gain > 0) && (c->gain_mode == 1) ) {
+        // the value read in auto mode changes behind our back
+        c->gain = gain ;
+        c->gain_known = 1 ;
+    }
+    return(gain);
+}
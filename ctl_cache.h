@@ -0,0 +1,62 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CTL_CACHE_H
+#define CTL_CACHE_H
+
+#include <stdint.h>
+
+/*
+ * Control plane state cache : the settings last written to the device. Getters are answered from
+ * it, a set to the value already there is not sent, and the gain mode is only sent when it changes,
+ * so each control transfer that could briefly stall the USB stream is one that changes something.
+ * Functions are called with the device ctl_lock held and return 0 on success, like the backends.
+ */
+
+struct t_rx_device ;
+
+struct t_ctl_cache {
+    int64_t center_freq ;   // Hz, -1 unknown
+    int sample_rate ;       // -1 unknown
+    int agc_mode ;          // -1 unknown
+    int gain_mode ;         // -1 unknown, 0 auto, 1 manual
+    int gain ;              // tenth of dB, meaningful when gain_known
+    int gain_known ;
+    int ppm ;               // meaningful when ppm_known
+    int ppm_known ;
+    // read by the metrics endpoint
+    uint64_t transfers ;    // requests sent to the device
+    uint64_t avoided ;      // sets and gets answered by the cache
+};
+
+// nothing known : after the device was opened or reopened
+void ctl_cache_reset( struct t_rx_device *dev );
+
+int ctl_set_sample_rate( struct t_rx_device *dev, int rate );
+int ctl_set_center_freq( struct t_rx_device *dev, int64_t freq );
+int ctl_set_agc_mode( struct t_rx_device *dev, int on );
+int ctl_set_gain_mode( struct t_rx_device *dev, int manual );
+int ctl_set_freq_correction( struct t_rx_device *dev, int ppm );
+
+// manual mode and gain (tenth of dB) in one step, each sent only if it changes
+int ctl_set_gain( struct t_rx_device *dev, int tenthdb );
+
+// 0 if unknown and the device cannot tell
+int64_t ctl_get_center_freq( struct t_rx_device *dev );
+int ctl_get_gain( struct t_rx_device *dev );
+
+#endif // CTL_CACHE_H
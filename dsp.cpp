@@ -0,0 +1,389 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "dsp.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// (k - 127) / 127, same values as the arithmetic version
+static float u8_table[256] ;
+static int table_ready = 0 ;
+
+void dsp_init( void ) {
+    if( table_ready ) {
+        return ;
+    }
+    for( int k=0 ; k < 256 ; k++ ) {
+        u8_table[k] = (k - 127) / 127.0f ;
+    }
+    table_ready = 1 ;
+}
+
+void dsp_u8_to_cf32( const unsigned char *buf, TYPECPX *out, int sample_count ) {
+    for( int i=0 ; i < sample_count ; i++ ) {
+        out[i].re = u8_table[buf[2*i]] ;
+        out[i].im = u8_table[buf[2*i+1]] ;
+    }
+}
+
+void dsp_u8_to_cf32_scalar( const unsigned char *buf, TYPECPX *out, int sample_count ) {
+    for( int i=0 ; i < sample_count ; i++ ) {
+        out[i].re = ((int)buf[2*i  ] - 127) / 127.0f ;
+        out[i].im = ((int)buf[2*i+1] - 127) / 127.0f ;
+    }
+}
+
+#ifdef __SSE2__
+void dsp_u8_to_cf32_sse2( const unsigned char *buf, TYPECPX *out, int sample_count ) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 offset = _mm_set1_ps( 127.0f );
+    const __m128 scale = _mm_set1_ps( 127.0f );
+    float *dst = (float *)(void *)out ;
+    int n = 2 * sample_count ;
+    int i = 0 ;
+    // 16 bytes, 8 complex samples per iteration. Divides like the scalar version, for equal results
+    for( ; i + 16 <= n ; i += 16 ) {
+        __m128i v = _mm_loadu_si128( (const __m128i *)(buf + i) );
+        __m128i lo = _mm_unpacklo_epi8( v, zero );
+        __m128i hi = _mm_unpackhi_epi8( v, zero );
+        __m128 f0 = _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo, zero ));
+        __m128 f1 = _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo, zero ));
+        __m128 f2 = _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi, zero ));
+        __m128 f3 = _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi, zero ));
+        _mm_storeu_ps( dst + i     , _mm_div_ps( _mm_sub_ps( f0, offset ), scale ));
+        _mm_storeu_ps( dst + i + 4 , _mm_div_ps( _mm_sub_ps( f1, offset ), scale ));
+        _mm_storeu_ps( dst + i + 8 , _mm_div_ps( _mm_sub_ps( f2, offset ), scale ));
+        _mm_storeu_ps( dst + i + 12, _mm_div_ps( _mm_sub_ps( f3, offset ), scale ));
+    }
+    for( ; i < n ; i++ ) {
+        dst[i] = ((int)buf[i] - 127) / 127.0f ;
+    }
+}
+#endif
+
+void dsp_dc_block( TYPECPX *samples, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1 ) {
+    TYPECPX x = *xn_1 ;
+    TYPECPX y = *yn_1 ;
+    for( int i=0 ; i < sample_count ; i++ ) {
+        TYPECPX in = samples[i] ;
+        y.re = in.re - x.re + ALPHA_DC * y.re ;
+        y.im = in.im - x.im + ALPHA_DC * y.im ;
+        x = in ;
+        samples[i] = y ;
+    }
+    *xn_1 = x ;
+    *yn_1 = y ;
+}
+
+// filter state is kept in locals, the caller's state is written once per call
+void dsp_convert_dc( const unsigned char *buf, TYPECPX *out, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1 ) {
+    TYPECPX x = *xn_1 ;
+    TYPECPX y = *yn_1 ;
+    for( int i=0 ; i < sample_count ; i++ ) {
+        float I = u8_table[buf[2*i]] ;
+        float Q = u8_table[buf[2*i+1]] ;
+        // see http://peabody.sapp.org/class/dmp2/lab/dcblock/
+        y.re = I - x.re + ALPHA_DC * y.re ;
+        y.im = Q - x.im + ALPHA_DC * y.im ;
+        x.re = I ;
+        x.im = Q ;
+        out[i] = y ;
+    }
+    *xn_1 = x ;
+    *yn_1 = y ;
+}
+
+void dsp_convert_dc_scalar( const unsigned char *buf, TYPECPX *out, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1 ) {
+    TYPECPX x = *xn_1 ;
+    TYPECPX y = *yn_1 ;
+    for( int i=0 ; i < sample_count ; i++ ) {
+        float I = ((int)buf[2*i  ] - 127) / 127.0f ;
+        float Q = ((int)buf[2*i+1] - 127) / 127.0f ;
+        y.re = I - x.re + ALPHA_DC * y.re ;
+        y.im = Q - x.im + ALPHA_DC * y.im ;
+        x.re = I ;
+        x.im = Q ;
+        out[i] = y ;
+    }
+    *xn_1 = x ;
+    *yn_1 = y ;
+}
+
+void dsp_convert_iq_scalar( const unsigned char *buf, TYPECPX *out, int sample_count, struct t_iq_balance *iq ) {
+    float ci = iq->ci, cq = iq->cq ;
+    double si = 0, sq = 0, sii = 0, sqq = 0, siq = 0 ;
+    for( int i=0 ; i < sample_count ; i++ ) {
+        float I = ((int)buf[2*i  ] - 127) / 127.0f ;
+        float Q = ((int)buf[2*i+1] - 127) / 127.0f ;
+        si += I ;
+        sq += Q ;
+        sii += I * I ;
+        sqq += Q * Q ;
+        siq += I * Q ;
+        out[i].re = I ;
+        out[i].im = cq * Q + ci * I ;
+    }
+    iq->si += si ;
+    iq->sq += sq ;
+    iq->sii += sii ;
+    iq->sqq += sqq ;
+    iq->siq += siq ;
+    iq->count += sample_count ;
+}
+
+void dsp_convert_dc_iq_scalar( const unsigned char *buf, TYPECPX *out, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1,
+                               struct t_iq_balance *iq ) {
+    TYPECPX x = *xn_1 ;
+    TYPECPX y = *yn_1 ;
+    float ci = iq->ci, cq = iq->cq ;
+    double si = 0, sq = 0, sii = 0, sqq = 0, siq = 0 ;
+    for( int i=0 ; i < sample_count ; i++ ) {
+        float I = ((int)buf[2*i  ] - 127) / 127.0f ;
+        float Q = ((int)buf[2*i+1] - 127) / 127.0f ;
+        y.re = I - x.re + ALPHA_DC * y.re ;
+        y.im = Q - x.im + ALPHA_DC * y.im ;
+        x.re = I ;
+        x.im = Q ;
+        si += y.re ;
+        sq += y.im ;
+        sii += y.re * y.re ;
+        sqq += y.im * y.im ;
+        siq += y.re * y.im ;
+        out[i].re = y.re ;
+        out[i].im = cq * y.im + ci * y.re ;
+    }
+    *xn_1 = x ;
+    *yn_1 = y ;
+    iq->si += si ;
+    iq->sq += sq ;
+    iq->sii += sii ;
+    iq->sqq += sqq ;
+    iq->siq += siq ;
+    iq->count += sample_count ;
+}
+
+#ifdef __SSE2__
+// moments of 2 complex samples per register, in float for IQ_CHUNK samples at most then added to iq
+#define IQ_CHUNK (1024)
+
+struct t_iq_acc {
+    __m128 s ;     // I0 Q0 I1 Q1
+    __m128 sq ;    // I0² Q0² I1² Q1²
+    __m128 cross ; // . I0Q0 . I1Q1
+};
+
+// I' = I, Q' = cq Q + ci I on [I0 Q0 I1 Q1]
+static inline __m128 iq_correct( __m128 v, __m128 cq, __m128 ci, struct t_iq_acc *acc ) {
+    __m128 ii = _mm_shuffle_ps( v, v, _MM_SHUFFLE(2,2,0,0) );
+    acc->s = _mm_add_ps( acc->s, v );
+    acc->sq = _mm_add_ps( acc->sq, _mm_mul_ps( v, v ));
+    acc->cross = _mm_add_ps( acc->cross, _mm_mul_ps( v, ii ));
+    return( _mm_add_ps( _mm_mul_ps( v, cq ), _mm_mul_ps( ii, ci )) );
+}
+
+static void iq_flush( struct t_iq_balance *iq, struct t_iq_acc *acc ) {
+    float s[4], sq[4], cross[4] ;
+    _mm_storeu_ps( s, acc->s );
+    _mm_storeu_ps( sq, acc->sq );
+    _mm_storeu_ps( cross, acc->cross );
+    iq->si += s[0] + s[2] ;
+    iq->sq += s[1] + s[3] ;
+    iq->sii += sq[0] + sq[2] ;
+    iq->sqq += sq[1] + sq[3] ;
+    iq->siq += cross[1] + cross[3] ;
+    acc->s = acc->sq = acc->cross = _mm_setzero_ps();
+}
+
+// 16 bytes to 4 registers of 2 complex samples, (k - 127) / 127 like the table
+static inline void u8_load( const unsigned char *buf, __m128 f[4] ) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 offset = _mm_set1_ps( 127.0f );
+    __m128i v = _mm_loadu_si128( (const __m128i *)buf );
+    __m128i lo = _mm_unpacklo_epi8( v, zero );
+    __m128i hi = _mm_unpackhi_epi8( v, zero );
+    f[0] = _mm_div_ps( _mm_sub_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo, zero )), offset ), offset );
+    f[1] = _mm_div_ps( _mm_sub_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo, zero )), offset ), offset );
+    f[2] = _mm_div_ps( _mm_sub_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi, zero )), offset ), offset );
+    f[3] = _mm_div_ps( _mm_sub_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi, zero )), offset ), offset );
+}
+
+void dsp_convert_iq( const unsigned char *buf, TYPECPX *out, int sample_count, struct t_iq_balance *iq ) {
+    const __m128 cq = _mm_setr_ps( 1.0f, iq->cq, 1.0f, iq->cq );
+    const __m128 ci = _mm_setr_ps( 0.0f, iq->ci, 0.0f, iq->ci );
+    struct t_iq_acc acc ;
+    acc.s = acc.sq = acc.cross = _mm_setzero_ps();
+    float *dst = (float *)(void *)out ;
+    int i = 0 ;
+    for( ; i + 8 <= sample_count ; i += 8 ) {
+        __m128 f[4] ;
+        u8_load( buf + 2*i, f );
+        for( int k=0 ; k < 4 ; k++ ) {
+            _mm_storeu_ps( dst + 2*i + 4*k, iq_correct( f[k], cq, ci, &acc ));
+        }
+        if( ((i + 8) % IQ_CHUNK) == 0 ) {
+            iq_flush( iq, &acc );
+        }
+    }
+    iq_flush( iq, &acc );
+    iq->count += i ;
+    if( i < sample_count ) {
+        dsp_convert_iq_scalar( buf + 2*i, out + i, sample_count - i, iq );
+    }
+}
+
+// the DC filter runs on 2 samples per register :
+//   y0 = d0 + a y[-1],  y1 = d1 + a d0 + a² y[-1],  d = x - x[-1]
+void dsp_convert_dc_iq( const unsigned char *buf, TYPECPX *out, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1,
+                        struct t_iq_balance *iq ) {
+    const __m128 cq = _mm_setr_ps( 1.0f, iq->cq, 1.0f, iq->cq );
+    const __m128 ci = _mm_setr_ps( 0.0f, iq->ci, 0.0f, iq->ci );
+    const __m128 alpha = _mm_set1_ps( (float)ALPHA_DC );
+    const __m128 alpha_y = _mm_setr_ps( (float)ALPHA_DC, (float)ALPHA_DC,
+                                        (float)(ALPHA_DC * ALPHA_DC), (float)(ALPHA_DC * ALPHA_DC) );
+    const __m128 zero = _mm_setzero_ps();
+    __m128 x = _mm_setr_ps( xn_1->re, xn_1->im, xn_1->re, xn_1->im );
+    __m128 y = _mm_setr_ps( yn_1->re, yn_1->im, yn_1->re, yn_1->im );
+    struct t_iq_acc acc ;
+    acc.s = acc.sq = acc.cross = _mm_setzero_ps();
+    float *dst = (float *)(void *)out ;
+    int i = 0 ;
+    for( ; i + 8 <= sample_count ; i += 8 ) {
+        __m128 f[4] ;
+        u8_load( buf + 2*i, f );
+        for( int k=0 ; k < 4 ; k++ ) {
+            __m128 d = _mm_sub_ps( f[k], _mm_shuffle_ps( x, f[k], _MM_SHUFFLE(1,0,1,0) ));
+            __m128 v = _mm_add_ps( d, _mm_add_ps( _mm_mul_ps( alpha, _mm_movelh_ps( zero, d )),
+                                                  _mm_mul_ps( alpha_y, y )) );
+            x = _mm_movehl_ps( f[k], f[k] );
+            y = _mm_movehl_ps( v, v );
+            _mm_storeu_ps( dst + 2*i + 4*k, iq_correct( v, cq, ci, &acc ));
+        }
+        if( ((i + 8) % IQ_CHUNK) == 0 ) {
+            iq_flush( iq, &acc );
+        }
+    }
+    iq_flush( iq, &acc );
+    iq->count += i ;
+    float state[4] ;
+    _mm_storeu_ps( state, x );
+    xn_1->re = state[0] ;
+    xn_1->im = state[1] ;
+    _mm_storeu_ps( state, y );
+    yn_1->re = state[0] ;
+    yn_1->im = state[1] ;
+    if( i < sample_count ) {
+        dsp_convert_dc_iq_scalar( buf + 2*i, out + i, sample_count - i, xn_1, yn_1, iq );
+    }
+}
+#else
+void dsp_convert_iq( const unsigned char *buf, TYPECPX *out, int sample_count, struct t_iq_balance *iq ) {
+    dsp_convert_iq_scalar( buf, out, sample_count, iq );
+}
+
+void dsp_convert_dc_iq( const unsigned char *buf, TYPECPX *out, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1,
+                        struct t_iq_balance *iq ) {
+    dsp_convert_dc_iq_scalar( buf, out, sample_count, xn_1, yn_1, iq );
+}
+#endif
+
+int dsp_count_clipped( const unsigned char *buf, int sample_count ) {
+    int clipped = 0 ;
+    for( int i=0 ; i < sample_count ; i++ ) {
+        unsigned char I = buf[2*i] ;
+        unsigned char Q = buf[2*i+1] ;
+        // (x + 1) & 0xfe is 0 for 0xff and 0x00 only
+        clipped += (((I + 1) & 0xfe) == 0) | (((Q + 1) & 0xfe) == 0) ;
+    }
+    return(clipped);
+}
+
+int dsp_decimate( TYPECPX *samples, int sample_count, int factor ) {
+    int out = sample_count / factor ;
+    float scale = 1.0f / factor ;
+    for( int i=0 ; i < out ; i++ ) {
+        float re = 0, im = 0 ;
+        for( int k=0 ; k < factor ; k++ ) {
+            re += samples[i*factor+k].re ;
+            im += samples[i*factor+k].im ;
+        }
+        samples[i].re = re * scale ;
+        samples[i].im = im * scale ;
+    }
+    return(out);
+}
+
+void dsp_nco( TYPECPX *samples, int sample_count, TYPECPX *phasor, TYPECPX step ) {
+    float pr = phasor->re, pi = phasor->im ;
+    for( int i=0 ; i < sample_count ; i++ ) {
+        float re = samples[i].re, im = samples[i].im ;
+        samples[i].re = re * pr - im * pi ;
+        samples[i].im = re * pi + im * pr ;
+        float t = pr * step.re - pi * step.im ;
+        pi = pr * step.im + pi * step.re ;
+        pr = t ;
+    }
+    // float rounding makes the magnitude drift, renormalized once per block
+    float mag = sqrtf( pr * pr + pi * pi );
+    phasor->re = pr / mag ;
+    phasor->im = pi / mag ;
+}
+
+void dsp_fft( TYPECPX *data, int n ) {
+    // bit reversal
+    for( int i=1, j=0 ; i < n ; i++ ) {
+        int bit = n >> 1 ;
+        for( ; j & bit ; bit >>= 1 ) {
+            j ^= bit ;
+        }
+        j ^= bit ;
+        if( i < j ) {
+            TYPECPX t = data[i] ;
+            data[i] = data[j] ;
+            data[j] = t ;
+        }
+    }
+    // butterflies, twiddles by recurrence in double
+    for( int len=2 ; len <= n ; len <<= 1 ) {
+        double angle = -2 * M_PI / len ;
+        double wr_step = cos( angle ), wi_step = sin( angle );
+        int half = len >> 1 ;
+        double wr = 1, wi = 0 ;
+        for( int k=0 ; k < half ; k++ ) {
+            float cr = (float)wr, ci = (float)wi ;
+            for( int i=k ; i < n ; i += len ) {
+                TYPECPX *a = &data[i] ;
+                TYPECPX *b = &data[i + half] ;
+                float tr = b->re * cr - b->im * ci ;
+                float ti = b->re * ci + b->im * cr ;
+                b->re = a->re - tr ;
+                b->im = a->im - ti ;
+                a->re += tr ;
+                a->im += ti ;
+            }
+            double t = wr * wr_step - wi * wi_step ;
+            wi = wr * wi_step + wi * wr_step ;
+            wr = t ;
+        }
+    }
+}
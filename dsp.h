@@ -0,0 +1,68 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DSP_H
+#define DSP_H
+
+#include "rx_device.h"
+
+/*
+ * Sample path kernels, shared by the driver and bench/dsp_bench. Variants of a kernel give the
+ * same output, the driver uses the one named without suffix.
+ */
+
+#define ALPHA_DC (0.9996)
+
+// builds the u8 to float table, before any kernel is used
+void dsp_init( void );
+
+// u8 IQ to float in [-1,1], count complex samples
+void dsp_u8_to_cf32( const unsigned char *buf, TYPECPX *out, int sample_count );        // table
+void dsp_u8_to_cf32_scalar( const unsigned char *buf, TYPECPX *out, int sample_count ); // arithmetic
+#ifdef __SSE2__
+void dsp_u8_to_cf32_sse2( const unsigned char *buf, TYPECPX *out, int sample_count );
+#endif
+
+// DC removal in place, y[n] = x[n] - x[n-1] + alpha * y[n-1]. Filter state in xn_1, yn_1
+void dsp_dc_block( TYPECPX *samples, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1 );
+
+// conversion and DC removal in one pass : what the sample callback does
+void dsp_convert_dc( const unsigned char *buf, TYPECPX *out, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1 );
+void dsp_convert_dc_scalar( const unsigned char *buf, TYPECPX *out, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1 );
+
+// conversion, with or without DC removal, and IQ imbalance correction in one pass. The moments of
+// the uncorrected samples are added to iq. Without suffix : SSE2 when available
+void dsp_convert_iq( const unsigned char *buf, TYPECPX *out, int sample_count, struct t_iq_balance *iq );
+void dsp_convert_iq_scalar( const unsigned char *buf, TYPECPX *out, int sample_count, struct t_iq_balance *iq );
+void dsp_convert_dc_iq( const unsigned char *buf, TYPECPX *out, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1,
+                        struct t_iq_balance *iq );
+void dsp_convert_dc_iq_scalar( const unsigned char *buf, TYPECPX *out, int sample_count, TYPECPX *xn_1, TYPECPX *yn_1,
+                               struct t_iq_balance *iq );
+
+// complex samples with I or Q at 0 or 255, the ADC range
+int dsp_count_clipped( const unsigned char *buf, int sample_count );
+
+// averages groups of factor samples in place, returns the new count
+int dsp_decimate( TYPECPX *samples, int sample_count, int factor );
+
+// frequency shift in place : multiplies by phasor, rotated by step each sample
+void dsp_nco( TYPECPX *samples, int sample_count, TYPECPX *phasor, TYPECPX step );
+
+// forward FFT in place, n a power of 2
+void dsp_fft( TYPECPX *data, int n );
+
+#endif // DSP_H
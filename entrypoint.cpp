@@ -26,63 +26,31 @@
 #include <unistd.h>
 #include <math.h>
 
-#include <rtl-sdr.h>
-
-#include "jansson/jansson.h"
-
-#include "entrypoint.h"
-#define DEBUG_DRIVER (0)
+#include "rx_device.h"
+#include "rtltcp_client.h"
+#include "sim_backend.h"
+#include "rtltcp_server.h"
+#include "shm_ring.h"
+#include "udp_stream.h"
+#include "stream_engine.h"
+#include "numa_placement.h"
+#include "watchdog.h"
+#include "hotplug.h"
+#include "backpressure.h"
+#include "reblock.h"
+#include "dsp.h"
+#include "latency_hist.h"
+#include "metrics.h"
+#include "trace.h"
+#include "hop_schedule.h"
+#include "ppm_correction.h"
+#include "iq_balance.h"
 
 char *driver_name ;
 void* acquisition_thread( void *params ) ;
 
-typedef struct __attribute__ ((__packed__)) _sCplx
-{
-    float re;
-    float im;
-} TYPECPX;
-
-struct t_sample_rates {
-    unsigned int *sample_rates ;
-    int enum_length ;
-    int preffered_sr_index ;
-};
-
-// this structure stores the device state
-struct t_rx_device {
-
-    rtlsdr_dev_t *rtlsdr_device ;
-    char *device_name ;
-    char *device_serial_number ;
-
-    struct t_sample_rates* rates;
-    int current_sample_rate ;
-
-    int64_t min_frq_hz ; // minimal frequency for this device
-    int64_t max_frq_hz ; // maximal frequency for this device
-    int64_t center_frq_hz ; // currently set frequency
-
-
-    float gain ;
-    float gain_min ;
-    float gain_max ;
-    int gain_size ;
-    int *gain_values;
-
-    char *uuid ;
-    bool running ;
-    bool acq_stop ;
-    sem_t mutex;
-
-    pthread_t receive_thread ;
-    // for DC removal
-    TYPECPX xn_1 ;
-    TYPECPX yn_1 ;
-
-    struct ext_Context context ;
-};
-
 int device_count ;
+int rx_capacity ;
 char *stage_name ;
 char *stage_unit ;
 
@@ -99,15 +67,318 @@ BOOL WINAPI DllMain( HINSTANCE hInstance, DWORD dwReason, LPVOID *lpvReserved )
 }
 #endif
 
+static pthread_mutex_t early_log_lock = PTHREAD_MUTEX_INITIALIZER ;
+
 void log( int device_id, int level, char *msg ) {
+    log_class( device_id, level, LOG_GENERAL, msg );
+}
+
+/**
+ * @brief log_deliver hands a message to SDRNode, from the logging thread
+ */
+void log_deliver( int device_id, int level, char *msg ) {
     if( sdrNode_LogFunction != NULL ) {
-        (*sdrNode_LogFunction)(rx[device_id].uuid,level,msg);
-        return ;
+        struct t_rx_device *dev = &rx[device_id] ;
+        pthread_mutex_lock( &early_log_lock );
+        if( dev->uuid != NULL ) {
+            pthread_mutex_unlock( &early_log_lock );
+            (*sdrNode_LogFunction)(dev->uuid,level,msg);
+            return ;
+        }
+        // SDRNode identifies the device by its uuid, keep the message until setBoardUUID()
+        if( dev->early_log_count < EARLY_LOG_SIZE ) {
+            dev->early_log_level[dev->early_log_count] = level ;
+            dev->early_log[dev->early_log_count++] = strdup(msg);
+            pthread_mutex_unlock( &early_log_lock );
+            return ;
+        }
+        pthread_mutex_unlock( &early_log_lock );
     }
     printf("Trace:%s\n", msg );
 }
 
+//-------------------------------------------------------------------
+// local USB backend : direct calls to librtlsdr
+//-------------------------------------------------------------------
+static enum rtlsdr_tuner usb_get_tuner_type( struct t_rx_device *dev ) {
+    return( rtlsdr_get_tuner_type( dev->rtlsdr_device ));
+}
+static int usb_get_tuner_gains( struct t_rx_device *dev, int *gains ) {
+    return( rtlsdr_get_tuner_gains( dev->rtlsdr_device, gains ));
+}
+static int usb_set_center_freq( struct t_rx_device *dev, uint32_t freq ) {
+    return( rtlsdr_set_center_freq( dev->rtlsdr_device, freq ));
+}
+static uint32_t usb_get_center_freq( struct t_rx_device *dev ) {
+    return( rtlsdr_get_center_freq( dev->rtlsdr_device ));
+}
+static int usb_set_sample_rate( struct t_rx_device *dev, uint32_t rate ) {
+    return( rtlsdr_set_sample_rate( dev->rtlsdr_device, rate ));
+}
+static uint32_t usb_get_sample_rate( struct t_rx_device *dev ) {
+    return( rtlsdr_get_sample_rate( dev->rtlsdr_device ));
+}
+static int usb_set_agc_mode( struct t_rx_device *dev, int on ) {
+    return( rtlsdr_set_agc_mode( dev->rtlsdr_device, on ));
+}
+static int usb_set_tuner_gain_mode( struct t_rx_device *dev, int manual ) {
+    return( rtlsdr_set_tuner_gain_mode( dev->rtlsdr_device, manual ));
+}
+static int usb_set_tuner_gain( struct t_rx_device *dev, int gain ) {
+    return( rtlsdr_set_tuner_gain( dev->rtlsdr_device, gain ));
+}
+static int usb_get_tuner_gain( struct t_rx_device *dev ) {
+    return( rtlsdr_get_tuner_gain( dev->rtlsdr_device ));
+}
+static int usb_reset_buffer( struct t_rx_device *dev ) {
+    return( rtlsdr_reset_buffer( dev->rtlsdr_device ));
+}
+static int usb_read_async( struct t_rx_device *dev, rtlsdr_read_async_cb_t cb, void *ctx,
+                           uint32_t buf_num, uint32_t buf_len ) {
+    return( rtlsdr_read_async( dev->rtlsdr_device, cb, ctx, buf_num, buf_len ));
+}
+static int usb_cancel_async( struct t_rx_device *dev ) {
+    return( rtlsdr_cancel_async( dev->rtlsdr_device ));
+}
+static int usb_reopen( struct t_rx_device *dev ) {
+    int index = dev->usb_index ;
+    // the dongle may come back at another index : follow its serial, if no other dongle has the same
+    int same = 0 ;
+    for( int d=0 ; d < device_count ; d++ ) {
+        if( (rx[d].backend == &usb_backend) && (strcmp( rx[d].device_serial_number, dev->device_serial_number ) == 0) ) {
+            same++ ;
+        }
+    }
+    if( (same == 1) && (dev->device_serial_number[0] != 0) ) {
+        int k = rtlsdr_get_index_by_serial( dev->device_serial_number );
+        if( k >= 0 ) {
+            index = k ;
+        }
+    }
+    if( dev->rtlsdr_device != NULL ) {
+        rtlsdr_close( dev->rtlsdr_device );
+        dev->rtlsdr_device = NULL ;
+    }
+    if( rtlsdr_open( &dev->rtlsdr_device, index ) < 0 ) {
+        dev->rtlsdr_device = NULL ;
+        return(-1);
+    }
+    return(0);
+}
+static int usb_set_freq_correction( struct t_rx_device *dev, int ppm ) {
+    int rc = rtlsdr_set_freq_correction( dev->rtlsdr_device, ppm );
+    return( rc == -2 ? 0 : rc ); // -2 : already set
+}
+
+const struct t_rx_backend usb_backend = {
+    "usb",
+    usb_get_tuner_type,
+    usb_get_tuner_gains,
+    usb_set_center_freq,
+    usb_get_center_freq,
+    usb_set_sample_rate,
+    usb_get_sample_rate,
+    usb_set_agc_mode,
+    usb_set_tuner_gain_mode,
+    usb_set_tuner_gain,
+    usb_get_tuner_gain,
+    usb_reset_buffer,
+    usb_read_async,
+    usb_cancel_async,
+    usb_reopen,
+    usb_set_freq_correction
+};
+
+
+
+/**
+ * @brief rx_device_restore applies frequency, rate and gain as SDRNode last set them, after the device
+ *        was reopened. Caller holds ctl_lock
+ * @param dev
+ */
+void rx_device_restore( struct t_rx_device *dev ) {
+    ctl_cache_reset( dev );
+    ctl_set_sample_rate( dev, dev->current_sample_rate );
+    ctl_set_center_freq( dev, dev->center_frq_hz );
+    ctl_set_agc_mode( dev, 0 );
+    ctl_set_gain( dev, (int)(dev->gain * 10) );
+    ctl_set_freq_correction( dev, dev->ppm );
+}
+
+/**
+ * @brief rx_device_setup opens the device of slot d, reads its capabilities and starts its threads.
+ *        Called by initLibrary() and by the hot-plug monitor for dongles plugged later
+ * @param d slot in rx[]
+ * @param usb_index librtlsdr index of a local dongle, -1 for a rtl_tcp server or a simulated board
+ * @param remote_index rank of the server in the "rtl_tcp" init parameter, then of the board in "simulated"
+ * @return 0 on success
+ */
+int rx_device_setup( int d, int usb_index, int remote_index ) {
+    struct t_rx_device *tmp = &rx[d] ;
+    int rc ;
+    char manufact[256], product[256], serial[256] ;
+    char report[256] ;
+
+    if( usb_index >= 0 ) {
+        tmp->backend = &usb_backend ;
+        tmp->usb_index = usb_index ;
+        rc = (int)rtlsdr_open( &tmp->rtlsdr_device, usb_index );
+        if( rc < 0 ) {
+            // cannot open this device
+            return(-1);
+        }
+        if( DEBUG_DRIVER ) fprintf(stderr,"%s rtlsdr_open(%d) okay\n", __func__, usb_index);
 
+        tmp->device_serial_number = (char *)malloc( sizeof(serial) );
+        tmp->device_serial_number[0] = 0 ;
+        rc = rtlsdr_get_usb_strings( tmp->rtlsdr_device, manufact, product, serial );
+        if( rc == 0 ) {
+            snprintf( tmp->device_serial_number, sizeof(serial), "%s", serial );
+        }
+        tmp->numa_node = numa_node_of_usb_device( usb_index, tmp->device_serial_number );
+    } else if( remote_index < rtltcp_count_servers( root_json )) {
+        tmp->usb_index = -1 ;
+        rc = rtltcp_open( tmp, root_json, remote_index );
+        if( rc < 0 ) {
+            return(-1);
+        }
+        tmp->numa_node = -1 ;
+        if( DEBUG_DRIVER ) fprintf(stderr,"%s rtltcp_open(%s) okay\n", __func__, tmp->device_serial_number);
+    } else {
+        tmp->usb_index = -1 ;
+        rc = sim_open( tmp, root_json, remote_index - rtltcp_count_servers( root_json ));
+        if( rc < 0 ) {
+            return(-1);
+        }
+        tmp->numa_node = -1 ;
+    }
+
+    tmp->uuid = NULL ;
+    pthread_mutex_init( &tmp->ctl_lock, NULL );
+    // zero filled, page aligned
+    tmp->hot = (struct t_rx_hot *)numa_buffer_alloc( sizeof(struct t_rx_hot), tmp->numa_node );
+    if( tmp->hot == NULL ) {
+        return(-1);
+    }
+    sem_init(&tmp->hot->mutex, 0, 0);
+
+    tmp->device_name = (char *)malloc( 64 *sizeof(char));
+
+    tmp->min_frq_hz = 70e6 ;
+    tmp->max_frq_hz = 1700e6 ;
+    enum rtlsdr_tuner ttype = tmp->backend->get_tuner_type( tmp ) ;
+    switch( ttype ) {
+    case RTLSDR_TUNER_UNKNOWN:
+        sprintf( tmp->device_name, "RTL%s", "SDR");
+        break ;
+    case RTLSDR_TUNER_E4000 :
+        sprintf( tmp->device_name, "RTL%s", "E4000");
+        tmp->min_frq_hz = 52e6 ;
+        tmp->max_frq_hz = 2200e6 ;
+        break ;
+    case RTLSDR_TUNER_R820T:
+        sprintf( tmp->device_name, "RTL%s", "820T");
+        tmp->min_frq_hz = 24e6 ;
+        tmp->max_frq_hz = 1766e6 ;
+        break ;
+    case RTLSDR_TUNER_R828D:
+        sprintf( tmp->device_name, "RTL%s", "828D");
+        tmp->min_frq_hz = 24e6 ;
+        tmp->max_frq_hz = 1766e6 ;
+        break ;
+    case RTLSDR_TUNER_FC0013:
+        sprintf( tmp->device_name, "RTL%s", "FC13");
+        tmp->min_frq_hz = 22e6 ;
+        tmp->max_frq_hz = 1100e6 ;
+        break ;
+    case RTLSDR_TUNER_FC0012:
+        sprintf( tmp->device_name, "RTL%s", "FC12");
+        tmp->min_frq_hz = 22e6 ;
+        tmp->max_frq_hz = 948e6 ;
+        break ;
+    case RTLSDR_TUNER_FC2580:
+        sprintf( tmp->device_name, "RTL%s", "FC2580");
+        tmp->min_frq_hz = 146e6 ;
+        tmp->max_frq_hz = 924e6 ;
+        break ;
+
+    default:
+        sprintf( tmp->device_name, "RTL%s", "SDR");
+        break ;
+    }
+
+    tmp->center_frq_hz = tmp->min_frq_hz + 1e6 ; // arbitrary startup freq
+
+    // allocate rates
+    tmp->rates = (struct t_sample_rates*)malloc( sizeof(struct t_sample_rates));
+    tmp->rates->enum_length = 5 ; // we manage 5 different sampling rates
+    tmp->rates->sample_rates = (unsigned int *)malloc( tmp->rates->enum_length * sizeof( unsigned int )) ;
+    tmp->rates->sample_rates[0] = 256*1000 ;
+    tmp->rates->sample_rates[1] = 1000*1000 ;
+    tmp->rates->sample_rates[2] = 1024*1000 ;
+    tmp->rates->sample_rates[3] = 2000*1000 ;
+    tmp->rates->sample_rates[4] = 2*1024*1000 ;
+    tmp->rates->preffered_sr_index = 2 ; // our default sampling rate will be 1024 KHz
+
+
+    // set default SR
+    tmp->current_sample_rate = tmp->rates->sample_rates[tmp->rates->preffered_sr_index] ;
+    ctl_cache_reset( tmp );
+    rc = ctl_set_sample_rate( tmp, tmp->current_sample_rate );
+
+    // disable AGC
+    ctl_set_agc_mode( tmp, 0 );
+    tmp->gain_size = tmp->backend->get_tuner_gains( tmp, NULL );
+    tmp->gain_values = (int *)malloc( tmp->gain_size * sizeof(int) );
+    tmp->gain_min = 999 ;
+    tmp->gain_max = 0 ;
+    tmp->backend->get_tuner_gains( tmp, tmp->gain_values );
+    for( rc = 0 ; rc < tmp->gain_size ;rc ++ ) {
+        if( DEBUG_DRIVER ) fprintf( stderr, "gain[%d]=%d\n",  rc, tmp->gain_values[rc] );
+        float v = tmp->gain_values[rc] / 10.0 ;
+        if( v > 0 ) {
+            if( v < tmp->gain_min ) tmp->gain_min = v ;
+            else
+                if( v > tmp->gain_max ) tmp->gain_max = v ;
+        }
+    }
+    tmp->gain = tmp->gain_min + (tmp->gain_max - tmp->gain_min)/2 ;
+
+    tmp->context.ctx_version = 0 ;
+    tmp->context.center_freq = tmp->center_frq_hz ;
+    tmp->context.sample_rate = tmp->current_sample_rate ;
+    tmp->context.hop_index = -1 ;
+    tmp->dc_block = 1 ;
+    tmp->iq_balance = iq_balance_configured( tmp, d, root_json ) ? 1 : 0 ;
+    tmp->iq_balance_seq = 1 ;
+    tmp->ppm = ppm_configured( tmp, d, root_json );
+    if( tmp->ppm != 0 ) {
+        ctl_set_freq_correction( tmp, tmp->ppm );
+    }
+
+    // create acquisition threads
+    stream_engine_attach( tmp );
+    tmp->watchdog = watchdog_attach( tmp );
+    tmp->backpressure = backpressure_attach( tmp, d, root_json );
+    tmp->reblock = reblock_attach( tmp, d, root_json );
+    tmp->latency = latency_attach( tmp );
+    tmp->ppm_estimator = ppm_estimator_attach( tmp, d );
+    pthread_create(&tmp->receive_thread, NULL, acquisition_thread, tmp );
+    thread_settings_for_device( root_json, tmp->device_serial_number, d, &tmp->acq_settings );
+    if( (tmp->acq_settings.cpu_count == 0) && (tmp->numa_node >= 0) ) {
+        // run next to the USB controller
+        numa_node_cpus( tmp->numa_node, &tmp->acq_settings );
+    }
+    char settings[192] ;
+    thread_settings_apply( tmp->receive_thread, &tmp->acq_settings, -1, settings, sizeof(settings) );
+    snprintf( report, sizeof(report), "acquisition thread: %s numa_node=%d", settings, tmp->numa_node );
+    log( d, 0, report );
+    tmp->tcp_server = rtltcp_server_start( tmp, d, root_json );
+    tmp->shm = shm_ring_start( tmp, d, root_json );
+    tmp->multicast = udp_stream_start( tmp, d, root_json );
+    tmp->present = 1 ;
+    return(0);
+}
 
 /*
  * First function called by SDRNode - must return 0 if hardware is not present or problem
@@ -125,9 +396,7 @@ LIBRARY_API int initLibrary(char *json_init_params,
                             _pushSamplesFun *acqCb ) {
     json_error_t error;
     root_json = NULL ;
-    struct t_rx_device *tmp ;
     int rc ;
-    char manufact[256], product[256], serial[256] ;
 
     sdrNode_LogFunction = ptr ;
     acqCbFunction = acqCb ;
@@ -136,128 +405,50 @@ LIBRARY_API int initLibrary(char *json_init_params,
         root_json = json_loads(json_init_params, 0, &error);
 
     }
+    trace_setup( root_json );
+    TRACE_ENTRY(-1);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s\n", __func__);
 
     driver_name = (char *)malloc( 100*sizeof(char));
     snprintf(driver_name,100,"RTLSDR");
 
-    // Step 1 : count how many devices we have
-    device_count = (int)rtlsdr_get_device_count();
-    if( device_count == 0 ) {
+    // Step 1 : count how many devices we have, local dongles first then rtl_tcp servers and simulated boards
+    int usb_count = (int)rtlsdr_get_device_count();
+    int tcp_count = rtltcp_count_servers( root_json );
+    device_count = usb_count + tcp_count + sim_count_devices( root_json );
+    // with hot-plug, room for the dongles plugged later
+    rx_capacity = hotplug_capacity( root_json, device_count );
+    if( rx_capacity == 0 ) {
         return(0); // no hardware
     }
 
-    rx = (struct t_rx_device *)malloc( device_count * sizeof(struct t_rx_device));
+    rx = (struct t_rx_device *)calloc( rx_capacity, sizeof(struct t_rx_device));
     if( rx == NULL ) {
         return(0);
     }
-    tmp = rx ;
+    log_queue_setup( root_json );
+    dsp_init();
+    char report[256] ;
+    thread_tuning_setup( root_json, report, sizeof(report) );
+    numa_placement_setup( root_json );
+    if( report[0] != 0 ) {
+        log( 0, 0, report );
+    }
+    stream_engine_setup( root_json );
+    watchdog_setup( root_json );
+    latency_setup( root_json );
+    ppm_estimator_setup( root_json );
+    metrics_setup( root_json );
     // iterate through devices to populate structure
-    for( int d=0 ; d < device_count ; d++ , tmp++ ) {
-        //
-        rc = (int)rtlsdr_open( &tmp->rtlsdr_device, d );
-        if( rc < 0 ) {
-            // cannot open this device
+    for( int d=0 ; d < device_count ; d++ ) {
+        rc = (d < usb_count) ? rx_device_setup( d, d, -1 ) : rx_device_setup( d, -1, d - usb_count );
+        if( rc != 0 ) {
             return(0);
         }
-        if( DEBUG_DRIVER ) fprintf(stderr,"%s rtlsdr_open(%d) okay\n", __func__, d);
-
-        tmp->uuid = NULL ;
-        tmp->running = false ;
-        tmp->acq_stop = false ;
-        sem_init(&tmp->mutex, 0, 0);
-
-        tmp->device_name = (char *)malloc( 64 *sizeof(char));
-        tmp->device_serial_number = (char *)malloc( 16 *sizeof(char));
-        rc = rtlsdr_get_usb_strings( tmp->rtlsdr_device, manufact, product, serial );
-        if( rc == 0 ) {
-            sprintf( tmp->device_serial_number, "%s", serial );
-        }
-
-        tmp->min_frq_hz = 70e6 ;
-        tmp->max_frq_hz = 1700e6 ;
-        enum rtlsdr_tuner ttype = rtlsdr_get_tuner_type( tmp->rtlsdr_device ) ;
-        switch( ttype ) {
-        case RTLSDR_TUNER_UNKNOWN:
-            sprintf( tmp->device_name, "RTL%s", "SDR");
-            break ;
-        case RTLSDR_TUNER_E4000 :
-            sprintf( tmp->device_name, "RTL%s", "E4000");
-            tmp->min_frq_hz = 52e6 ;
-            tmp->max_frq_hz = 2200e6 ;
-            break ;
-        case RTLSDR_TUNER_R820T:
-            sprintf( tmp->device_name, "RTL%s", "820T");
-            tmp->min_frq_hz = 24e6 ;
-            tmp->max_frq_hz = 1766e6 ;
-            break ;
-        case RTLSDR_TUNER_R828D:
-            sprintf( tmp->device_name, "RTL%s", "828D");
-            tmp->min_frq_hz = 24e6 ;
-            tmp->max_frq_hz = 1766e6 ;
-            break ;
-        case RTLSDR_TUNER_FC0013:
-            sprintf( tmp->device_name, "RTL%s", "FC13");
-            tmp->min_frq_hz = 22e6 ;
-            tmp->max_frq_hz = 1100e6 ;
-            break ;
-        case RTLSDR_TUNER_FC0012:
-            sprintf( tmp->device_name, "RTL%s", "FC12");
-            tmp->min_frq_hz = 22e6 ;
-            tmp->max_frq_hz = 948e6 ;
-            break ;
-        case RTLSDR_TUNER_FC2580:
-            sprintf( tmp->device_name, "RTL%s", "FC2580");
-            tmp->min_frq_hz = 146e6 ;
-            tmp->max_frq_hz = 924e6 ;
-            break ;
-
-        default:
-            sprintf( tmp->device_name, "RTL%s", "SDR");
-            break ;
-        }
-
-        tmp->center_frq_hz = tmp->min_frq_hz + 1e6 ; // arbitrary startup freq
-
-        // allocate rates
-        tmp->rates = (struct t_sample_rates*)malloc( sizeof(struct t_sample_rates));
-        tmp->rates->enum_length = 5 ; // we manage 5 different sampling rates
-        tmp->rates->sample_rates = (unsigned int *)malloc( tmp->rates->enum_length * sizeof( unsigned int )) ;
-        tmp->rates->sample_rates[0] = 256*1000 ;
-        tmp->rates->sample_rates[1] = 1000*1000 ;
-        tmp->rates->sample_rates[2] = 1024*1000 ;
-        tmp->rates->sample_rates[3] = 2000*1000 ;
-        tmp->rates->sample_rates[4] = 2*1024*1000 ;
-        tmp->rates->preffered_sr_index = 2 ; // our default sampling rate will be 1024 KHz
-
-
-        // set default SR
-        tmp->current_sample_rate = tmp->rates->sample_rates[tmp->rates->preffered_sr_index] ;
-        rc = rtlsdr_set_sample_rate( tmp->rtlsdr_device, tmp->current_sample_rate );
-
-        // disable AGC
-        rtlsdr_set_agc_mode( tmp->rtlsdr_device, 0 );
-        tmp->gain_size = rtlsdr_get_tuner_gains( tmp->rtlsdr_device, NULL );
-        tmp->gain_values = (int *)malloc( tmp->gain_size * sizeof(int) );
-        tmp->gain_min = 999 ;
-        tmp->gain_max = 0 ;
-        rtlsdr_get_tuner_gains( tmp->rtlsdr_device, tmp->gain_values );
-        for( rc = 0 ; rc < tmp->gain_size ;rc ++ ) {
-            if( DEBUG_DRIVER ) fprintf( stderr, "gain[%d]=%d\n",  rc, tmp->gain_values[rc] );
-            float v = tmp->gain_values[rc] / 10.0 ;
-            if( v > 0 ) {
-                if( v < tmp->gain_min ) tmp->gain_min = v ;
-                else
-                    if( v > tmp->gain_max ) tmp->gain_max = v ;
-            }
-        }
-        tmp->gain = tmp->gain_min + (tmp->gain_max - tmp->gain_min)/2 ;
-
-        tmp->context.ctx_version = 0 ;
-
-        // create acquisition threads
-        pthread_create(&tmp->receive_thread, NULL, acquisition_thread, tmp );
     }
+    watchdog_start();
+    hotplug_start();
+    metrics_start();
 
     // all RTLSDR have one single gain stage
     stage_name = (char *)malloc( 10*sizeof(char));
@@ -277,6 +468,7 @@ LIBRARY_API int initLibrary(char *json_init_params,
  * @return
  */
 LIBRARY_API int setBoardUUID( int device_id, char *uuid ) {
+    TRACE_ENTRY(device_id);
     int len = 0 ;
 
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%s)\n", __func__, device_id, uuid );
@@ -288,11 +480,27 @@ LIBRARY_API int setBoardUUID( int device_id, char *uuid ) {
         return(RC_NOK);
 
     len = strlen(uuid);
-    if( rx[device_id].uuid != NULL ) {
-        free( rx[device_id].uuid );
+    char *copy = (char *)malloc( (len+1) * sizeof(char));
+    strcpy( copy, uuid);
+
+    // now SDRNode can tell which device the startup messages are about
+    // taken out under the lock, logged without it : delivery may be synchronous and lock it again
+    struct t_rx_device *dev = &rx[device_id] ;
+    char *early[EARLY_LOG_SIZE] ;
+    int early_level[EARLY_LOG_SIZE] ;
+    pthread_mutex_lock( &early_log_lock );
+    char *old = dev->uuid ;
+    dev->uuid = copy ;
+    int early_count = dev->early_log_count ;
+    memcpy( early, dev->early_log, early_count * sizeof(char *));
+    memcpy( early_level, dev->early_log_level, early_count * sizeof(int));
+    dev->early_log_count = 0 ;
+    pthread_mutex_unlock( &early_log_lock );
+    for( int k=0 ; k < early_count ; k++ ) {
+        log( device_id, early_level[k], early[k] );
+        free( early[k] );
     }
-    rx[device_id].uuid = (char *)malloc( len * sizeof(char));
-    strcpy( rx[device_id].uuid, uuid);
+    free( old );
     return(RC_OK);
 }
 
@@ -302,6 +510,7 @@ LIBRARY_API int setBoardUUID( int device_id, char *uuid ) {
  * @return a string with the hardware name, this name is listed in the 'devices' admin page and appears 'as is' in the scripts
  */
 LIBRARY_API char *getHardwareName(int device_id) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s\n", __func__);
     if( device_id >= device_count )
         return(NULL);
@@ -314,16 +523,182 @@ LIBRARY_API char *getHardwareName(int device_id) {
  * @return the number of devices managed by the driver
  */
 LIBRARY_API int getBoardCount() {
+    TRACE_ENTRY(-1);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s\n", __func__);
     return(device_count);
 }
 
+/**
+ * @brief getBoardGeneration lets SDRNode poll for hot-plug events
+ * @return a counter incremented each time a board appears or disappears
+ */
+LIBRARY_API int getBoardGeneration() {
+    TRACE_ENTRY(-1);
+    if( DEBUG_DRIVER ) fprintf(stderr,"%s\n", __func__);
+    return( __atomic_load_n( &hotplug_generation, __ATOMIC_ACQUIRE ));
+}
+
+/**
+ * @brief isBoardPresent tells whether the device can be used. An unplugged dongle keeps its id
+ * @param device_id
+ * @return 1 if present, 0 otherwise
+ */
+LIBRARY_API int isBoardPresent( int device_id ) {
+    TRACE_ENTRY(device_id);
+    if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
+    if( device_id >= device_count )
+        return(0);
+    return( __atomic_load_n( &rx[device_id].present, __ATOMIC_ACQUIRE ));
+}
+
+/**
+ * @brief getBoardIdBySerial finds the id of a device, present or not
+ * @param serial as returned by getSerialNumber()
+ * @return device id, -1 if unknown
+ */
+LIBRARY_API int getBoardIdBySerial( char *serial ) {
+    TRACE_ENTRY(-1);
+    if( DEBUG_DRIVER ) fprintf(stderr,"%s(%s)\n", __func__, serial);
+    if( serial == NULL )
+        return(-1);
+    for( int d=0 ; d < device_count ; d++ ) {
+        if( strcmp( rx[d].device_serial_number, serial ) == 0 ) {
+            return(d);
+        }
+    }
+    return(-1);
+}
+
+/**
+ * @brief getLatencyHistograms sample path latency of a device : callback time, pushSamples duration,
+ *        USB completion to push and transfer interval, each with count, p50, p99, p99.9 and max
+ *        in microseconds. Needs "latency_histograms" in the init parameters
+ * @param device_id
+ * @param json receives the JSON object, nul terminated
+ * @param json_len size of json
+ * @return RC_OK, RC_NOK if disabled or json is too small
+ */
+LIBRARY_API int getLatencyHistograms( int device_id, char *json, int json_len ) {
+    TRACE_ENTRY(device_id);
+    if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
+    if( (device_id < 0) || (device_id >= device_count) || (json == NULL) || (json_len <= 0) )
+        return(RC_NOK);
+    struct t_rx_device *dev = &rx[device_id] ;
+    if( dev->latency == NULL )
+        return(RC_NOK);
+
+    json_t *report = latency_report( dev->latency );
+    json_object_set_new( report, "serial", json_string( dev->device_serial_number ));
+    char *text = json_dumps( report, JSON_COMPACT | JSON_PRESERVE_ORDER );
+    json_decref( report );
+    int rc = RC_NOK ;
+    if( (text != NULL) && ((int)strlen(text) < json_len) ) {
+        strcpy( json, text );
+        rc = RC_OK ;
+    }
+    free( text );
+    return(rc);
+}
+
+/**
+ * @brief getIQBalanceStats IQ imbalance measured by the correction stage : Q gain relative to I in dB,
+ *        phase error in degrees and the number of estimates made. Values stay at 0 until the
+ *        correction is enabled ("iq_balance" in the init parameters or setRxConfig)
+ * @param device_id
+ * @param json receives the JSON object, nul terminated
+ * @param json_len size of json
+ * @return RC_OK, RC_NOK if json is too small
+ */
+LIBRARY_API int getIQBalanceStats( int device_id, char *json, int json_len ) {
+    TRACE_ENTRY(device_id);
+    if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
+    if( (device_id < 0) || (device_id >= device_count) || (json == NULL) || (json_len <= 0) )
+        return(RC_NOK);
+    struct t_rx_device *dev = &rx[device_id] ;
+
+    json_t *report = iq_balance_report( dev );
+    json_object_set_new( report, "serial", json_string( dev->device_serial_number ));
+    char *text = json_dumps( report, JSON_COMPACT | JSON_PRESERVE_ORDER );
+    json_decref( report );
+    int rc = RC_NOK ;
+    if( (text != NULL) && ((int)strlen(text) < json_len) ) {
+        strcpy( json, text );
+        rc = RC_OK ;
+    }
+    free( text );
+    return(rc);
+}
+
+/**
+ * @brief dumpTrace writes the events kept by the trace recorder (entry points, acquisition and DSP stages)
+ *        in the Chrome trace format, to open in chrome://tracing or ui.perfetto.dev. Needs "trace"
+ *        in the init parameters. Recording goes on during the dump
+ * @param filename
+ * @return RC_OK, RC_NOK if disabled or the file cannot be written
+ */
+LIBRARY_API int dumpTrace( char *filename ) {
+    TRACE_ENTRY(-1);
+    if( DEBUG_DRIVER ) fprintf(stderr,"%s(%s)\n", __func__, filename);
+    if( filename == NULL )
+        return(RC_NOK);
+    return( trace_dump( filename ) == 0 ? RC_OK : RC_NOK );
+}
+
+/**
+ * @brief setHopSchedule loads the frequency list the device cycles through once startHopSchedule()
+ *        is called. Hops are done by the acquisition at transfer boundaries, see hop_schedule.h
+ * @param device_id
+ * @param json schedule
+ * @return RC_OK, RC_NOK if the schedule is invalid
+ */
+LIBRARY_API int setHopSchedule( int device_id, char *json ) {
+    TRACE_ENTRY(device_id);
+    json_error_t error ;
+    if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%s)\n", __func__, device_id, json);
+    if( (device_id < 0) || (device_id >= device_count) || (json == NULL) )
+        return(RC_NOK);
+    json_t *conf = json_loads( json, 0, &error );
+    if( conf == NULL )
+        return(RC_NOK);
+    int rc = hop_schedule_load( &rx[device_id], device_id, conf );
+    json_decref( conf );
+    return( rc == 0 ? RC_OK : RC_NOK );
+}
+
+/**
+ * @brief startHopSchedule starts hopping from the first entry of the schedule
+ * @param device_id
+ * @return RC_OK, RC_NOK if no schedule was loaded
+ */
+LIBRARY_API int startHopSchedule( int device_id ) {
+    TRACE_ENTRY(device_id);
+    if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
+    if( (device_id < 0) || (device_id >= device_count) )
+        return(RC_NOK);
+    return( hop_schedule_start( &rx[device_id] ) == 0 ? RC_OK : RC_NOK );
+}
+
+/**
+ * @brief stopHopSchedule stops hopping, the device stays on the current frequency
+ * @param device_id
+ * @return
+ */
+LIBRARY_API int stopHopSchedule( int device_id ) {
+    TRACE_ENTRY(device_id);
+    if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
+    if( (device_id < 0) || (device_id >= device_count) )
+        return(RC_NOK);
+    hop_schedule_stop( &rx[device_id] );
+    return(RC_OK);
+}
+
 /**
  * @brief getPossibleSampleRateCount called to know how many sample rates are available. Used to fill the select zone in admin
  * @param device_id
  * @return sample rate in Hz
  */
 LIBRARY_API int getPossibleSampleRateCount(int device_id) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s\n", __func__);
     if( device_id >= device_count )
         return(0);
@@ -338,6 +713,7 @@ LIBRARY_API int getPossibleSampleRateCount(int device_id) {
  * @return
  */
 LIBRARY_API unsigned int getPossibleSampleRateValue(int device_id, int index) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, index );
     if( device_id >= device_count )
         return(0);
@@ -351,6 +727,7 @@ LIBRARY_API unsigned int getPossibleSampleRateValue(int device_id, int index) {
 }
 
 LIBRARY_API unsigned int getPrefferedSampleRateValue(int device_id) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s\n", __func__);
     if( device_id >= device_count )
         return(0);
@@ -361,6 +738,7 @@ LIBRARY_API unsigned int getPrefferedSampleRateValue(int device_id) {
 }
 //-------------------------------------------------------------------
 LIBRARY_API int64_t getMin_HWRx_CenterFreq(int device_id) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s\n", __func__);
     if( device_id >= device_count )
         return(0);
@@ -369,6 +747,7 @@ LIBRARY_API int64_t getMin_HWRx_CenterFreq(int device_id) {
 }
 
 LIBRARY_API int64_t getMax_HWRx_CenterFreq(int device_id) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s\n", __func__);
     if( device_id >= device_count )
         return(0);
@@ -383,30 +762,35 @@ LIBRARY_API int64_t getMax_HWRx_CenterFreq(int device_id) {
 // each stage can be 'continuous gain' or 'discrete' (on/off for example)
 //-------------------------------------------------------------------
 LIBRARY_API int getRxGainStageCount(int device_id) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
     // RTLSDR have only one stage
     return(1);
 }
 
 LIBRARY_API char* getRxGainStageName( int device_id, int stage) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%d)\n", __func__, device_id, stage );
     // RTLSDR have only one stage so the name is same for all
     return( stage_name );
 }
 
 LIBRARY_API char* getRxGainStageUnitName( int device_id, int stage) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%d)\n", __func__, device_id, stage );
     // RTLSDR have only one stage so the unit is same for all
     return( stage_unit );
 }
 
 LIBRARY_API int getRxGainStageType( int device_id, int stage) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%d)\n", __func__, device_id, stage );
     // continuous value
     return(0);
 }
 
 LIBRARY_API float getMinGainValue(int device_id,int stage) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%d)\n", __func__, device_id, stage );
     if( device_id >= device_count )
         return(0);
@@ -415,6 +799,7 @@ LIBRARY_API float getMinGainValue(int device_id,int stage) {
 }
 
 LIBRARY_API float getMaxGainValue(int device_id,int stage) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%d)\n", __func__, device_id, stage );
     if( device_id >= device_count )
         return(0);
@@ -423,11 +808,13 @@ LIBRARY_API float getMaxGainValue(int device_id,int stage) {
 }
 
 LIBRARY_API int getGainDiscreteValuesCount( int device_id, int stage ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%d)\n", __func__, device_id, stage);
     return(0);
 }
 
 LIBRARY_API float getGainDiscreteValue( int device_id, int stage, int index ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d, %d,%d)\n", __func__, device_id, stage, index);
     return(0);
 }
@@ -438,6 +825,7 @@ LIBRARY_API float getGainDiscreteValue( int device_id, int stage, int index ) {
  * @return
  */
 LIBRARY_API char* getSerialNumber( int device_id ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
     if( device_id >= device_count )
         return(RC_NOK);
@@ -452,41 +840,97 @@ LIBRARY_API char* getSerialNumber( int device_id ) {
 // when the driver shall stop, SDRNode calls finalizeRXEngine()
 
 /**
- * @brief prepareRXEngine trig on the acquisition process for the device
+ * @brief prepareRXEngine trig on the acquisition process for the device. A stream in warm idle
+ *        is just ungated, otherwise the acquisition thread is woken up
  * @param device_id
  * @return RC_OK if streaming has started, RC_NOK otherwise
  */
 LIBRARY_API int prepareRXEngine( int device_id ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
     if( device_id >= device_count )
         return(RC_NOK);
 
-    // here we keep it simple, just fire the relevant mutex
     struct t_rx_device *dev = &rx[device_id] ;
-    dev->acq_stop = false ;
-    rtlsdr_reset_buffer( dev->rtlsdr_device);
-    sem_post(&dev->mutex);
+    if( !__atomic_load_n( &dev->present, __ATOMIC_ACQUIRE ) )
+        return(RC_NOK);
+    __atomic_add_fetch( &dev->hot->starts, 1, __ATOMIC_RELEASE ); // drops a partial push block
+    int expected = RX_IDLE ;
+    if( __atomic_compare_exchange_n( &dev->hot->state, &expected, RX_STREAMING, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE )) {
+        return(RC_OK);
+    }
+
+    // here we keep it simple, just fire the relevant mutex
+    __atomic_store_n( &dev->hot->last_block_ms, rx_now_ms(), __ATOMIC_RELAXED );
+    __atomic_store_n( &dev->hot->state, RX_STREAMING, __ATOMIC_RELEASE );
+    pthread_mutex_lock( &dev->ctl_lock );
+    dev->backend->reset_buffer( dev );
+    pthread_mutex_unlock( &dev->ctl_lock );
+    sem_post(&dev->hot->mutex);
 
     return(RC_OK);
 }
 
 /**
- * @brief finalizeRXEngine stops the acquisition process
+ * @brief finalizeRXEngine stops the acquisition process. With warm idle enabled the USB stream
+ *        keeps running, samples are no more pushed, until prepareRXEngine() or the idle timeout
  * @param device_id
  * @return
  */
 LIBRARY_API int finalizeRXEngine( int device_id ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
     if( device_id >= device_count )
         return(RC_NOK);
 
     struct t_rx_device *dev = &rx[device_id] ;
-    dev->acq_stop = true ;
-    rtlsdr_cancel_async( dev->rtlsdr_device ) ;
+    dev->resume = 0 ; // an unplugged dongle shall not restart when plugged again
+    if( (stream_engine.warm_idle_ms != 0) && __atomic_load_n( &dev->hot->running, __ATOMIC_ACQUIRE ) ) {
+        __atomic_store_n( &dev->hot->idle_since, rx_now_ms(), __ATOMIC_RELAXED );
+        __atomic_store_n( &dev->hot->state, RX_IDLE, __ATOMIC_RELEASE );
+        return(RC_OK);
+    }
+    __atomic_store_n( &dev->hot->state, RX_STOPPING, __ATOMIC_RELEASE );
+    pthread_mutex_lock( &dev->ctl_lock );
+    dev->backend->cancel_async( dev ) ;
+    pthread_mutex_unlock( &dev->ctl_lock );
 
     return(RC_OK);
 }
 
+// closest rate the RTL2832 supports
+static int supported_sample_rate( int sample_rate ) {
+    if( (sample_rate<225001)) {
+        sample_rate = 256e3 ;
+    } else if( (sample_rate>300e3) && (sample_rate<900e3)) {
+        sample_rate = 1000e3 ;
+    } else if( sample_rate>3200e3) {
+        sample_rate = 3200e3 ;
+    }
+    return(sample_rate);
+}
+
+// gain in dB to the closest tuner gain, in tenth of dB
+static int tuner_gain( struct t_rx_device *dev, float gain_value ) {
+    // check value against device range
+    if( gain_value > dev->gain_max ) {
+        gain_value = dev->gain_max ;
+    }
+    if( gain_value < dev->gain_min ) {
+        gain_value = dev->gain_min ;
+    }
+    // find the most appropriate device value
+    int tenthdb = (int)(gain_value*10); // RTLSDR gains are in tenth of db
+    for( int k=0 ; k < dev->gain_size-1 ; k++ ) {
+        if( ( dev->gain_values[k]<=tenthdb) && (dev->gain_values[k+1]>=tenthdb)) {
+            tenthdb = dev->gain_values[k];
+            break ;
+        }
+    }
+    return(tenthdb);
+}
+
 /**
  * @brief setRxSampleRate configures the sample rate for the device (in Hz). Can be different from the enum given by getXXXSampleRate
  * @param device_id
@@ -494,6 +938,7 @@ LIBRARY_API int finalizeRXEngine( int device_id ) {
  * @return
  */
 LIBRARY_API int setRxSampleRate( int device_id , int sample_rate) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%d)\n", __func__, device_id,sample_rate);
     if( device_id >= device_count )
         return(RC_NOK);
@@ -502,22 +947,21 @@ LIBRARY_API int setRxSampleRate( int device_id , int sample_rate) {
     if( sample_rate == dev->current_sample_rate ) {
         return(RC_OK);
     }
-    if( (sample_rate<225001)) {
-        sample_rate = 256e3 ;
-    } else if( (sample_rate>300e3) && (sample_rate<900e3)) {
-        sample_rate = 1000e3 ;
-    } else if( sample_rate>3200e3) {
-        sample_rate = 3200e3 ;
-    }
+    sample_rate = supported_sample_rate( sample_rate );
 
-    int rc = rtlsdr_set_sample_rate( dev->rtlsdr_device, sample_rate );
+    pthread_mutex_lock( &dev->ctl_lock );
+    bool changed = (sample_rate != dev->ctl.sample_rate) ; // compared once mapped : same rate, same context
+    int rc = ctl_set_sample_rate( dev, sample_rate );
     if( rc == 0 ) {
         dev->current_sample_rate = sample_rate ;
-        dev->context.ctx_version++ ;
-        dev->context.sample_rate = sample_rate ;
+        if( changed ) {
+            dev->context.ctx_version++ ;
+            dev->context.sample_rate = sample_rate ;
+        }
     } else {
-        dev->current_sample_rate = rtlsdr_get_sample_rate( dev->rtlsdr_device );
+        dev->current_sample_rate = dev->backend->get_sample_rate( dev );
     }
+    pthread_mutex_unlock( &dev->ctl_lock );
     return(RC_OK);
 }
 
@@ -527,6 +971,7 @@ LIBRARY_API int setRxSampleRate( int device_id , int sample_rate) {
  * @return
  */
 LIBRARY_API int getActualRxSampleRate( int device_id ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
     if( device_id >= device_count )
         return(RC_NOK);
@@ -535,54 +980,63 @@ LIBRARY_API int getActualRxSampleRate( int device_id ) {
 }
 
 /**
- * @brief setRxCenterFreq tunes device to frq_hz (center frequency)
+ * @brief setRxCenterFreq tunes device to frq_hz (center frequency). Nothing is sent if already tuned there.
+ *        A running hop schedule is stopped
  * @param device_id
  * @param frq_hz
  * @return
  */
 LIBRARY_API int setRxCenterFreq( int device_id, int64_t frq_hz ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%ld)\n", __func__, device_id, (long)frq_hz);
     if( DEBUG_DRIVER ) fflush(stderr);
     if( device_id >= device_count )
         return(RC_NOK);
 
     struct t_rx_device *dev = &rx[device_id] ;
-    int rc = rtlsdr_set_center_freq( dev->rtlsdr_device, (uint32_t)frq_hz  );
-    if( rc == 0 ) {
+    hop_schedule_stop( dev ); // SDRNode takes over
+    pthread_mutex_lock( &dev->ctl_lock );
+    bool changed = (frq_hz != dev->ctl.center_freq) ; // already tuned : no retune, same context
+    int rc = ctl_set_center_freq( dev, frq_hz );
+    if( (rc == 0) && changed ) {
         dev->center_frq_hz = frq_hz ;
         dev->context.ctx_version++ ;
         dev->context.center_freq = frq_hz ;
-        return(RC_OK);
     }
-    return(RC_NOK);
+    pthread_mutex_unlock( &dev->ctl_lock );
+    return( rc == 0 ? RC_OK : RC_NOK );
 }
 
 /**
- * @brief getRxCenterFreq retrieve the current center frequency for the device
+ * @brief getRxCenterFreq retrieve the current center frequency for the device, from the control state cache
  * @param device_id
  * @return
  */
 LIBRARY_API int64_t getRxCenterFreq( int device_id ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
     if( device_id >= device_count )
         return(RC_NOK);
 
     struct t_rx_device *dev = &rx[device_id] ;
-    int64_t frequency = (int64_t)rtlsdr_get_center_freq( dev->rtlsdr_device ) ;
+    pthread_mutex_lock( &dev->ctl_lock );
+    int64_t frequency = ctl_get_center_freq( dev ) ;
     if( frequency > 0 ) {
         dev->center_frq_hz = frequency ;
     }
+    pthread_mutex_unlock( &dev->ctl_lock );
     return( dev->center_frq_hz ) ;
 }
 
 /**
- * @brief setRxGain sets the current gain
+ * @brief setRxGain sets the current gain. Gain mode and value are only sent to the device when they change
  * @param device_id
  * @param stage_id
  * @param gain_value
  * @return
  */
 LIBRARY_API int setRxGain( int device_id, int stage_id, float gain_value ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%d,%f)\n", __func__, device_id,stage_id,gain_value);
     if( device_id >= device_count )
         return(RC_NOK);
@@ -590,43 +1044,26 @@ LIBRARY_API int setRxGain( int device_id, int stage_id, float gain_value ) {
         return(RC_NOK);
 
     struct t_rx_device *dev = &rx[device_id] ;
-    // make sure device is in manual gain mode
-    int rc = rtlsdr_set_tuner_gain_mode( dev->rtlsdr_device, 1);
-
+    int tenthdb = tuner_gain( dev, gain_value );
+    pthread_mutex_lock( &dev->ctl_lock );
+    // manual gain mode and value, each one sent only if it changes
+    int rc = ctl_set_gain( dev, tenthdb );
     if( rc == 0 ) {
-        // check value against device range
-        if( gain_value > dev->gain_max ) {
-            gain_value = dev->gain_max ;
-        }
-        if( gain_value < dev->gain_min ) {
-            gain_value = dev->gain_min ;
-        }
-        // find the most appropriate device value
-        int tenthdb = (int)(gain_value*10); // RTLSDR gains are in tenth of db
-        for( int k=0 ; k < dev->gain_size-1 ; k++ ) {
-            if( ( dev->gain_values[k]<=tenthdb) && (dev->gain_values[k+1]>=tenthdb)) {
-                tenthdb = dev->gain_values[k];
-                break ;
-            }
-        }
-        // set it
-        rc = rtlsdr_set_tuner_gain( dev->rtlsdr_device, tenthdb );
-        if( rc == 0 ) {
-            // keep value
-            dev->gain = tenthdb/10.0 ;
-            return(RC_OK);
-        }
+        // keep value
+        dev->gain = tenthdb/10.0 ;
     }
-    return(RC_NOK);
+    pthread_mutex_unlock( &dev->ctl_lock );
+    return( rc == 0 ? RC_OK : RC_NOK );
 }
 
 /**
- * @brief getRxGainValue reads the current gain value
+ * @brief getRxGainValue reads the current gain value, from the control state cache
  * @param device_id
  * @param stage_id
  * @return
  */
 LIBRARY_API float getRxGainValue( int device_id , int stage_id ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%d)\n", __func__, device_id,stage_id);
 
     if( device_id >= device_count )
@@ -634,20 +1071,148 @@ LIBRARY_API float getRxGainValue( int device_id , int stage_id ) {
     if( stage_id >= 1 )
         return(RC_NOK);
     struct t_rx_device *dev = &rx[device_id] ;
-    int rc = rtlsdr_get_tuner_gain( dev->rtlsdr_device ) ;
+    pthread_mutex_lock( &dev->ctl_lock );
+    int rc = ctl_get_gain( dev ) ;
     if( rc > 0 ) {
         dev->gain = rc/10.0 ;
     }
+    pthread_mutex_unlock( &dev->ctl_lock );
     return( dev->gain) ;
 }
 
 LIBRARY_API bool setAutoGainMode( int device_id ) {
+    TRACE_ENTRY(device_id);
     if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d)\n", __func__, device_id);
     if( device_id >= device_count )
         return(false);
     return(false);
 }
 
+/**
+ * @brief setRxConfig applies several settings in one control sequence, under the device lock, with
+ *        one context change for all of them :
+ *        { "sample_rate" : 2048000, "center_freq" : 162400000, "gain" : 29.7, "ppm" : -12, "dc_block" : true,
+ *          "iq_balance" : true }
+ *        Every key is optional. The document is checked first, nothing is applied if a value is invalid
+ * @param device_id
+ * @param json settings
+ * @return RC_OK, RC_NOK if the document is invalid or the device refused a setting
+ */
+LIBRARY_API int setRxConfig( int device_id, char *json ) {
+    TRACE_ENTRY(device_id);
+    json_error_t error ;
+    char msg[256] ;
+    if( DEBUG_DRIVER ) fprintf(stderr,"%s(%d,%s)\n", __func__, device_id, json);
+    if( (device_id < 0) || (device_id >= device_count) || (json == NULL) )
+        return(RC_NOK);
+    json_t *conf = json_loads( json, 0, &error );
+    if( !json_is_object(conf) ) {
+        json_decref( conf );
+        return(RC_NOK);
+    }
+
+    struct t_rx_device *dev = &rx[device_id] ;
+    json_t *rate = json_object_get( conf, "sample_rate" );
+    json_t *freq = json_object_get( conf, "center_freq" );
+    json_t *gain = json_object_get( conf, "gain" );
+    json_t *ppm = json_object_get( conf, "ppm" );
+    json_t *dc_block = json_object_get( conf, "dc_block" );
+    json_t *iq_balance = json_object_get( conf, "iq_balance" );
+    const char *invalid = NULL ;
+    if( (rate != NULL) && (!json_is_number(rate) || (json_number_value(rate) <= 0)) ) {
+        invalid = "sample_rate" ;
+    } else if( (freq != NULL) && (!json_is_number(freq) || (json_number_value(freq) < dev->min_frq_hz) ||
+                                  (json_number_value(freq) > dev->max_frq_hz)) ) {
+        invalid = "center_freq" ;
+    } else if( (gain != NULL) && !json_is_number(gain) ) {
+        invalid = "gain" ;
+    } else if( (ppm != NULL) && (!json_is_integer(ppm) || (llabs( json_integer_value(ppm) ) > 1000)) ) {
+        invalid = "ppm" ;
+    } else if( (dc_block != NULL) && !json_is_boolean(dc_block) ) {
+        invalid = "dc_block" ;
+    } else if( (iq_balance != NULL) && !json_is_boolean(iq_balance) ) {
+        invalid = "iq_balance" ;
+    }
+    const char *key ;
+    json_t *value ;
+    json_object_foreach( conf, key, value ) {
+        if( (invalid == NULL) && (strcmp( key, "sample_rate" ) != 0) && (strcmp( key, "center_freq" ) != 0) &&
+            (strcmp( key, "gain" ) != 0) && (strcmp( key, "ppm" ) != 0) && (strcmp( key, "dc_block" ) != 0) &&
+            (strcmp( key, "iq_balance" ) != 0) ) {
+            invalid = key ;
+        }
+    }
+    if( invalid != NULL ) {
+        snprintf( msg, sizeof(msg), "setRxConfig: invalid or unknown \"%.64s\", nothing applied", invalid );
+        log( device_id, 0, msg );
+        json_decref( conf );
+        return(RC_NOK);
+    }
+
+    if( freq != NULL ) {
+        hop_schedule_stop( dev ); // SDRNode takes over
+    }
+    int failed = 0 ;
+    bool changed = false ;
+    pthread_mutex_lock( &dev->ctl_lock );
+    // rate first, the tuner settings do not depend on it
+    if( rate != NULL ) {
+        int sample_rate = supported_sample_rate( (int)json_number_value(rate) );
+        changed |= (sample_rate != dev->ctl.sample_rate) ;
+        if( ctl_set_sample_rate( dev, sample_rate ) == 0 ) {
+            dev->current_sample_rate = sample_rate ;
+        } else {
+            dev->current_sample_rate = dev->backend->get_sample_rate( dev );
+            failed++ ;
+        }
+    }
+    if( ppm != NULL ) {
+        int value = (int)json_integer_value(ppm) ;
+        changed |= !dev->ctl.ppm_known || (value != dev->ctl.ppm) ;
+        if( ctl_set_freq_correction( dev, value ) == 0 ) {
+            dev->ppm = value ;
+            __atomic_store_n( &dev->nco_ppb, 0, __ATOMIC_RELAXED );
+        } else {
+            failed++ ;
+        }
+    }
+    if( freq != NULL ) {
+        int64_t frq_hz = (int64_t)json_number_value(freq) ;
+        changed |= (frq_hz != dev->ctl.center_freq) ;
+        if( ctl_set_center_freq( dev, frq_hz ) == 0 ) {
+            dev->center_frq_hz = frq_hz ;
+        } else {
+            failed++ ;
+        }
+    }
+    if( gain != NULL ) {
+        int tenthdb = tuner_gain( dev, (float)json_number_value(gain) );
+        if( ctl_set_gain( dev, tenthdb ) == 0 ) {
+            dev->gain = tenthdb/10.0 ;
+        } else {
+            failed++ ;
+        }
+    }
+    if( (dc_block != NULL) && (json_is_true(dc_block) != (dev->dc_block != 0)) ) {
+        __atomic_store_n( &dev->dc_block, json_is_true(dc_block) ? 1 : 0, __ATOMIC_RELAXED );
+        changed = true ;
+    }
+    if( (iq_balance != NULL) && (json_is_true(iq_balance) != (dev->iq_balance != 0)) ) {
+        __atomic_store_n( &dev->iq_balance, json_is_true(iq_balance) ? 1 : 0, __ATOMIC_RELAXED );
+        __atomic_add_fetch( &dev->iq_balance_seq, 1, __ATOMIC_RELAXED );
+        changed = true ;
+    }
+    if( changed ) {
+        // one new context for everything applied
+        dev->context.sample_rate = dev->current_sample_rate ;
+        dev->context.center_freq = dev->center_frq_hz ;
+        dev->context.ctx_version++ ;
+    }
+    pthread_mutex_unlock( &dev->ctl_lock );
+    json_decref( conf );
+    return( failed == 0 ? RC_OK : RC_NOK );
+}
+
 //-----------------------------------------------------------------------------------------
 // functions below are RTLSDR specific
 // One thread is started by device, and each sample frame calls rtlsdr_callback() with a block
@@ -656,60 +1221,179 @@ LIBRARY_API bool setAutoGainMode( int device_id ) {
 //
 
 
-#define ALPHA_DC (0.9996)
+int64_t rx_now_ms() {
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+int64_t rx_now_us() {
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+/**
+ * @brief rx_stream_gated called for each transfer, tells the callbacks whether samples shall be dropped.
+ *        In warm idle, the stream is really stopped once the idle timeout has elapsed
+ * @param dev
+ * @return true if nothing must be pushed
+ */
+bool rx_stream_gated( struct t_rx_device *dev ) {
+    struct t_rx_hot *hot = dev->hot ;
+    int64_t now = rx_now_ms();
+    __atomic_store_n( &hot->last_block_ms, now, __ATOMIC_RELAXED );
+    int state = __atomic_load_n( &hot->state, __ATOMIC_ACQUIRE );
+    if( state == RX_STREAMING ) {
+        return(false);
+    }
+    if( (state == RX_IDLE) && (stream_engine.warm_idle_ms > 0) &&
+        (now - __atomic_load_n( &hot->idle_since, __ATOMIC_RELAXED ) >= stream_engine.warm_idle_ms) ) {
+        // prepareRXEngine() may race with us, only one of us wins
+        if( __atomic_compare_exchange_n( &hot->state, &state, RX_STOPPING, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE )) {
+            dev->backend->cancel_async( dev ) ;
+        }
+    }
+    return(true);
+}
+
 /**
  * @brief rtlsdr_callback called by rtlsdr driver. This function converts to float and removes DC offset
  * @param buf
  * @param len
  * @param ctx
  */
-void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx) {
-    TYPECPX *samples ;
-    TYPECPX tmp ;
-    float I,Q ;
+// to float, DC removed unless disabled by setRxConfig(), IQ imbalance and residual crystal error corrected
+static void convert( struct t_rx_device* my_device, const unsigned char *buf, TYPECPX *out, int sample_count,
+                     TYPECPX *xn_1, TYPECPX *yn_1 ) {
+    bool dc_block = __atomic_load_n( &my_device->dc_block, __ATOMIC_RELAXED ) ;
+    if( __atomic_load_n( &my_device->iq_balance, __ATOMIC_RELAXED ) ) {
+        struct t_iq_balance *iq = &my_device->hot->iq ;
+        uint32_t seq = __atomic_load_n( &my_device->iq_balance_seq, __ATOMIC_RELAXED );
+        if( iq->seq != seq ) {
+            // first use or switched off and on : coefficients and sums may be stale
+            iq_balance_reset( iq );
+            iq->seq = seq ;
+        }
+        if( dc_block ) {
+            dsp_convert_dc_iq( buf, out, sample_count, xn_1, yn_1, iq );
+        } else {
+            dsp_convert_iq( buf, out, sample_count, iq );
+        }
+        iq_balance_update( iq );
+    } else if( dc_block ) {
+        dsp_convert_dc( buf, out, sample_count, xn_1, yn_1 );
+    } else {
+        dsp_u8_to_cf32( buf, out, sample_count );
+    }
+    if( __atomic_load_n( &my_device->nco_ppb, __ATOMIC_RELAXED ) != 0 ) {
+        ppm_nco( my_device, out, sample_count );
+    }
+}
 
+// conversion and publication of one transfer, false if the stream is gated
+static bool process_transfer( struct t_rx_device* my_device, unsigned char *buf, uint32_t len ) {
+    TYPECPX *samples ;
 
-    struct t_rx_device* my_device = (struct t_rx_device*)ctx ;
-    if( my_device->acq_stop == true ) {
-        if( DEBUG_DRIVER ) fprintf(stderr,"%s(len=%d) my_device->acq_stop == true\n", __func__, len );
-        fflush(stderr);
-        return ;
+    struct t_rx_hot* hot = my_device->hot ;
+    if( rx_stream_gated( my_device ) ) {
+        return(false);
     }
 
     int sample_count = len/2 ;
-    samples = (TYPECPX *)malloc( sample_count * sizeof( TYPECPX ));
-    if( samples == NULL ) {
-        if( DEBUG_DRIVER ) fprintf(stderr,"%s(len=%d) samples == NULL\n", __func__, len );
-        fflush(stderr);
-        return ;
+    __atomic_store_n( &hot->received, hot->received + sample_count, __ATOMIC_RELAXED );
+    if( metrics_enabled ) {
+        __atomic_store_n( &hot->clipped, hot->clipped + dsp_count_clipped( buf, sample_count ), __ATOMIC_RELAXED );
+    }
+    if( my_device->hop != NULL ) {
+        // frequency hopping : samples received while retuning and settling are dropped
+        int skip = hop_schedule_step( my_device, sample_count );
+        if( skip >= sample_count ) {
+            return(true);
+        }
+        buf += 2*skip ;
+        len -= 2*skip ;
+        sample_count -= skip ;
+    }
+    ppm_estimator_feed( my_device, buf, sample_count );
+
+    // raw stream to the rtl_tcp clients, if any
+    uint64_t span = trace_begin();
+    rtltcp_server_publish( my_device->tcp_server, buf, len );
+    shm_ring_publish( my_device->shm, SHM_FORMAT_U8, buf, len, len/2, &my_device->context );
+    udp_stream_publish( my_device->multicast, buf, len, &my_device->context );
+    trace_end( "publish_raw", (int)(my_device - rx), span );
+    bool admitted = backpressure_admit( my_device->backpressure );
+    if( !admitted && (shm_ring_format( my_device->shm ) != SHM_FORMAT_CF32) ) {
+        return(true); // SDRNode is late and nobody else wants the float samples
     }
 
-    // convert samples from 8bits to float and remove DC component
-
-    for( int i=0 ; i < sample_count ; i++ ) {
-        int j = 2*i ;
-        I =  ((int)buf[j  ] - 127)/ 127.0f   ;
-        Q =  ((int)buf[j+1] - 127)/ 127.0f   ;
-        // DC
-        // y[n] = x[n] - x[n-1] + alpha * y[n-1]
-        // see http://peabody.sapp.org/class/dmp2/lab/dcblock/
-        tmp.re = I - my_device->xn_1.re + ALPHA_DC * my_device->yn_1.re ;
-        tmp.im = Q - my_device->xn_1.im + ALPHA_DC * my_device->yn_1.im ;
-
-        my_device->xn_1.re = I ;
-        my_device->xn_1.im = Q ;
-
-        my_device->yn_1.re = tmp.re ;
-        my_device->yn_1.im = tmp.im ;
+    TYPECPX xn_1 = hot->xn_1 ;
+    TYPECPX yn_1 = hot->yn_1 ;
+    if( admitted && (my_device->reblock != NULL) ) {
+        // converted straight into push sized blocks, each one leaves as soon as it is full
+        int pos = 0 ;
+        while( pos < sample_count ) {
+            int room = reblock_room( my_device, &samples );
+            if( room == 0 ) {
+                log_class( (int)(my_device - rx), 0, LOG_STREAM, (char *)"out of memory, samples dropped" );
+                break ;
+            }
+            int n = (sample_count - pos < room) ? sample_count - pos : room ;
+            span = trace_begin();
+            convert( my_device, buf + 2*pos, samples, n, &xn_1, &yn_1 );
+            trace_end( "convert", (int)(my_device - rx), span );
+            shm_ring_publish( my_device->shm, SHM_FORMAT_CF32, samples, n * sizeof(TYPECPX),
+                              n, &my_device->context );
+            reblock_commit( my_device, n );
+            pos += n ;
+        }
+        hot->xn_1 = xn_1 ;
+        hot->yn_1 = yn_1 ;
+        return(true);
+    }
 
-        samples[i] = tmp ;
+    samples = (TYPECPX *)malloc( sample_count * sizeof( TYPECPX ));
+    if( samples == NULL ) {
+        log_class( (int)(my_device - rx), 0, LOG_STREAM, (char *)"out of memory, samples dropped" );
+        return(true);
     }
-    // push samples to SDRNode callback function
-    // we only manage one channel per device
-    if( (*acqCbFunction)( my_device->uuid,
-                          (float *)samples, sample_count, 1,
-                          &my_device->context) <= 0 ) {
+    span = trace_begin();
+    convert( my_device, buf, samples, sample_count, &xn_1, &yn_1 );
+    trace_end( "convert", (int)(my_device - rx), span );
+    hot->xn_1 = xn_1 ;
+    hot->yn_1 = yn_1 ;
+    shm_ring_publish( my_device->shm, SHM_FORMAT_CF32, samples, sample_count * sizeof(TYPECPX),
+                      sample_count, &my_device->context );
+    if( !admitted ) {
         free(samples);
+        return(true);
+    }
+    // push samples to SDRNode callback function, according to the backpressure policy
+    backpressure_push( my_device, samples, sample_count, &my_device->context );
+    return(true);
+}
+
+void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx) {
+    struct t_rx_device* my_device = (struct t_rx_device*)ctx ;
+    if( (my_device->latency == NULL) && !metrics_enabled && !trace_enabled ) {
+        process_transfer( my_device, buf, len );
+        return ;
+    }
+    struct t_rx_hot* hot = my_device->hot ;
+    uint64_t start = latency_now();
+    if( (my_device->queue == NULL) && (my_device->latency != NULL) ) {
+        // called by the USB thread, the transfer just completed
+        latency_transfer( my_device->latency, __atomic_load_n( &hot->starts, __ATOMIC_RELAXED ), start );
+    }
+    if( process_transfer( my_device, buf, len )) {
+        uint64_t ticks = latency_now() - start ;
+        __atomic_store_n( &hot->callback_ticks, hot->callback_ticks + ticks, __ATOMIC_RELAXED );
+        if( my_device->latency != NULL ) {
+            latency_record( my_device->latency, LAT_CALLBACK, ticks );
+        }
+        trace_end( "callback", (int)(my_device - rx), start );
     }
 }
 
@@ -720,16 +1404,33 @@ void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx) {
  */
 void* acquisition_thread( void *params ) {
     struct t_rx_device* my_device = (struct t_rx_device*)params ;
-    rtlsdr_dev_t *rtlsdr_device = my_device->rtlsdr_device ;
+    char name[64] ;
     if( DEBUG_DRIVER ) fprintf(stderr,"%s() start thread\n", __func__ );
+    snprintf( name, sizeof(name), "acquisition %s", my_device->device_serial_number );
+    trace_thread_name( name );
     for( ; ; ) {
-        my_device->running = false ;
         if( DEBUG_DRIVER ) fprintf(stderr,"%s() thread waiting\n", __func__ );
-        fflush(stderr);
-        sem_wait( &my_device->mutex );
+        sem_wait( &my_device->hot->mutex );
         if( DEBUG_DRIVER ) fprintf(stderr,"%s() rtlsdr_read_async\n", __func__ );
-        rtlsdr_read_async(rtlsdr_device, rtlsdr_callback, (void *)my_device, 0, 65536);
-        my_device->running = true ;
+        int rc ;
+        uint64_t span = trace_begin();
+        do {
+            __atomic_store_n( &my_device->hot->running, 1, __ATOMIC_RELEASE );
+            rc = my_device->backend->read_async(my_device, stream_engine_callback( my_device ), (void *)my_device,
+                                                stream_engine.buf_num, stream_engine.buf_len) ;
+            __atomic_store_n( &my_device->hot->running, 0, __ATOMIC_RELEASE );
+        } while( watchdog_should_restart( my_device, rc ) );
+        trace_end( "read_async", (int)(my_device - rx), span );
+        if( (rc < 0) && (my_device->watchdog == NULL) ) {
+            log_class( (int)(my_device - rx), 0, LOG_STREAM, "stream lost, waiting for next start" );
+        }
+        // a stream restarted by prepareRXEngine() meanwhile stays RX_STREAMING, its post is pending
+        int expected = RX_STOPPING ;
+        __atomic_compare_exchange_n( &my_device->hot->state, &expected, RX_STOPPED, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+        expected = RX_IDLE ;
+        __atomic_compare_exchange_n( &my_device->hot->state, &expected, RX_STOPPED, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
 
     }
     return(NULL);
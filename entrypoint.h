@@ -41,6 +41,11 @@ struct ext_Context {
     long ctx_version ;
     int64_t center_freq;
     unsigned int sample_rate;
+    // driver extension, after the fields SDRNode knows : incremented each time samples were lost
+    // (stream restarted, blocks dropped under backpressure)
+    unsigned int discontinuity;
+    // entry of the hop schedule the samples were received on, -1 when not hopping
+    int hop_index;
 };
 
 // call this function to log something into the SDRNode central log file
@@ -64,6 +69,25 @@ extern "C" {
     LIBRARY_API int initLibrary(char *json_init_params, _tlogFun* ptr, _pushSamplesFun *acqCb );
     LIBRARY_API int getBoardCount();
 
+    // hot-plug : ids are stable, getBoardCount() only grows
+    LIBRARY_API int getBoardGeneration();
+    LIBRARY_API int isBoardPresent( int device_id );
+    LIBRARY_API int getBoardIdBySerial( char *serial );
+
+    // sample path latency histograms of a device, as a JSON object
+    LIBRARY_API int getLatencyHistograms( int device_id, char *json, int json_len );
+
+    // estimated IQ gain and phase imbalance of a device, as a JSON object
+    LIBRARY_API int getIQBalanceStats( int device_id, char *json, int json_len );
+
+    // writes the recorded events as Chrome trace JSON
+    LIBRARY_API int dumpTrace( char *filename );
+
+    // frequency hopping driven by the acquisition, see hop_schedule.h for the JSON
+    LIBRARY_API int setHopSchedule( int device_id, char *json );
+    LIBRARY_API int startHopSchedule( int device_id );
+    LIBRARY_API int stopHopSchedule( int device_id );
+
 
     LIBRARY_API int setBoardUUID( int device_id, char *uuid );
 
@@ -105,6 +129,9 @@ extern "C" {
     LIBRARY_API int setRxGain( int device_id, int stage_id, float gain_value );
     LIBRARY_API float getRxGainValue( int device_id , int stage_id );
     LIBRARY_API bool setAutoGainMode( int device_id );
+
+    // rate, frequency, gain, ppm and DSP settings in one step, one context change
+    LIBRARY_API int setRxConfig( int device_id, char *json );
 }
 
 #endif // ENTRYPOINT_H
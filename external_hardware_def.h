@@ -42,6 +42,21 @@ typedef int   (CALLPREFIX _setBoardUUID)(int, char *); // device, uuid
 typedef int   (CALLPREFIX _getBoardCount)();
 typedef char* (CALLPREFIX _getHardwareName)(int); // device
 
+// hot-plug
+typedef int   (CALLPREFIX _getBoardGeneration)(); // changes when a board appears or disappears
+typedef int   (CALLPREFIX _isBoardPresent)(int); // device
+typedef int   (CALLPREFIX _getBoardIdBySerial)(char *); // serial, -1 if unknown
+
+// diagnostics
+typedef int   (CALLPREFIX _getLatencyHistograms)(int, char *, int); // device, json buffer, buffer size
+typedef int   (CALLPREFIX _getIQBalanceStats)(int, char *, int); // device, json buffer, buffer size
+typedef int   (CALLPREFIX _dumpTrace)(char *); // file name
+
+// frequency hopping
+typedef int   (CALLPREFIX _setHopSchedule)(int, char *); // device, JSON schedule
+typedef int   (CALLPREFIX _startHopSchedule)(int); // device
+typedef int   (CALLPREFIX _stopHopSchedule)(int); // device
+
 typedef int   (CALLPREFIX _getPossibleSampleRateCount)(int); // device
 typedef unsigned int   (CALLPREFIX _getPossibleSampleRateValue)(int,int); // device, rank
 typedef unsigned int   (CALLPREFIX _getPrefferedSampleRateValue)(int); // device
@@ -73,6 +88,7 @@ typedef uint64_t (CALLPREFIX _getRxCenterFreq)(int); // device
 typedef int    (CALLPREFIX _setRxGain)(int,int,float); // device, stage, value
 typedef float  (CALLPREFIX _getRxGainValue)(int,int); // device, stage
 typedef bool   (CALLPREFIX _setAutoGainMode)(int); // device
+typedef int    (CALLPREFIX _setRxConfig)(int, char *); // device, JSON settings
 
 
 #endif // EXTERNAL_HARDWARE_DEF_H
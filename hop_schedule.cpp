@@ -0,0 +1,325 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "hop_schedule.h"
+#include "reblock.h"
+#include "trace.h"
+
+#define DEFAULT_DWELL_MS  (100)
+#define DEFAULT_SETTLE_US (2000)
+#define MAX_HOPS          (4096)
+
+struct t_hop_entry {
+    int64_t freq ;
+    int dwell_us ;
+    int64_t dwell_samples ; // at plan rate
+};
+
+// immutable once handed to the sample path, except the sample counts it recomputes
+struct t_hop_plan {
+    int count ;
+    int loop ;
+    int settle_us ;
+    unsigned int rate ;       // sample rate the sample counts were computed for
+    int64_t settle_samples ;
+    struct t_hop_entry entries[] ;
+};
+
+#define HOP_IDLE     (0)
+#define HOP_DWELL    (1) // samples are kept
+#define HOP_RETUNING (2) // waiting for the retune thread, samples dropped
+#define HOP_SETTLING (3) // samples dropped
+#define HOP_RETAG    (4) // next entry on the same frequency, new context from the next transfer
+
+struct t_hop_schedule {
+    struct t_rx_device *dev ;
+    int device_id ;
+    // control side
+    struct t_hop_plan *pending ; // taken by the sample path
+    int active ;
+    uint32_t start_seq ;         // incremented by each start
+    // retune thread
+    sem_t wake ;
+    pthread_t thread ;
+    int64_t target_freq ;
+    uint32_t request_seq ;
+    uint32_t done_seq ;
+    int64_t done_freq ;          // where the device is after the retune
+    // sample path only
+    struct t_hop_plan *plan ;
+    uint32_t start_seen ;
+    int phase ;
+    int index ;
+    int64_t left ;               // samples left to dwell or to settle
+};
+
+static void* retune_thread( void *params ) {
+    struct t_hop_schedule *hs = (struct t_hop_schedule *)params ;
+    struct t_rx_device *dev = hs->dev ;
+    char msg[256] ;
+
+    snprintf( msg, sizeof(msg), "hop %s", dev->device_serial_number );
+    trace_thread_name( msg );
+    for( ; ; ) {
+        sem_wait( &hs->wake );
+        uint32_t seq = __atomic_load_n( &hs->request_seq, __ATOMIC_ACQUIRE );
+        int64_t freq = __atomic_load_n( &hs->target_freq, __ATOMIC_RELAXED );
+        if( seq == __atomic_load_n( &hs->done_seq, __ATOMIC_RELAXED ) ) {
+            continue ; // handled with a previous wake up
+        }
+        uint64_t span = trace_begin();
+        int rc = 0 ;
+        pthread_mutex_lock( &dev->ctl_lock );
+        // stopped meanwhile : setRxCenterFreq() may have tuned elsewhere
+        if( __atomic_load_n( &hs->active, __ATOMIC_ACQUIRE ) ) {
+            rc = ctl_set_center_freq( dev, freq );
+            if( rc == 0 ) {
+                dev->center_frq_hz = freq ;
+            }
+        }
+        int64_t now = dev->center_frq_hz ;
+        pthread_mutex_unlock( &dev->ctl_lock );
+        trace_end( "retune", hs->device_id, span );
+        if( rc != 0 ) {
+            snprintf( msg, sizeof(msg), "hop: cannot tune to %lld Hz", (long long)freq );
+            log_class( hs->device_id, 0, LOG_STREAM, msg );
+        }
+        __atomic_store_n( &hs->done_freq, now, __ATOMIC_RELAXED );
+        __atomic_store_n( &hs->done_seq, seq, __ATOMIC_RELEASE );
+    }
+    return(NULL);
+}
+
+static void plan_rate( struct t_hop_plan *p, unsigned int rate ) {
+    p->rate = rate ;
+    for( int k=0 ; k < p->count ; k++ ) {
+        int64_t n = (int64_t)rate * p->entries[k].dwell_us / 1000000 ;
+        p->entries[k].dwell_samples = n > 0 ? n : 1 ;
+    }
+    p->settle_samples = (int64_t)rate * p->settle_us / 1000000 ;
+}
+
+static struct t_hop_plan* parse( struct t_rx_device *dev, int device_id, json_t *conf ) {
+    json_t *hops = json_object_get( conf, "hops" );
+    char msg[256] ;
+    if( !json_is_array(hops) || (json_array_size(hops) == 0) || (json_array_size(hops) > MAX_HOPS) ) {
+        log( device_id, 0, (char *)"hop: \"hops\" shall be a non empty array" );
+        return(NULL);
+    }
+    int count = (int)json_array_size(hops);
+    struct t_hop_plan *p = (struct t_hop_plan *)calloc( 1, sizeof(struct t_hop_plan) + count * sizeof(struct t_hop_entry));
+    if( p == NULL ) {
+        return(NULL);
+    }
+    int dwell_ms = DEFAULT_DWELL_MS ;
+    json_t *v = json_object_get( conf, "dwell_ms" );
+    if( json_is_integer(v) && (json_integer_value(v) > 0) ) {
+        dwell_ms = (int)json_integer_value(v);
+    }
+    p->settle_us = DEFAULT_SETTLE_US ;
+    v = json_object_get( conf, "settle_us" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 0) ) {
+        p->settle_us = (int)json_integer_value(v);
+    }
+    v = json_object_get( conf, "loop" );
+    p->loop = json_is_false(v) ? 0 : 1 ;
+
+    p->count = count ;
+    for( int k=0 ; k < count ; k++ ) {
+        json_t *h = json_array_get( hops, k );
+        json_t *f = json_is_object(h) ? json_object_get( h, "freq" ) : h ;
+        json_t *d = json_is_object(h) ? json_object_get( h, "dwell_ms" ) : NULL ;
+        int64_t freq = json_is_number(f) ? (int64_t)json_number_value(f) : 0 ;
+        if( (freq < dev->min_frq_hz) || (freq > dev->max_frq_hz) ) {
+            snprintf( msg, sizeof(msg), "hop: entry %d, frequency out of the device range", k );
+            log( device_id, 0, msg );
+            free(p);
+            return(NULL);
+        }
+        p->entries[k].freq = freq ;
+        p->entries[k].dwell_us = 1000 * (json_is_integer(d) && (json_integer_value(d) > 0) ? (int)json_integer_value(d) : dwell_ms) ;
+    }
+    return(p);
+}
+
+int hop_schedule_load( struct t_rx_device *dev, int device_id, json_t *conf ) {
+    struct t_hop_plan *p = parse( dev, device_id, conf );
+    if( p == NULL ) {
+        return(-1);
+    }
+    struct t_hop_schedule *hs = dev->hop ;
+    if( hs == NULL ) {
+        hs = (struct t_hop_schedule *)calloc( 1, sizeof(struct t_hop_schedule));
+        if( hs == NULL ) {
+            free(p);
+            return(-1);
+        }
+        hs->dev = dev ;
+        hs->device_id = device_id ;
+        hs->index = -1 ;
+        sem_init( &hs->wake, 0, 0 );
+        if( pthread_create( &hs->thread, NULL, retune_thread, hs ) != 0 ) {
+            free(hs);
+            free(p);
+            return(-1);
+        }
+        pthread_detach( hs->thread );
+        __atomic_store_n( &dev->hop, hs, __ATOMIC_RELEASE );
+    }
+    // a running schedule restarts with the new plan when the sample path takes it
+    free( __atomic_exchange_n( &hs->pending, p, __ATOMIC_ACQ_REL ));
+    return(0);
+}
+
+int hop_schedule_start( struct t_rx_device *dev ) {
+    struct t_hop_schedule *hs = dev->hop ;
+    if( hs == NULL ) {
+        return(-1);
+    }
+    __atomic_add_fetch( &hs->start_seq, 1, __ATOMIC_RELEASE );
+    __atomic_store_n( &hs->active, 1, __ATOMIC_RELEASE );
+    return(0);
+}
+
+void hop_schedule_stop( struct t_rx_device *dev ) {
+    struct t_hop_schedule *hs = dev->hop ;
+    if( hs != NULL ) {
+        __atomic_store_n( &hs->active, 0, __ATOMIC_RELEASE );
+    }
+}
+
+static void request( struct t_hop_schedule *hs, int index ) {
+    struct t_hop_entry *e = &hs->plan->entries[index] ;
+    bool same = (hs->phase == HOP_DWELL) && (e->freq == hs->plan->entries[hs->index].freq) ;
+    hs->index = index ;
+    if( same ) {
+        hs->phase = HOP_RETAG ;
+        return ;
+    }
+    trace_instant( "hop", hs->device_id );
+    hs->phase = HOP_RETUNING ;
+    __atomic_store_n( &hs->target_freq, e->freq, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &hs->request_seq, 1, __ATOMIC_RELEASE );
+    sem_post( &hs->wake );
+}
+
+// samples from now on belong to the current entry, -1 when not hopping. The context is written by
+// the setters too : under ctl_lock, held only by control requests, never while pushing
+static void retag( struct t_hop_schedule *hs, int64_t freq, int hop_index ) {
+    struct t_rx_device *dev = hs->dev ;
+    reblock_flush( dev ); // what is pending goes with the previous context
+    pthread_mutex_lock( &dev->ctl_lock );
+    dev->context.center_freq = freq ;
+    dev->context.hop_index = hop_index ;
+    dev->context.ctx_version++ ;
+    pthread_mutex_unlock( &dev->ctl_lock );
+}
+
+int hop_schedule_step( struct t_rx_device *dev, int sample_count ) {
+    struct t_hop_schedule *hs = __atomic_load_n( &dev->hop, __ATOMIC_ACQUIRE );
+    if( hs == NULL ) {
+        return(0);
+    }
+    bool retuned = (hs->phase == HOP_RETUNING) &&
+                   (__atomic_load_n( &hs->done_seq, __ATOMIC_ACQUIRE ) == hs->request_seq) ;
+    if( (hs->phase == HOP_RETUNING) && !retuned ) {
+        return(sample_count); // whatever happens next, the retune goes on
+    }
+
+    // a new plan is a restart : hs->index belongs to the old one
+    struct t_hop_plan *p = __atomic_exchange_n( &hs->pending, NULL, __ATOMIC_ACQ_REL );
+    bool restart = (p != NULL) ;
+    if( restart ) {
+        if( hs->phase != HOP_IDLE ) {
+            hs->phase = HOP_IDLE ;
+            retag( hs, retuned ? __atomic_load_n( &hs->done_freq, __ATOMIC_RELAXED ) : dev->context.center_freq, -1 );
+        }
+        hs->index = -1 ;
+        free( hs->plan );
+        hs->plan = p ;
+        hs->plan->rate = 0 ;
+    }
+    if( !__atomic_load_n( &hs->active, __ATOMIC_ACQUIRE ) || (hs->plan == NULL) ) {
+        if( hs->phase != HOP_IDLE ) {
+            hs->phase = HOP_IDLE ;
+            retag( hs, retuned ? __atomic_load_n( &hs->done_freq, __ATOMIC_RELAXED ) : dev->context.center_freq, -1 );
+        }
+        return(0);
+    }
+    if( hs->plan->rate != dev->context.sample_rate ) {
+        plan_rate( hs->plan, dev->context.sample_rate );
+    }
+    uint32_t seq = __atomic_load_n( &hs->start_seq, __ATOMIC_ACQUIRE );
+    if( restart || (seq != hs->start_seen) ) {
+        // started or new plan : first entry
+        hs->start_seen = seq ;
+        if( hs->phase != HOP_IDLE ) {
+            hs->phase = HOP_IDLE ;
+            retag( hs, retuned ? __atomic_load_n( &hs->done_freq, __ATOMIC_RELAXED ) : dev->context.center_freq, -1 );
+        }
+        request( hs, 0 );
+        return(sample_count);
+    }
+
+    int skip = 0 ;
+    switch( hs->phase ) {
+    case HOP_RETUNING:
+        // this transfer may hold samples of both frequencies
+        retag( hs, __atomic_load_n( &hs->done_freq, __ATOMIC_RELAXED ), hs->index );
+        hs->phase = HOP_SETTLING ;
+        hs->left = hs->plan->settle_samples ;
+        return(sample_count);
+
+    case HOP_RETAG:
+        retag( hs, dev->context.center_freq, hs->index );
+        hs->phase = HOP_DWELL ;
+        hs->left = hs->plan->entries[hs->index].dwell_samples ;
+        break ;
+
+    case HOP_SETTLING:
+        if( hs->left >= sample_count ) {
+            hs->left -= sample_count ;
+            return(sample_count);
+        }
+        skip = (int)hs->left ;
+        hs->phase = HOP_DWELL ;
+        hs->left = hs->plan->entries[hs->index].dwell_samples ;
+        break ;
+
+    default:
+        break ;
+    }
+
+    // dwell : the hop happens at the end of the transfer that completes it
+    hs->left -= sample_count - skip ;
+    if( hs->left <= 0 ) {
+        int next = hs->index + 1 ;
+        if( next < hs->plan->count ) {
+            request( hs, next );
+        } else if( hs->plan->loop ) {
+            request( hs, 0 );
+        } else {
+            // one pass done, stays on the last frequency
+            __atomic_store_n( &hs->active, 0, __ATOMIC_RELEASE );
+        }
+    }
+    return(skip);
+}
@@ -0,0 +1,54 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOP_SCHEDULE_H
+#define HOP_SCHEDULE_H
+
+#include "rx_device.h"
+
+/*
+ * Frequency hopping driven by the sample path : the dongle cycles through a list of frequencies,
+ * each one kept for its dwell time, counted in samples so hops fall on transfer boundaries.
+ *
+ *   { "hops" : [ 162400000,                                  // dwell_ms below
+ *                { "freq" : 162550000, "dwell_ms" : 200 } ],
+ *     "dwell_ms" : 100,   // default dwell
+ *     "settle_us" : 2000, // samples discarded after each retune while the PLL settles
+ *     "loop" : true }     // false : stops on the last entry
+ *
+ * The retune runs in a thread of the device (control transfers cannot be sent from the USB
+ * callback), samples received meanwhile and during the settle time are dropped. Each hop bumps
+ * ctx_version, and ext_Context.hop_index tells which entry the samples belong to.
+ * Dwell and settle times are converted to samples when the schedule is loaded and again when
+ * the sample rate changes.
+ */
+
+struct t_hop_schedule ;
+
+// replaces the schedule of the device, a running schedule restarts with the new one. 0 on success
+int hop_schedule_load( struct t_rx_device *dev, int device_id, json_t *conf );
+
+// starts from the first entry, 0 on success (a schedule is loaded)
+int hop_schedule_start( struct t_rx_device *dev );
+
+// the device stays on the current frequency
+void hop_schedule_stop( struct t_rx_device *dev );
+
+// called by the sample path for each transfer : samples to drop at the start of it
+int hop_schedule_step( struct t_rx_device *dev, int sample_count );
+
+#endif // HOP_SCHEDULE_H
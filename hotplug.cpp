@@ -0,0 +1,218 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hotplug.h"
+#include "trace.h"
+
+#define DEFAULT_PERIOD_MS   (1000)
+#define CLOSE_WAIT_MS       (2000) // max wait for the acquisition thread to leave read_async
+#define MAX_SCAN            (64)
+
+struct t_usb_entry {
+    char serial[256] ;
+    bool claimed ;
+};
+
+int hotplug_generation ;
+
+static bool enabled = false ;
+static int period_ms = DEFAULT_PERIOD_MS ;
+static pthread_t monitor_thread ;
+
+int hotplug_capacity( json_t *root, int count ) {
+    json_t *conf = json_object_get( root, "hotplug" );
+    if( !json_is_object(conf) ) {
+        return(count);
+    }
+    enabled = true ;
+    int max_devices = 16 ;
+    json_t *v = json_object_get( conf, "max_devices" );
+    if( json_is_integer(v) && (json_integer_value(v) > 0) ) max_devices = (int)json_integer_value(v);
+    v = json_object_get( conf, "period_ms" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 100) ) period_ms = (int)json_integer_value(v);
+    return( count > max_devices ? count : max_devices );
+}
+
+/**
+ * @brief unplugged the dongle is gone : stop its stream and close it. The slot and the settings stay
+ */
+static void unplugged( int d ) {
+    struct t_rx_device *dev = &rx[d] ;
+    char msg[256] ;
+
+    __atomic_store_n( &dev->present, 0, __ATOMIC_RELEASE );
+    int state = __atomic_exchange_n( &dev->hot->state, RX_STOPPING, __ATOMIC_ACQ_REL );
+    dev->resume = (state == RX_STREAMING) ;
+    pthread_mutex_lock( &dev->ctl_lock );
+    dev->backend->cancel_async( dev );
+    pthread_mutex_unlock( &dev->ctl_lock );
+
+    for( int k=0 ; (k < CLOSE_WAIT_MS/10) && __atomic_load_n( &dev->hot->running, __ATOMIC_ACQUIRE ) ; k++ ) {
+        usleep( 10000 );
+    }
+    pthread_mutex_lock( &dev->ctl_lock );
+    if( __atomic_load_n( &dev->hot->running, __ATOMIC_ACQUIRE ) ) {
+        snprintf( msg, sizeof(msg), "hotplug: %.64s unplugged, stream did not stop, device left open", dev->device_serial_number );
+    } else {
+        if( dev->rtlsdr_device != NULL ) {
+            rtlsdr_close( dev->rtlsdr_device );
+            dev->rtlsdr_device = NULL ;
+        }
+        snprintf( msg, sizeof(msg), "hotplug: %.64s unplugged", dev->device_serial_number );
+    }
+    pthread_mutex_unlock( &dev->ctl_lock );
+    __atomic_add_fetch( &hotplug_generation, 1, __ATOMIC_RELEASE );
+    log_class( d, 0, LOG_HOTPLUG, msg );
+}
+
+/**
+ * @brief replugged a known dongle is back at usb_index : open it in its slot and restore its settings
+ */
+static void replugged( int d, int usb_index ) {
+    struct t_rx_device *dev = &rx[d] ;
+    char msg[256] ;
+
+    pthread_mutex_lock( &dev->ctl_lock );
+    dev->usb_index = usb_index ;
+    int rc = rtlsdr_open( &dev->rtlsdr_device, usb_index );
+    if( rc < 0 ) {
+        dev->rtlsdr_device = NULL ;
+    } else {
+        rx_device_restore( dev );
+    }
+    pthread_mutex_unlock( &dev->ctl_lock );
+    if( rc < 0 ) {
+        snprintf( msg, sizeof(msg), "hotplug: %.64s plugged but cannot be opened (%d)", dev->device_serial_number, rc );
+        log_class( d, 0, LOG_HOTPLUG, msg );
+        return ;
+    }
+
+    __atomic_store_n( &dev->present, 1, __ATOMIC_RELEASE );
+    __atomic_store_n( &dev->hot->state, RX_STOPPED, __ATOMIC_RELEASE );
+    __atomic_add_fetch( &hotplug_generation, 1, __ATOMIC_RELEASE );
+    snprintf( msg, sizeof(msg), "hotplug: %.64s plugged again as device %d%s", dev->device_serial_number, d,
+              dev->resume ? ", streaming" : "" );
+    log_class( d, 0, LOG_HOTPLUG, msg );
+    if( dev->resume ) {
+        dev->resume = 0 ;
+        prepareRXEngine( d );
+    }
+}
+
+// new dongle : next free slot
+static void added( int usb_index, const char *serial ) {
+    char msg[256] ;
+    int d = device_count ;
+    if( d >= rx_capacity ) {
+        snprintf( msg, sizeof(msg), "hotplug: %.64s plugged, no free slot (max_devices=%d)", serial, rx_capacity );
+        log_class( 0, 0, LOG_HOTPLUG, msg );
+        return ;
+    }
+    if( rx_device_setup( d, usb_index, -1 ) != 0 ) {
+        snprintf( msg, sizeof(msg), "hotplug: %.64s plugged but cannot be opened", serial );
+        log_class( 0, 0, LOG_HOTPLUG, msg );
+        return ;
+    }
+    __atomic_store_n( &device_count, d + 1, __ATOMIC_RELEASE );
+    __atomic_add_fetch( &hotplug_generation, 1, __ATOMIC_RELEASE );
+    snprintf( msg, sizeof(msg), "hotplug: %.64s plugged, new device %d", serial, d );
+    log_class( d, 0, LOG_HOTPLUG, msg );
+}
+
+/**
+ * @brief scan matches the enumerated dongles with the slots. Present slots claim their serial first,
+ *        so running devices are never moved, then unplugged slots, then new slots
+ */
+static void scan( int usb_count ) {
+    static struct t_usb_entry found[MAX_SCAN] ;
+    char manufact[256], product[256] ;
+
+    if( usb_count > MAX_SCAN ) {
+        usb_count = MAX_SCAN ;
+    }
+    for( int i=0 ; i < usb_count ; i++ ) {
+        found[i].serial[0] = 0 ;
+        found[i].claimed = false ;
+        rtlsdr_get_device_usb_strings( i, manufact, product, found[i].serial );
+    }
+
+    int count = device_count ;
+    for( int d=0 ; d < count ; d++ ) {
+        struct t_rx_device *dev = &rx[d] ;
+        if( (dev->backend != &usb_backend) || !dev->present ) {
+            continue ;
+        }
+        int i ;
+        for( i=0 ; i < usb_count ; i++ ) {
+            if( !found[i].claimed && (strcmp( found[i].serial, dev->device_serial_number ) == 0) ) {
+                found[i].claimed = true ;
+                dev->usb_index = i ;
+                break ;
+            }
+        }
+        if( i == usb_count ) {
+            unplugged( d );
+        }
+    }
+    for( int i=0 ; i < usb_count ; i++ ) {
+        if( found[i].claimed ) {
+            continue ;
+        }
+        found[i].claimed = true ;
+        int d ;
+        for( d=0 ; d < count ; d++ ) {
+            if( (rx[d].backend == &usb_backend) && !rx[d].present &&
+                (strcmp( found[i].serial, rx[d].device_serial_number ) == 0) ) {
+                break ;
+            }
+        }
+        if( d < count ) {
+            replugged( d, i );
+        } else {
+            added( i, found[i].serial );
+        }
+    }
+}
+
+static void* monitor( void *params ) {
+    (void)params ;
+    int last = (int)rtlsdr_get_device_count();
+    trace_thread_name( "hotplug" );
+    for( ; ; ) {
+        usleep( period_ms * 1000 );
+        int usb_count = (int)rtlsdr_get_device_count();
+        if( usb_count != last ) {
+            uint64_t span = trace_begin();
+            scan( usb_count );
+            trace_end( "hotplug_scan", -1, span );
+            last = usb_count ;
+        }
+    }
+    return(NULL);
+}
+
+void hotplug_start( void ) {
+    if( !enabled ) {
+        return ;
+    }
+    pthread_create( &monitor_thread, NULL, monitor, NULL );
+}
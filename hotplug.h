@@ -0,0 +1,47 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOTPLUG_H
+#define HOTPLUG_H
+
+#include "rx_device.h"
+
+/*
+ * Hot-plug of local dongles while the driver runs.
+ *
+ *   { "hotplug" : { "max_devices" : 16,   // slots allocated in rx[]
+ *                   "period_ms" : 1000 } } // enumeration polling period
+ *
+ * Device ids are slots in rx[], a dongle keeps its id for the lifetime of the driver :
+ * - unplugged, its stream is stopped, the device closed and isBoardPresent() returns 0 ;
+ * - plugged again (same serial), it gets its slot back with its settings, and streams again if it was ;
+ * - a new serial takes the next free slot, getBoardCount() grows.
+ * Other devices are not touched. getBoardGeneration() changes at each event, so SDRNode can poll it.
+ * Dongles sharing the same serial (factory default) are matched in enumeration order : set unique
+ * serials (rtl_eeprom -s) for stable ids.
+ * Enumeration goes through librtlsdr, the USB bus is only scanned when the dongle count changes.
+ */
+
+extern int hotplug_generation ;
+
+// rx[] capacity for the devices found at startup : count, or max_devices if hot-plug is enabled
+int hotplug_capacity( json_t *root, int count );
+
+// starts the monitor thread if enabled, once the devices found at startup are set up
+void hotplug_start( void );
+
+#endif // HOTPLUG_H
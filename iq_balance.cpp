@@ -0,0 +1,91 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "iq_balance.h"
+
+#define IQ_BLOCK     (65536) // samples per estimate
+#define IQ_SMOOTHING (0.25)  // weight of a new estimate
+#define IQ_MIN_POWER (1e-6)  // below, no signal to estimate from
+#define IQ_MAX_SKEW  (0.5)   // sine of the largest phase error corrected, 30 degrees
+
+bool iq_balance_configured( struct t_rx_device *dev, int device_id, json_t *root ) {
+    json_t *conf = json_object_get( root, "iq_balance" );
+    char index[16] ;
+    if( json_is_object(conf) ) {
+        snprintf( index, sizeof(index), "%d", device_id );
+        json_t *v = json_object_get( conf, dev->device_serial_number );
+        conf = (v != NULL) ? v : json_object_get( conf, index );
+    }
+    return( json_is_true(conf) );
+}
+
+void iq_balance_reset( struct t_iq_balance *iq ) {
+    memset( iq, 0, sizeof(struct t_iq_balance));
+    iq->cq = 1 ;
+}
+
+void iq_balance_update( struct t_iq_balance *iq ) {
+    if( iq->count < IQ_BLOCK ) {
+        return ;
+    }
+    double n = iq->count ;
+    double mi = iq->si / n ;
+    double mq = iq->sq / n ;
+    double ii = iq->sii / n - mi * mi ;
+    double qq = iq->sqq / n - mq * mq ;
+    double cross = iq->siq / n - mi * mq ;
+    iq->si = iq->sq = iq->sii = iq->sqq = iq->siq = 0 ;
+    iq->count = 0 ;
+    if( (ii < IQ_MIN_POWER) || (qq < IQ_MIN_POWER) ) {
+        return ;
+    }
+    if( iq->blocks == 0 ) {
+        iq->ii = ii ;
+        iq->qq = qq ;
+        iq->iq = cross ;
+    } else {
+        iq->ii += IQ_SMOOTHING * (ii - iq->ii) ;
+        iq->qq += IQ_SMOOTHING * (qq - iq->qq) ;
+        iq->iq += IQ_SMOOTHING * (cross - iq->iq) ;
+    }
+    iq->blocks++ ;
+
+    // Q = g (sin(phi) I + cos(phi) Q_ideal) : Q' = (a/c) (Q/b - s I/a)
+    double a = sqrt( iq->ii );
+    double b = sqrt( iq->qq );
+    double s = iq->iq / (a * b) ;
+    s = fmax( -IQ_MAX_SKEW, fmin( IQ_MAX_SKEW, s ));
+    double c = sqrt( 1 - s * s );
+    iq->cq = (float)(a / (b * c)) ;
+    iq->ci = (float)(-s / c) ;
+    iq->gain_db = (float)(20 * log10( b / a )) ;
+    iq->phase_deg = (float)(asin( s ) * 180 / M_PI) ;
+}
+
+json_t* iq_balance_report( struct t_rx_device *dev ) {
+    struct t_iq_balance *iq = &dev->hot->iq ;
+    json_t *report = json_object();
+    json_object_set_new( report, "enabled", json_boolean( __atomic_load_n( &dev->iq_balance, __ATOMIC_RELAXED )));
+    json_object_set_new( report, "gain_db", json_real( iq->gain_db ));
+    json_object_set_new( report, "phase_deg", json_real( iq->phase_deg ));
+    json_object_set_new( report, "estimates", json_integer( iq->blocks ));
+    return(report);
+}
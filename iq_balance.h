@@ -0,0 +1,47 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef IQ_BALANCE_H
+#define IQ_BALANCE_H
+
+#include "rx_device.h"
+
+/*
+ * IQ imbalance correction : the I and Q branches of the dongle differ slightly in gain and are not
+ * exactly in quadrature, which mirrors every signal as an image on the other side of the center.
+ * Enabled per device in the init parameters,
+ *
+ *   { "iq_balance" : true }  or  { "iq_balance" : { "00000001" : true, "2" : true } }
+ *
+ * or with setRxConfig(). The conversion kernels accumulate the I/Q covariance of the samples they
+ * correct, every IQ_BLOCK samples it is smoothed with the previous estimates and the coefficients
+ * of the next blocks are computed (Gram-Schmidt : Q made orthogonal to I, at the power of I).
+ */
+
+// from the init parameters
+bool iq_balance_configured( struct t_rx_device *dev, int device_id, json_t *root );
+
+// identity coefficients, no estimate. Sample path, when dev->iq_balance_seq changes
+void iq_balance_reset( struct t_iq_balance *iq );
+
+// new coefficients once a block of samples was accumulated. Sample path
+void iq_balance_update( struct t_iq_balance *iq );
+
+// { "enabled", "gain_db", "phase_deg", "estimates" }, caller owns the reference
+json_t* iq_balance_report( struct t_rx_device *dev );
+
+#endif // IQ_BALANCE_H
@@ -0,0 +1,197 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "latency_hist.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC (1)
+#endif
+
+#define SUB_BITS    (4)
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKETS     ((64 - SUB_BITS + 1) * SUB_BUCKETS)
+
+// one writer (the sample path of the device), readers use relaxed loads
+struct t_hist {
+    uint64_t counts[BUCKETS] ;
+    uint64_t total ;
+    uint64_t max ;
+};
+
+struct t_latency {
+    struct t_hist hist[LAT_HIST_COUNT] ;
+    uint64_t reference ;     // completion of the transfer being processed
+    uint64_t last_transfer ;
+    uint32_t starts ;        // stream start of last_transfer
+};
+
+static const char *hist_names[LAT_HIST_COUNT] = { "callback", "push", "usb_to_push", "interval" };
+
+static bool enabled = false ;
+// ticks to ns, from two clock readings apart : the longer the driver runs, the better
+static uint64_t ticks_origin ;
+static int64_t ns_origin ;
+
+static int64_t clock_ns() {
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec );
+}
+
+uint64_t latency_now( void ) {
+#ifdef HAVE_TSC
+    return( __rdtsc() );
+#else
+    return( (uint64_t)clock_ns() );
+#endif
+}
+
+double latency_ns_per_tick( void ) {
+#ifdef HAVE_TSC
+    uint64_t ticks = latency_now() - ticks_origin ;
+    int64_t ns = clock_ns() - ns_origin ;
+    return( ticks > 0 ? (double)ns / ticks : 1.0 );
+#else
+    return(1.0);
+#endif
+}
+
+void latency_setup( json_t *root ) {
+    json_t *v = json_object_get( root, "latency_histograms" );
+    enabled = json_is_true(v);
+    ticks_origin = latency_now();
+    ns_origin = clock_ns();
+}
+
+struct t_latency* latency_attach( struct t_rx_device *dev ) {
+    (void)dev ;
+    if( !enabled ) {
+        return(NULL);
+    }
+    return( (struct t_latency *)calloc( 1, sizeof(struct t_latency)) );
+}
+
+static int bucket_of( uint64_t v ) {
+    if( v < SUB_BUCKETS ) {
+        return( (int)v );
+    }
+    int msb = 63 - __builtin_clzll( v );
+    return( (msb - SUB_BITS + 1) * SUB_BUCKETS + (int)((v >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1)) );
+}
+
+// middle of the values falling in the bucket
+static double bucket_value( int b ) {
+    if( b < SUB_BUCKETS ) {
+        return( b );
+    }
+    int msb = b / SUB_BUCKETS + SUB_BITS - 1 ;
+    int sub = b % SUB_BUCKETS ;
+    double low = (double)((uint64_t)(SUB_BUCKETS + sub) << (msb - SUB_BITS)) ;
+    return( low + (double)(1ULL << (msb - SUB_BITS)) / 2 );
+}
+
+void latency_record( struct t_latency *lat, int hist, uint64_t ticks ) {
+    if( lat == NULL ) {
+        return ;
+    }
+    struct t_hist *h = &lat->hist[hist] ;
+    int b = bucket_of( ticks );
+    __atomic_store_n( &h->counts[b], __atomic_load_n( &h->counts[b], __ATOMIC_RELAXED ) + 1, __ATOMIC_RELAXED );
+    __atomic_store_n( &h->total, __atomic_load_n( &h->total, __ATOMIC_RELAXED ) + 1, __ATOMIC_RELAXED );
+    if( ticks > __atomic_load_n( &h->max, __ATOMIC_RELAXED )) {
+        __atomic_store_n( &h->max, ticks, __ATOMIC_RELAXED );
+    }
+}
+
+void latency_transfer( struct t_latency *lat, uint32_t starts, uint64_t ticks ) {
+    if( lat == NULL ) {
+        return ;
+    }
+    // the first transfer after a start has no meaningful interval
+    if( (lat->last_transfer != 0) && (starts == lat->starts) ) {
+        latency_record( lat, LAT_INTERVAL, ticks - lat->last_transfer );
+    }
+    lat->last_transfer = ticks ;
+    lat->starts = starts ;
+    lat->reference = ticks ;
+}
+
+void latency_set_reference( struct t_latency *lat, uint64_t ticks ) {
+    if( lat != NULL ) {
+        lat->reference = ticks ;
+    }
+}
+
+int latency_push( struct t_rx_device *dev, TYPECPX *samples, int sample_count, struct ext_Context *ctx ) {
+    struct t_latency *lat = dev->latency ;
+    int rc ;
+    uint64_t span = trace_begin();
+    if( lat == NULL ) {
+        rc = (*acqCbFunction)( dev->uuid, (float *)samples, sample_count, 1, ctx );
+    } else {
+        uint64_t start = latency_now();
+        latency_record( lat, LAT_USB_TO_PUSH, start - lat->reference );
+        rc = (*acqCbFunction)( dev->uuid, (float *)samples, sample_count, 1, ctx );
+        latency_record( lat, LAT_PUSH, latency_now() - start );
+    }
+    trace_end( "pushSamples", (int)(dev - rx), span );
+    if( rc > 0 ) {
+        // single writer, the metrics endpoint reads
+        struct t_rx_hot *hot = dev->hot ;
+        __atomic_store_n( &hot->pushed, hot->pushed + sample_count, __ATOMIC_RELAXED );
+        __atomic_store_n( &hot->push_blocks, hot->push_blocks + 1, __ATOMIC_RELAXED );
+    }
+    return(rc);
+}
+
+json_t* latency_report( struct t_latency *lat ) {
+    static const double quantiles[] = { 0.5, 0.99, 0.999 };
+    static const char *quantile_names[] = { "p50_us", "p99_us", "p999_us" };
+    double us = latency_ns_per_tick() / 1000.0 ;
+    json_t *report = json_object();
+
+    for( int k=0 ; k < LAT_HIST_COUNT ; k++ ) {
+        struct t_hist *h = &lat->hist[k] ;
+        json_t *o = json_object();
+        uint64_t total = __atomic_load_n( &h->total, __ATOMIC_RELAXED );
+        uint64_t max = __atomic_load_n( &h->max, __ATOMIC_RELAXED );
+        json_object_set_new( o, "count", json_integer( (json_int_t)total ));
+        int q = 0 ;
+        uint64_t seen = 0 ;
+        for( int b=0 ; (b < BUCKETS) && (q < 3) && (total > 0) ; b++ ) {
+            seen += __atomic_load_n( &h->counts[b], __ATOMIC_RELAXED );
+            while( (q < 3) && (seen >= quantiles[q] * total) ) {
+                double v = bucket_value(b) ;
+                json_object_set_new( o, quantile_names[q], json_real( (v < max ? v : max) * us ));
+                q++ ;
+            }
+        }
+        for( ; q < 3 ; q++ ) {
+            json_object_set_new( o, quantile_names[q], json_real( max * us ));
+        }
+        json_object_set_new( o, "max_us", json_real( max * us ));
+        json_object_set_new( report, hist_names[k], o );
+    }
+    return(report);
+}
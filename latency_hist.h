@@ -0,0 +1,70 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include "rx_device.h"
+
+/*
+ * Per device latency histograms of the sample path, log-linear buckets (16 per octave, ~6%) fed
+ * with TSC timestamps on x86, the monotonic clock elsewhere :
+ *
+ *   callback    : time spent in rtlsdr_callback for a transfer, pushes included
+ *   push        : pushSamples call duration
+ *   usb_to_push : from the completion of the transfer to the push of its samples (worker queue,
+ *                 re-blocking and backpressure queue included)
+ *   interval    : between two transfers of a running stream
+ *
+ * Enabled with { "latency_histograms" : true }, read with getLatencyHistograms().
+ */
+
+#define LAT_CALLBACK    (0)
+#define LAT_PUSH        (1)
+#define LAT_USB_TO_PUSH (2)
+#define LAT_INTERVAL    (3)
+#define LAT_HIST_COUNT  (4)
+
+struct t_latency ;
+
+// reads the configuration, starts the tick calibration
+void latency_setup( json_t *root );
+
+// per device histograms, NULL if disabled
+struct t_latency* latency_attach( struct t_rx_device *dev );
+
+// timestamp in ticks
+uint64_t latency_now( void );
+
+// duration of a tick, calibrated against the monotonic clock since latency_setup()
+double latency_ns_per_tick( void );
+
+// a transfer completed at ticks : interval histogram, and reference of the next pushes
+void latency_transfer( struct t_latency *lat, uint32_t starts, uint64_t ticks );
+
+// reference of the next pushes, when the transfer was queued before being processed
+void latency_set_reference( struct t_latency *lat, uint64_t ticks );
+
+void latency_record( struct t_latency *lat, int hist, uint64_t ticks );
+
+// pushSamples, timed in the push and usb_to_push histograms. Accepted samples are counted in dev->hot
+int latency_push( struct t_rx_device *dev, TYPECPX *samples, int sample_count, struct ext_Context *ctx );
+
+// JSON object with count, p50, p99, p99.9 and max in microseconds for each histogram
+json_t* latency_report( struct t_latency *lat );
+
+#endif // LATENCY_HIST_H
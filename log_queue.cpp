@@ -0,0 +1,196 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "log_queue.h"
+
+#define DEFAULT_QUEUE (256)
+
+// bounded multi producer queue, each slot carries a sequence number telling whether it is free
+// (seq == position) or filled (seq == position + 1)
+struct t_log_slot {
+    uint32_t seq ;
+    int device_id ;
+    int level ;
+    int suppressed ;     // messages of the class not sent before this one
+    char msg[LOG_MSG_SIZE] ;
+};
+
+struct t_rate {
+    int per_second ;     // 0 : no limit
+    int64_t window ;     // second of the current window
+    int count ;          // messages in the window
+    int suppressed ;     // not sent since the last message of the class
+};
+
+static const char *class_names[LOG_CLASS_COUNT] = { "general", "stream", "backpressure", "network", "hotplug" };
+
+static struct t_log_slot *slots = NULL ; // NULL : synchronous delivery
+static uint32_t mask ;
+static uint32_t enqueue_pos ;
+static uint32_t dequeue_pos ;
+static int dropped ;
+static int max_level = INT_MAX ;
+static struct t_rate rates[LOG_CLASS_COUNT] ;
+static sem_t wake ;
+static pthread_t log_thread ;
+
+static int64_t now_s() {
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( (int64_t)ts.tv_sec );
+}
+
+// true if the message is over the rate of its class
+static bool rate_limited( int msg_class ) {
+    struct t_rate *r = &rates[msg_class] ;
+    if( r->per_second == 0 ) {
+        return(false);
+    }
+    int64_t sec = now_s();
+    int64_t window = __atomic_load_n( &r->window, __ATOMIC_RELAXED );
+    if( (window != sec) && __atomic_compare_exchange_n( &r->window, &window, sec, false,
+                                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED )) {
+        __atomic_store_n( &r->count, 0, __ATOMIC_RELAXED );
+    }
+    if( __atomic_fetch_add( &r->count, 1, __ATOMIC_RELAXED ) >= r->per_second ) {
+        __atomic_add_fetch( &r->suppressed, 1, __ATOMIC_RELAXED );
+        return(true);
+    }
+    return(false);
+}
+
+void log_class( int device_id, int level, int msg_class, const char *msg ) {
+    char tmp[LOG_MSG_SIZE] ;
+    if( (level > max_level) || rate_limited( msg_class ) ) {
+        return ;
+    }
+    if( slots == NULL ) {
+        snprintf( tmp, sizeof(tmp), "%s", msg );
+        log_deliver( device_id, level, tmp );
+        return ;
+    }
+
+    struct t_log_slot *slot ;
+    uint32_t pos = __atomic_load_n( &enqueue_pos, __ATOMIC_RELAXED );
+    for( ; ; ) {
+        slot = &slots[pos & mask] ;
+        int32_t diff = (int32_t)(__atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE ) - pos) ;
+        if( diff == 0 ) {
+            if( __atomic_compare_exchange_n( &enqueue_pos, &pos, pos + 1, true,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED )) {
+                break ;
+            }
+        } else if( diff < 0 ) {
+            __atomic_add_fetch( &dropped, 1, __ATOMIC_RELAXED ); // full, the logging thread is late
+            return ;
+        } else {
+            pos = __atomic_load_n( &enqueue_pos, __ATOMIC_RELAXED );
+        }
+    }
+    slot->device_id = device_id ;
+    slot->level = level ;
+    slot->suppressed = __atomic_exchange_n( &rates[msg_class].suppressed, 0, __ATOMIC_RELAXED );
+    snprintf( slot->msg, sizeof(slot->msg), "%s", msg );
+    __atomic_store_n( &slot->seq, pos + 1, __ATOMIC_RELEASE );
+    sem_post( &wake );
+}
+
+static void* log_thread_run( void *params ) {
+    char msg[LOG_MSG_SIZE + 64] ;
+    (void)params ;
+    for( ; ; ) {
+        sem_wait( &wake );
+        for( ; ; ) {
+            struct t_log_slot *slot = &slots[dequeue_pos & mask] ;
+            if( __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE ) != dequeue_pos + 1 ) {
+                break ;
+            }
+            int device_id = slot->device_id ;
+            int level = slot->level ;
+            if( slot->suppressed > 0 ) {
+                snprintf( msg, sizeof(msg), "%s (%d similar suppressed)", slot->msg, slot->suppressed );
+            } else {
+                snprintf( msg, sizeof(msg), "%s", slot->msg );
+            }
+            __atomic_store_n( &slot->seq, dequeue_pos + mask + 1, __ATOMIC_RELEASE );
+            dequeue_pos++ ;
+            log_deliver( device_id, level, msg );
+        }
+        int lost = __atomic_exchange_n( &dropped, 0, __ATOMIC_RELAXED );
+        if( lost > 0 ) {
+            snprintf( msg, sizeof(msg), "log: %d messages dropped, queue full", lost );
+            log_deliver( 0, 0, msg );
+        }
+    }
+    return(NULL);
+}
+
+void log_queue_setup( json_t *root ) {
+    json_t *conf = json_object_get( root, "log" );
+    uint32_t size = 1 ;
+    int queue = DEFAULT_QUEUE ;
+
+    rates[LOG_STREAM].per_second = 10 ;
+    rates[LOG_BACKPRESSURE].per_second = 10 ;
+    if( json_is_object(conf) ) {
+        json_t *v = json_object_get( conf, "level" );
+        if( json_is_integer(v) ) {
+            max_level = (int)json_integer_value(v);
+        }
+        v = json_object_get( conf, "queue" );
+        if( json_is_integer(v) && (json_integer_value(v) >= 16) && (json_integer_value(v) <= 65536) ) {
+            queue = (int)json_integer_value(v);
+        }
+        json_t *rate = json_object_get( conf, "rate" );
+        for( int k=0 ; json_is_object(rate) && (k < LOG_CLASS_COUNT) ; k++ ) {
+            v = json_object_get( rate, class_names[k] );
+            if( json_is_integer(v) && (json_integer_value(v) >= 0) ) {
+                rates[k].per_second = (int)json_integer_value(v);
+            }
+        }
+    }
+    if( slots != NULL ) {
+        return ; // thread already running
+    }
+    while( size < (uint32_t)queue ) {
+        size <<= 1 ;
+    }
+    struct t_log_slot *s = (struct t_log_slot *)calloc( size, sizeof(struct t_log_slot));
+    if( s == NULL ) {
+        return ;
+    }
+    for( uint32_t k=0 ; k < size ; k++ ) {
+        s[k].seq = k ;
+    }
+    mask = size - 1 ;
+    enqueue_pos = dequeue_pos = 0 ;
+    sem_init( &wake, 0, 0 );
+    __atomic_store_n( &slots, s, __ATOMIC_RELEASE );
+    if( pthread_create( &log_thread, NULL, log_thread_run, NULL ) != 0 ) {
+        __atomic_store_n( &slots, (struct t_log_slot *)NULL, __ATOMIC_RELEASE );
+        free(s);
+    }
+}
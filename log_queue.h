@@ -0,0 +1,53 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LOG_QUEUE_H
+#define LOG_QUEUE_H
+
+#include "jansson/jansson.h"
+
+/*
+ * Asynchronous log path : log() only copies the message in a lock-free queue, a background thread
+ * hands it to SDRNode. A full queue drops the message, so logging never blocks the sample path.
+ *
+ *   { "log" : { "level" : 0,                                // messages above this level are dropped
+ *               "queue" : 256,                              // slots, rounded up to a power of 2
+ *               "rate" : { "stream" : 10, "backpressure" : 5 } } } // per second and per class, 0 : no limit
+ *
+ * Messages over the rate are counted, the count is appended to the next message of the class.
+ */
+
+#define LOG_MSG_SIZE (256)
+
+// message classes, rate limited separately
+#define LOG_GENERAL      (0) // setup, settings
+#define LOG_STREAM       (1) // stream lost, stall, recovery
+#define LOG_BACKPRESSURE (2)
+#define LOG_NETWORK      (3) // rtl_tcp, multicast clients
+#define LOG_HOTPLUG      (4)
+#define LOG_CLASS_COUNT  (5)
+
+// reads the configuration and starts the logging thread, messages are delivered synchronously before
+void log_queue_setup( json_t *root );
+
+// never blocks. Same as log(), with a class
+void log_class( int device_id, int level, int msg_class, const char *msg );
+
+// called by the logging thread, in entrypoint.cpp
+void log_deliver( int device_id, int level, char *msg );
+
+#endif // LOG_QUEUE_H
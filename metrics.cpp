@@ -0,0 +1,273 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "metrics.h"
+#include "backpressure.h"
+#include "stream_engine.h"
+#include "worker_pool.h"
+#include "latency_hist.h"
+
+bool metrics_enabled = false ;
+
+#ifndef _WIN64
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define PAGE_PER_DEVICE (4096)
+#define PAGE_BASE       (8192)
+
+static int port ;
+static char bind_addr[64] = "127.0.0.1" ;
+static char *page ;            // scrape output
+static size_t page_size ;
+static size_t page_len ;
+static int page_devices ;      // devices the page has room for
+static uint64_t *last_received ; // clipping ratio since the previous scrape
+static uint64_t *last_clipped ;
+
+void metrics_setup( json_t *root ) {
+    json_t *conf = json_object_get( root, "metrics" );
+    if( !json_is_object(conf) ) {
+        return ;
+    }
+    json_t *v = json_object_get( conf, "port" );
+    if( json_is_integer(v) && (json_integer_value(v) > 0) && (json_integer_value(v) < 65536) ) {
+        port = (int)json_integer_value(v);
+    }
+    v = json_object_get( conf, "bind" );
+    if( json_is_string(v) ) {
+        snprintf( bind_addr, sizeof(bind_addr), "%s", json_string_value(v));
+    }
+    metrics_enabled = (port > 0) ;
+}
+
+static void out( const char *fmt, ... ) {
+    va_list ap ;
+    if( page_len >= page_size ) {
+        return ;
+    }
+    va_start( ap, fmt );
+    int n = vsnprintf( page + page_len, page_size - page_len, fmt, ap );
+    va_end( ap );
+    if( n > 0 ) {
+        page_len += (size_t)n < page_size - page_len ? (size_t)n : page_size - page_len - 1 ;
+    }
+}
+
+static void family( const char *name, const char *type, const char *help ) {
+    out( "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type );
+}
+
+static void value( const char *name, int d, double v ) {
+    out( "%s{device=\"%d\",serial=\"%s\"} %.17g\n", name, d, rx[d].device_serial_number, v );
+}
+
+static double thread_cpu_seconds( pthread_t thread ) {
+    clockid_t clock ;
+    struct timespec ts ;
+    if( (pthread_getcpuclockid( thread, &clock ) != 0) || (clock_gettime( clock, &ts ) != 0) ) {
+        return(0);
+    }
+    return( ts.tv_sec + ts.tv_nsec * 1e-9 );
+}
+
+static void render() {
+    int count = __atomic_load_n( &device_count, __ATOMIC_ACQUIRE );
+    if( count > page_devices ) {
+        count = page_devices ;
+    }
+    double seconds_per_tick = latency_ns_per_tick() * 1e-9 ;
+    struct t_push_counters bp[count > 0 ? count : 1] ;
+
+    for( int d=0 ; d < count ; d++ ) {
+        memset( &bp[d], 0, sizeof(bp[d]));
+        backpressure_counters( rx[d].backpressure, &bp[d] );
+    }
+    page_len = 0 ;
+
+#define EACH_DEVICE(name, expr) for( int d=0 ; d < count ; d++ ) { struct t_rx_device *dev = &rx[d] ; (void)dev ; value( name, d, (expr) ); }
+    family( "rtlsdr_up", "gauge", "1 if the dongle is present" );
+    EACH_DEVICE( "rtlsdr_up", __atomic_load_n( &dev->present, __ATOMIC_RELAXED ))
+    family( "rtlsdr_streaming", "gauge", "1 if samples are pushed to SDRNode" );
+    EACH_DEVICE( "rtlsdr_streaming", __atomic_load_n( &dev->hot->state, __ATOMIC_RELAXED ) == RX_STREAMING )
+    family( "rtlsdr_sample_rate_hz", "gauge", "Sample rate" );
+    EACH_DEVICE( "rtlsdr_sample_rate_hz", dev->current_sample_rate )
+    family( "rtlsdr_center_frequency_hz", "gauge", "Tuned frequency" );
+    EACH_DEVICE( "rtlsdr_center_frequency_hz", dev->center_frq_hz )
+    family( "rtlsdr_gain_db", "gauge", "Tuner gain" );
+    EACH_DEVICE( "rtlsdr_gain_db", dev->gain )
+    family( "rtlsdr_ppm_correction", "gauge", "Crystal correction, tuner and NCO" );
+    EACH_DEVICE( "rtlsdr_ppm_correction", dev->ppm + __atomic_load_n( &dev->nco_ppb, __ATOMIC_RELAXED ) / 1000.0 )
+    family( "rtlsdr_samples_received_total", "counter", "Samples of the transfers processed" );
+    EACH_DEVICE( "rtlsdr_samples_received_total", __atomic_load_n( &dev->hot->received, __ATOMIC_RELAXED ))
+    family( "rtlsdr_samples_pushed_total", "counter", "Samples accepted by SDRNode" );
+    EACH_DEVICE( "rtlsdr_samples_pushed_total", __atomic_load_n( &dev->hot->pushed, __ATOMIC_RELAXED ))
+    family( "rtlsdr_blocks_pushed_total", "counter", "Blocks accepted by SDRNode" );
+    EACH_DEVICE( "rtlsdr_blocks_pushed_total", __atomic_load_n( &dev->hot->push_blocks, __ATOMIC_RELAXED ))
+    family( "rtlsdr_pushes_refused_total", "counter", "Pushes refused by SDRNode (backpressure enabled)" );
+    EACH_DEVICE( "rtlsdr_pushes_refused_total", bp[d].refused )
+    family( "rtlsdr_blocks_dropped_total", "counter", "Blocks dropped under backpressure" );
+    EACH_DEVICE( "rtlsdr_blocks_dropped_total", bp[d].dropped )
+    family( "rtlsdr_transfers_dropped_total", "counter", "USB transfers dropped, DSP workers late (shared engine)" );
+    EACH_DEVICE( "rtlsdr_transfers_dropped_total", stream_engine_overruns( dev ))
+    family( "rtlsdr_discontinuities_total", "counter", "Times samples were lost (ext_Context.discontinuity)" );
+    EACH_DEVICE( "rtlsdr_discontinuities_total", dev->context.discontinuity )
+    family( "rtlsdr_callback_seconds_total", "counter", "Time spent converting and pushing samples" );
+    EACH_DEVICE( "rtlsdr_callback_seconds_total", __atomic_load_n( &dev->hot->callback_ticks, __ATOMIC_RELAXED ) * seconds_per_tick )
+    family( "rtlsdr_acquisition_cpu_seconds_total", "counter", "CPU time of the acquisition thread" );
+    EACH_DEVICE( "rtlsdr_acquisition_cpu_seconds_total", thread_cpu_seconds( dev->receive_thread ))
+    family( "rtlsdr_control_transfers_total", "counter", "Control requests sent to the device" );
+    EACH_DEVICE( "rtlsdr_control_transfers_total", __atomic_load_n( &dev->ctl.transfers, __ATOMIC_RELAXED ))
+    family( "rtlsdr_control_transfers_avoided_total", "counter", "Settings and reads answered by the control state cache" );
+    EACH_DEVICE( "rtlsdr_control_transfers_avoided_total", __atomic_load_n( &dev->ctl.avoided, __ATOMIC_RELAXED ))
+    family( "rtlsdr_iq_gain_imbalance_db", "gauge", "Q amplitude relative to I, IQ correction enabled" );
+    EACH_DEVICE( "rtlsdr_iq_gain_imbalance_db", dev->hot->iq.gain_db )
+    family( "rtlsdr_iq_phase_imbalance_degrees", "gauge", "I/Q skew from quadrature, IQ correction enabled" );
+    EACH_DEVICE( "rtlsdr_iq_phase_imbalance_degrees", dev->hot->iq.phase_deg )
+    family( "rtlsdr_clipped_samples_total", "counter", "Samples with I or Q at the ADC limits" );
+    EACH_DEVICE( "rtlsdr_clipped_samples_total", __atomic_load_n( &dev->hot->clipped, __ATOMIC_RELAXED ))
+    family( "rtlsdr_clipping_ratio", "gauge", "Clipped samples ratio since the previous scrape" );
+    for( int d=0 ; d < count ; d++ ) {
+        uint64_t received = __atomic_load_n( &rx[d].hot->received, __ATOMIC_RELAXED );
+        uint64_t clipped = __atomic_load_n( &rx[d].hot->clipped, __ATOMIC_RELAXED );
+        uint64_t dr = received - last_received[d] ;
+        value( "rtlsdr_clipping_ratio", d, dr > 0 ? (double)(clipped - last_clipped[d]) / dr : 0.0 );
+        last_received[d] = received ;
+        last_clipped[d] = clipped ;
+    }
+#undef EACH_DEVICE
+
+    if( stream_engine.mode == STREAM_ENGINE_SHARED ) {
+        family( "rtlsdr_dsp_worker_cpu_seconds_total", "counter", "CPU time of the shared DSP workers" );
+        for( int k=0 ; k < worker_pool_size() ; k++ ) {
+            out( "rtlsdr_dsp_worker_cpu_seconds_total{worker=\"%d\"} %.17g\n", k, thread_cpu_seconds( worker_pool_thread(k) ));
+        }
+    }
+}
+
+static void serve( int sock ) {
+    char request[1024] ;
+    char header[256] ;
+    size_t len = 0 ;
+    struct timeval tv = { 1, 0 };
+
+    setsockopt( sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt( sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    while( len < sizeof(request) - 1 ) {
+        ssize_t n = recv( sock, request + len, sizeof(request) - 1 - len, 0 );
+        if( n <= 0 ) {
+            break ;
+        }
+        len += n ;
+        request[len] = 0 ;
+        if( strstr( request, "\r\n\r\n" ) != NULL ) {
+            break ;
+        }
+    }
+    request[len] = 0 ;
+
+    const char *body = page ;
+    size_t body_len ;
+    int n ;
+    if( (strncmp( request, "GET /metrics ", 13 ) == 0) || (strncmp( request, "GET /metrics?", 13 ) == 0) ) {
+        render();
+        body_len = page_len ;
+        n = snprintf( header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                              "Content-Length: %d\r\nConnection: close\r\n\r\n", (int)body_len );
+    } else {
+        body = "not found\n" ;
+        body_len = strlen( body );
+        n = snprintf( header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n"
+                                              "Content-Length: %d\r\nConnection: close\r\n\r\n", (int)body_len );
+    }
+    if( send( sock, header, n, MSG_NOSIGNAL ) == n ) {
+        size_t sent = 0 ;
+        while( sent < body_len ) {
+            ssize_t k = send( sock, body + sent, body_len - sent, MSG_NOSIGNAL );
+            if( k <= 0 ) {
+                break ;
+            }
+            sent += k ;
+        }
+    }
+    close( sock );
+}
+
+static void* metrics_thread( void *params ) {
+    int listen_sock = (int)(intptr_t)params ;
+    for( ; ; ) {
+        int sock = accept( listen_sock, NULL, NULL );
+        if( sock >= 0 ) {
+            serve( sock );
+        }
+    }
+    return(NULL);
+}
+
+void metrics_start( void ) {
+    struct sockaddr_in addr ;
+    pthread_t thread ;
+    char msg[256] ;
+
+    if( !metrics_enabled ) {
+        return ;
+    }
+    // hot-plugged devices included
+    page_devices = rx_capacity ;
+    page_size = PAGE_BASE + (size_t)PAGE_PER_DEVICE * page_devices ;
+    page = (char *)malloc( page_size );
+    last_received = (uint64_t *)calloc( page_devices, sizeof(uint64_t));
+    last_clipped = (uint64_t *)calloc( page_devices, sizeof(uint64_t));
+    if( (page == NULL) || (last_received == NULL) || (last_clipped == NULL) ) {
+        return ;
+    }
+
+    int sock = socket( AF_INET, SOCK_STREAM, 0 );
+    int one = 1 ;
+    setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset( &addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET ;
+    addr.sin_port = htons( port );
+    addr.sin_addr.s_addr = inet_addr( bind_addr );
+    if( (bind( sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen( sock, 4 ) != 0) ) {
+        snprintf( msg, sizeof(msg), "metrics: cannot listen on %s:%d", bind_addr, port );
+        log( 0, 0, msg );
+        close( sock );
+        return ;
+    }
+    pthread_create( &thread, NULL, metrics_thread, (void *)(intptr_t)sock );
+    pthread_detach( thread );
+    snprintf( msg, sizeof(msg), "metrics: serving http://%s:%d/metrics", bind_addr, port );
+    log( 0, 0, msg );
+}
+
+#else
+// metrics endpoint relies on POSIX sockets, not available in the Windows build
+void metrics_setup( json_t *root ) {
+}
+
+void metrics_start( void ) {
+}
+#endif
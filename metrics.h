@@ -0,0 +1,41 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "rx_device.h"
+
+/*
+ * Prometheus endpoint : a small HTTP listener serving per device metrics in the text exposition
+ * format on GET /metrics.
+ *
+ *   { "metrics" : { "port" : 9130, "bind" : "127.0.0.1" } }   // bind defaults to 127.0.0.1
+ *
+ * The page is written in a buffer allocated at start, nothing is allocated per scrape.
+ */
+
+// counters that cost on the sample path (clipping, callback time) are kept only when true
+extern bool metrics_enabled ;
+
+// reads the configuration, before the devices are set up
+void metrics_setup( json_t *root );
+
+// opens the listener and starts its thread, once the devices are set up
+void metrics_start( void );
+
+#endif // METRICS_H
@@ -0,0 +1,261 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "numa_placement.h"
+
+static bool numa_enabled = true ;
+
+void numa_placement_setup( json_t *root ) {
+    json_t *v = json_object_get( root, "numa" );
+    if( json_is_string(v) && (strcmp( json_string_value(v), "off" ) == 0) ) {
+        numa_enabled = false ;
+    }
+}
+
+#ifdef __linux__
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define USB_DEVICES_DIR "/sys/bus/usb/devices"
+#define MPOL_PREFERRED_MODE (1) // from linux/mempolicy.h, avoids a libnuma dependency
+#define MAX_RTL_DEVICES (64)
+
+// VID/PID pairs handled by librtlsdr (most common ones)
+static const unsigned int known_ids[][2] = {
+    { 0x0bda, 0x2832 }, { 0x0bda, 0x2838 }, { 0x0413, 0x6680 }, { 0x0413, 0x6f0f },
+    { 0x0458, 0x707f }, { 0x0ccd, 0x00a9 }, { 0x0ccd, 0x00b3 }, { 0x0ccd, 0x00b4 },
+    { 0x0ccd, 0x00b5 }, { 0x0ccd, 0x00b7 }, { 0x0ccd, 0x00b8 }, { 0x0ccd, 0x00b9 },
+    { 0x0ccd, 0x00c0 }, { 0x0ccd, 0x00c6 }, { 0x0ccd, 0x00d3 }, { 0x0ccd, 0x00d7 },
+    { 0x0ccd, 0x00e0 }, { 0x185b, 0x0620 }, { 0x185b, 0x0650 }, { 0x185b, 0x0680 },
+    { 0x1b80, 0xd393 }, { 0x1b80, 0xd394 }, { 0x1b80, 0xd395 }, { 0x1b80, 0xd397 },
+    { 0x1b80, 0xd398 }, { 0x1b80, 0xd39d }, { 0x1b80, 0xd3a4 }, { 0x1b80, 0xd3a8 },
+    { 0x1b80, 0xd3af }, { 0x1b80, 0xd3b0 }, { 0x1d19, 0x1101 }, { 0x1d19, 0x1102 },
+    { 0x1d19, 0x1103 }, { 0x1d19, 0x1104 }, { 0x1f4d, 0xa803 }, { 0x1f4d, 0xb803 },
+    { 0x1f4d, 0xc803 }, { 0x1f4d, 0xd286 }, { 0x1f4d, 0xd803 }
+};
+
+struct t_usb_entry {
+    char path[PATH_MAX] ;
+    char serial[256] ;
+    int busnum ;
+    int devnum ;
+};
+
+static bool read_line( const char *dir, const char *attr, char *out, size_t len ) {
+    char path[PATH_MAX] ;
+    snprintf( path, sizeof(path), "%s/%s", dir, attr );
+    FILE *f = fopen( path, "r" );
+    if( f == NULL ) {
+        return(false);
+    }
+    bool ok = (fgets( out, len, f ) != NULL);
+    fclose(f);
+    if( ok ) {
+        out[strcspn( out, "\n" )] = 0 ;
+    }
+    return(ok);
+}
+
+static bool is_rtl_device( const char *dir ) {
+    char vid[16], pid[16] ;
+    if( !read_line( dir, "idVendor", vid, sizeof(vid)) || !read_line( dir, "idProduct", pid, sizeof(pid))) {
+        return(false);
+    }
+    unsigned int v = strtoul( vid, NULL, 16 );
+    unsigned int p = strtoul( pid, NULL, 16 );
+    for( size_t k=0 ; k < sizeof(known_ids)/sizeof(known_ids[0]) ; k++ ) {
+        if( (known_ids[k][0] == v) && (known_ids[k][1] == p) ) return(true);
+    }
+    return(false);
+}
+
+static int compare_entries( const void *a, const void *b ) {
+    const struct t_usb_entry *ea = (const struct t_usb_entry *)a ;
+    const struct t_usb_entry *eb = (const struct t_usb_entry *)b ;
+    if( ea->busnum != eb->busnum ) return( ea->busnum - eb->busnum );
+    return( ea->devnum - eb->devnum );
+}
+
+// walks up from the usb device to the first parent having a numa_node attribute (the PCI controller)
+static int node_of_path( const char *sysfs_path ) {
+    char path[PATH_MAX] ;
+    char value[32] ;
+    if( realpath( sysfs_path, path ) == NULL ) {
+        return(-1);
+    }
+    for( ; ; ) {
+        if( read_line( path, "numa_node", value, sizeof(value)) ) {
+            return( atoi(value) );
+        }
+        char *slash = strrchr( path, '/' );
+        if( (slash == NULL) || (slash == path) ) {
+            return(-1);
+        }
+        *slash = 0 ;
+    }
+}
+
+int numa_node_of_usb_device( int usb_index, const char *serial ) {
+    struct t_usb_entry *entries ;
+    int count = 0 ;
+    int node = -1 ;
+
+    if( !numa_enabled ) {
+        return(-1);
+    }
+    DIR *d = opendir( USB_DEVICES_DIR );
+    if( d == NULL ) {
+        return(-1);
+    }
+    entries = (struct t_usb_entry *)calloc( MAX_RTL_DEVICES, sizeof(struct t_usb_entry));
+    struct dirent *e ;
+    while( (entries != NULL) && ((e = readdir(d)) != NULL) && (count < MAX_RTL_DEVICES) ) {
+        if( (e->d_name[0] == '.') || (strchr( e->d_name, ':' ) != NULL) ) {
+            continue ; // interfaces are named bus-port:config.interface
+        }
+        struct t_usb_entry *u = &entries[count] ;
+        char num[16] ;
+        snprintf( u->path, sizeof(u->path), "%s/%s", USB_DEVICES_DIR, e->d_name );
+        if( !is_rtl_device( u->path )) {
+            continue ;
+        }
+        if( !read_line( u->path, "serial", u->serial, sizeof(u->serial)) ) u->serial[0] = 0 ;
+        u->busnum = read_line( u->path, "busnum", num, sizeof(num)) ? atoi(num) : 0 ;
+        u->devnum = read_line( u->path, "devnum", num, sizeof(num)) ? atoi(num) : 0 ;
+        count++ ;
+    }
+    closedir(d);
+    if( count == 0 ) {
+        free( entries );
+        return(-1);
+    }
+    // libusb enumerates in bus/address order
+    qsort( entries, count, sizeof(struct t_usb_entry), compare_entries );
+
+    // a unique serial identifies the dongle, otherwise rely on the enumeration order
+    int match = -1 ;
+    int same_serial = 0 ;
+    for( int k=0 ; (serial != NULL) && (serial[0] != 0) && (k < count) ; k++ ) {
+        if( strcmp( entries[k].serial, serial ) == 0 ) {
+            match = k ;
+            same_serial++ ;
+        }
+    }
+    if( same_serial != 1 ) {
+        match = (usb_index < count) ? usb_index : -1 ;
+    }
+    if( match >= 0 ) {
+        node = node_of_path( entries[match].path );
+    }
+    free( entries );
+    return(node);
+}
+
+int numa_node_cpus( int node, struct t_thread_settings *s ) {
+    char dir[64] ;
+    char list[1024] ;
+    snprintf( dir, sizeof(dir), "/sys/devices/system/node/node%d", node );
+    s->cpu_count = 0 ;
+    if( (node < 0) || !read_line( dir, "cpulist", list, sizeof(list)) ) {
+        return(0);
+    }
+    // "0-7,16-23"
+    char *save = NULL ;
+    for( char *tok = strtok_r( list, ",", &save ) ; tok != NULL ; tok = strtok_r( NULL, ",", &save )) {
+        int first, last ;
+        if( sscanf( tok, "%d-%d", &first, &last ) != 2 ) {
+            first = last = atoi(tok);
+        }
+        for( int cpu = first ; (cpu <= last) && (s->cpu_count < MAX_PINNED_CPUS) ; cpu++ ) {
+            s->cpus[s->cpu_count++] = cpu ;
+        }
+    }
+    return( s->cpu_count );
+}
+
+int numa_bind_range( void *ptr, size_t size, int node ) {
+    if( (node < 0) || (node >= 64) || !numa_enabled ) {
+        return(0);
+    }
+    unsigned long mask = 1UL << node ;
+    return( (int)syscall( SYS_mbind, ptr, size, MPOL_PREFERRED_MODE, &mask, sizeof(mask)*8, 0 ));
+}
+
+void* numa_buffer_alloc( size_t size, int node ) {
+    void *p = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( p == MAP_FAILED ) {
+        return(NULL);
+    }
+    // policy is set before the first touch, so pages are faulted in on the node
+    numa_bind_range( p, size, node );
+    return(p);
+}
+
+void numa_buffer_free( void *ptr, size_t size ) {
+    if( ptr != NULL ) {
+        munmap( ptr, size );
+    }
+}
+
+#else
+#ifdef _WIN64
+#include <malloc.h>
+#endif
+
+int numa_node_of_usb_device( int usb_index, const char *serial ) {
+    return(-1);
+}
+
+int numa_node_cpus( int node, struct t_thread_settings *s ) {
+    s->cpu_count = 0 ;
+    return(0);
+}
+
+int numa_bind_range( void *ptr, size_t size, int node ) {
+    return(0);
+}
+
+void* numa_buffer_alloc( size_t size, int node ) {
+    void *p = NULL ;
+#ifdef _WIN64
+    p = _aligned_malloc( size, 4096 );
+#else
+    if( posix_memalign( &p, 4096, size ) != 0 ) {
+        p = NULL ;
+    }
+#endif
+    if( p != NULL ) {
+        memset( p, 0, size );
+    }
+    return(p);
+}
+
+void numa_buffer_free( void *ptr, size_t size ) {
+#ifdef _WIN64
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+#endif
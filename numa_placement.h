@@ -0,0 +1,53 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NUMA_PLACEMENT_H
+#define NUMA_PLACEMENT_H
+
+#include <stddef.h>
+
+#include "thread_tuning.h"
+
+/*
+ * NUMA placement : each dongle is attached to the node of its USB host controller. The streaming
+ * buffers of the device are allocated on that node and its acquisition thread runs on the node cpus
+ * (unless cpus are given in the "threads" section).
+ *
+ *   { "numa" : "auto" }   // auto (default) | off
+ *
+ * The node is found from sysfs : /sys/bus/usb/devices/<port>/ is matched with the dongle (serial
+ * number, or enumeration order when serials are not unique) and its parents are walked up to the
+ * PCI controller numa_node attribute. Nothing changes on single node hosts.
+ */
+
+// reads the configuration
+void numa_placement_setup( json_t *root );
+
+// node of the USB controller of the index-th librtlsdr device, -1 if unknown or disabled
+int numa_node_of_usb_device( int usb_index, const char *serial );
+
+// fills s->cpus with the cpus of the node, returns the cpu count
+int numa_node_cpus( int node, struct t_thread_settings *s );
+
+// page aligned, zero filled buffer, preferably on node (any node if node < 0). Release with numa_buffer_free()
+void* numa_buffer_alloc( size_t size, int node );
+void numa_buffer_free( void *ptr, size_t size );
+
+// moves the (not yet touched) pages of an existing mapping to node
+int numa_bind_range( void *ptr, size_t size, int node );
+
+#endif // NUMA_PLACEMENT_H
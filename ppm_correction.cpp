@@ -0,0 +1,321 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "ppm_correction.h"
+#include "dsp.h"
+
+#define MIN_FFT        (1024)
+#define MAX_FFT        (1 << 20)
+#define DC_GUARD_BINS  (8)      // DC spike and its leakage
+#define MIN_SNR        (20.0)   // peak over the mean of the search range
+#define CONVERGED_PPM  (0.05)
+
+static struct {
+    bool enabled ;
+    double reference_hz ;
+    int fft ;
+    int averages ;
+    double max_ppm ;
+    int period_s ;
+} config = { false, 0, 65536, 8, 100, 60 };
+
+struct t_ppm_estimator {
+    struct t_rx_device *dev ;
+    int device_id ;
+    // filled by the sample path while want is set
+    unsigned char *raw ;
+    int fill ;
+    int want ;
+    long ctx_version ;     // context of the samples in raw
+    int64_t center_freq ;
+    unsigned int rate ;
+    sem_t full ;
+    // estimator thread
+    pthread_t thread ;
+    TYPECPX *work ;
+    float *window ;
+    float *power ;
+    int count ;            // spectra in power
+    long acc_version ;
+    int acc_ppm ;          // tuner correction of the samples in power
+};
+
+int ppm_configured( struct t_rx_device *dev, int device_id, json_t *root ) {
+    json_t *conf = json_object_get( root, "ppm" );
+    char index[16] ;
+    if( json_is_object(conf) ) {
+        snprintf( index, sizeof(index), "%d", device_id );
+        json_t *v = json_object_get( conf, dev->device_serial_number );
+        conf = (v != NULL) ? v : json_object_get( conf, index );
+    }
+    if( json_is_integer(conf) && (llabs( json_integer_value(conf) ) <= 1000) ) {
+        return( (int)json_integer_value(conf) );
+    }
+    return(0);
+}
+
+void ppm_estimator_setup( json_t *root ) {
+    json_t *conf = json_object_get( root, "ppm_estimator" );
+    if( !json_is_object(conf) ) {
+        return ;
+    }
+    json_t *v = json_object_get( conf, "reference_hz" );
+    if( !json_is_number(v) || (json_number_value(v) <= 0) ) {
+        return ;
+    }
+    config.reference_hz = json_number_value(v);
+    v = json_object_get( conf, "fft" );
+    if( json_is_integer(v) && (json_integer_value(v) >= MIN_FFT) && (json_integer_value(v) <= MAX_FFT) ) {
+        config.fft = MIN_FFT ;
+        while( config.fft < json_integer_value(v) ) {
+            config.fft <<= 1 ;
+        }
+    }
+    v = json_object_get( conf, "averages" );
+    if( json_is_integer(v) && (json_integer_value(v) > 0) ) {
+        config.averages = (int)json_integer_value(v);
+    }
+    v = json_object_get( conf, "max_ppm" );
+    if( json_is_number(v) && (json_number_value(v) > 0) ) {
+        config.max_ppm = json_number_value(v);
+    }
+    v = json_object_get( conf, "period_s" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 0) ) {
+        config.period_s = (int)json_integer_value(v);
+    }
+    config.enabled = true ;
+}
+
+// offset of the reference from the tuned frequency if it can be measured
+static bool reference_in_band( int64_t center_freq, unsigned int rate, double *offset ) {
+    *offset = config.reference_hz - center_freq ;
+    double bin = (double)rate / config.fft ;
+    return( (rate > 0) && (fabs(*offset) < 0.45 * rate) && (fabs(*offset) > DC_GUARD_BINS * bin) );
+}
+
+void ppm_estimator_feed( struct t_rx_device *dev, const unsigned char *buf, int sample_count ) {
+    struct t_ppm_estimator *est = dev->ppm_estimator ;
+    double offset ;
+    if( (est == NULL) || !__atomic_load_n( &est->want, __ATOMIC_ACQUIRE ) ) {
+        return ;
+    }
+    if( (est->fill == 0) || (est->ctx_version != dev->context.ctx_version) ) {
+        if( !reference_in_band( dev->context.center_freq, dev->context.sample_rate, &offset )) {
+            return ;
+        }
+        est->fill = 0 ;
+        est->ctx_version = dev->context.ctx_version ;
+        est->center_freq = dev->context.center_freq ;
+        est->rate = dev->context.sample_rate ;
+    }
+    int n = config.fft - est->fill ;
+    if( n > sample_count ) {
+        n = sample_count ;
+    }
+    memcpy( est->raw + 2 * est->fill, buf, 2 * n );
+    est->fill += n ;
+    if( est->fill == config.fft ) {
+        __atomic_store_n( &est->want, 0, __ATOMIC_RELEASE );
+        sem_post( &est->full );
+    }
+}
+
+void ppm_nco( struct t_rx_device *dev, TYPECPX *samples, int sample_count ) {
+    struct t_rx_hot *hot = dev->hot ;
+    int32_t ppb = __atomic_load_n( &dev->nco_ppb, __ATOMIC_RELAXED );
+    if( (ppb != hot->nco_ppb) || (dev->context.center_freq != hot->nco_freq) ||
+        (dev->context.sample_rate != hot->nco_rate) ) {
+        // the LO error in Hz follows the tuned frequency
+        double step = 2 * M_PI * dev->context.center_freq * ppb * 1e-9 / (dev->context.sample_rate > 0 ? dev->context.sample_rate : 1) ;
+        hot->nco_step.re = (float)cos( step );
+        hot->nco_step.im = (float)sin( step );
+        hot->nco_ppb = ppb ;
+        hot->nco_freq = dev->context.center_freq ;
+        hot->nco_rate = dev->context.sample_rate ;
+        if( (hot->nco.re == 0) && (hot->nco.im == 0) ) {
+            hot->nco.re = 1 ;
+        }
+    }
+    if( ppb != 0 ) {
+        dsp_nco( samples, sample_count, &hot->nco, hot->nco_step );
+    }
+}
+
+/**
+ * @brief measure peak of the averaged spectrum near the expected bin, interpolated on the log power
+ * @return correction in ppm the samples call for, NAN if the reference was not found
+ */
+static double measure( struct t_ppm_estimator *est, double expected ) {
+    int n = config.fft ;
+    double bin_hz = (double)est->rate / n ;
+    int center = (int)lrint( expected / bin_hz );
+    int range = (int)ceil( config.max_ppm * 1e-6 * est->center_freq / bin_hz ) + 2 ;
+    int best = 0 ;
+    float best_power = -1 ;
+    double sum = 0 ;
+    int summed = 0 ;
+    for( int k = center - range ; k <= center + range ; k++ ) {
+        if( (abs(k) <= DC_GUARD_BINS) || (abs(k) >= n/2 - 1) ) {
+            continue ;
+        }
+        float p = est->power[k & (n - 1)] ;
+        sum += p ;
+        summed++ ;
+        if( p > best_power ) {
+            best_power = p ;
+            best = k ;
+        }
+    }
+    if( (summed < 3) || (best_power <= 0) || (best_power < MIN_SNR * sum / summed) ) {
+        return(NAN);
+    }
+    double a = log( est->power[(best - 1) & (n - 1)] + 1e-30 );
+    double b = log( best_power );
+    double c = log( est->power[(best + 1) & (n - 1)] + 1e-30 );
+    double den = a - 2 * b + c ;
+    double delta = (den < 0) ? 0.5 * (a - c) / den : 0 ;
+    double measured = (best + delta) * bin_hz ;
+    // the carrier shows up at offset - center_freq * (error - correction)
+    return( est->acc_ppm - (measured - expected) / (est->center_freq * 1e-6) );
+}
+
+static void apply( struct t_ppm_estimator *est, double ppm ) {
+    struct t_rx_device *dev = est->dev ;
+    char msg[256] ;
+    int tuner = (int)lrint( ppm );
+    pthread_mutex_lock( &dev->ctl_lock );
+    if( (tuner != dev->ppm) && (ctl_set_freq_correction( dev, tuner ) == 0) ) {
+        dev->ppm = tuner ;
+        dev->context.ctx_version++ ;
+    }
+    int32_t ppb = (int32_t)lrint( (ppm - dev->ppm) * 1000 );
+    pthread_mutex_unlock( &dev->ctl_lock );
+    __atomic_store_n( &dev->nco_ppb, ppb, __ATOMIC_RELAXED );
+    snprintf( msg, sizeof(msg), "ppm: %.3f measured against %.0f Hz, tuner %d, NCO %.3f",
+              ppm, config.reference_hz, dev->ppm, ppb / 1000.0 );
+    log( est->device_id, 0, msg );
+}
+
+static void* estimator_thread( void *params ) {
+    struct t_ppm_estimator *est = (struct t_ppm_estimator *)params ;
+    struct t_rx_device *dev = est->dev ;
+    int n = config.fft ;
+    double last = NAN ;
+
+    for( ; ; ) {
+        est->fill = 0 ;
+        __atomic_store_n( &est->want, 1, __ATOMIC_RELEASE );
+        sem_wait( &est->full );
+
+        // samples taken under another correction or tuning are of no use
+        pthread_mutex_lock( &dev->ctl_lock );
+        bool current = (est->ctx_version == dev->context.ctx_version) ;
+        int tuner = dev->ppm ;
+        pthread_mutex_unlock( &dev->ctl_lock );
+        if( !current ) {
+            continue ;
+        }
+        if( (est->count == 0) || (est->ctx_version != est->acc_version) ) {
+            memset( est->power, 0, n * sizeof(float));
+            est->count = 0 ;
+            est->acc_version = est->ctx_version ;
+            est->acc_ppm = tuner ;
+        }
+
+        dsp_u8_to_cf32( est->raw, est->work, n );
+        float mean_re = 0, mean_im = 0 ;
+        for( int k=0 ; k < n ; k++ ) {
+            mean_re += est->work[k].re ;
+            mean_im += est->work[k].im ;
+        }
+        mean_re /= n ;
+        mean_im /= n ;
+        for( int k=0 ; k < n ; k++ ) {
+            est->work[k].re = (est->work[k].re - mean_re) * est->window[k] ;
+            est->work[k].im = (est->work[k].im - mean_im) * est->window[k] ;
+        }
+        dsp_fft( est->work, n );
+        for( int k=0 ; k < n ; k++ ) {
+            est->power[k] += est->work[k].re * est->work[k].re + est->work[k].im * est->work[k].im ;
+        }
+        if( ++est->count < config.averages ) {
+            continue ;
+        }
+        est->count = 0 ;
+
+        double expected ;
+        reference_in_band( est->center_freq, est->rate, &expected );
+        double ppm = measure( est, expected );
+        if( isnan(ppm) ) {
+            log_class( est->device_id, 0, LOG_STREAM, (char *)"ppm: reference carrier not found" );
+            sleep(1);
+            continue ;
+        }
+        apply( est, ppm );
+        if( !isnan(last) && (fabs( ppm - last ) < CONVERGED_PPM) ) {
+            sleep( config.period_s );
+        }
+        last = ppm ;
+    }
+    return(NULL);
+}
+
+struct t_ppm_estimator* ppm_estimator_attach( struct t_rx_device *dev, int device_id ) {
+    if( !config.enabled ) {
+        return(NULL);
+    }
+    int n = config.fft ;
+    struct t_ppm_estimator *est = (struct t_ppm_estimator *)calloc( 1, sizeof(struct t_ppm_estimator));
+    if( est == NULL ) {
+        return(NULL);
+    }
+    est->dev = dev ;
+    est->device_id = device_id ;
+    est->raw = (unsigned char *)malloc( 2 * n );
+    est->work = (TYPECPX *)malloc( n * sizeof(TYPECPX));
+    est->window = (float *)malloc( n * sizeof(float));
+    est->power = (float *)calloc( n, sizeof(float));
+    if( (est->raw == NULL) || (est->work == NULL) || (est->window == NULL) || (est->power == NULL) ) {
+        free( est->raw );
+        free( est->work );
+        free( est->window );
+        free( est->power );
+        free( est );
+        return(NULL);
+    }
+    // Hann
+    for( int k=0 ; k < n ; k++ ) {
+        est->window[k] = (float)(0.5 - 0.5 * cos( 2 * M_PI * k / n ));
+    }
+    sem_init( &est->full, 0, 0 );
+    if( pthread_create( &est->thread, NULL, estimator_thread, est ) != 0 ) {
+        free( est->raw );
+        free( est->work );
+        free( est->window );
+        free( est->power );
+        free( est );
+        return(NULL);
+    }
+    pthread_detach( est->thread );
+    return(est);
+}
@@ -0,0 +1,58 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PPM_CORRECTION_H
+#define PPM_CORRECTION_H
+
+#include "rx_device.h"
+
+/*
+ * Crystal correction of the dongles.
+ *
+ *   { "ppm" : { "00000001" : -12, "2" : 31 } }   // by serial or index, or "ppm" : -12 for every dongle
+ *
+ * and an optional estimator measuring the error against a known carrier :
+ *
+ *   { "ppm_estimator" : { "reference_hz" : 162400000, // NOAA weather, GSM BCCH, a beacon...
+ *                         "fft" : 65536,              // bins, a power of 2
+ *                         "averages" : 8,             // power spectra averaged for a measure
+ *                         "max_ppm" : 100,            // search range around the expected bin
+ *                         "period_s" : 60 } }         // between measures once converged
+ *
+ * While the reference falls in the tuned band, not too close to the center, raw blocks are copied
+ * from the sample path and analyzed by a thread of the device. The integer part of the measured
+ * correction goes to the tuner, the fraction to an NCO on the float samples (not on the raw u8
+ * streams).
+ */
+
+struct t_ppm_estimator ;
+
+// correction from the init parameters, 0 if none
+int ppm_configured( struct t_rx_device *dev, int device_id, json_t *root );
+
+void ppm_estimator_setup( json_t *root );
+
+// NULL if disabled
+struct t_ppm_estimator* ppm_estimator_attach( struct t_rx_device *dev, int device_id );
+
+// sample path : copies the transfer when the estimator waits for samples
+void ppm_estimator_feed( struct t_rx_device *dev, const unsigned char *buf, int sample_count );
+
+// sample path : residual correction, dev->nco_ppb
+void ppm_nco( struct t_rx_device *dev, TYPECPX *samples, int sample_count );
+
+#endif // PPM_CORRECTION_H
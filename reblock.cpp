@@ -0,0 +1,148 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "reblock.h"
+#include "backpressure.h"
+
+#define MIN_BLOCK (64)
+#define MAX_BLOCK (1 << 22)
+
+struct t_reblock {
+    int samples ;         // configured size, 0 if ms is used
+    int ms ;
+    int size ;            // current block size
+    unsigned int rate ;   // sample rate size was computed for
+    TYPECPX *pending ;
+    int fill ;
+    struct ext_Context ctx ; // context of the pending samples
+    uint32_t start ;      // stream start of the pending samples
+};
+
+static void parse( json_t *obj, struct t_reblock *rb ) {
+    if( !json_is_object(obj) ) {
+        return ;
+    }
+    json_t *v = json_object_get( obj, "samples" );
+    if( json_is_integer(v) && (json_integer_value(v) >= MIN_BLOCK) && (json_integer_value(v) <= MAX_BLOCK) ) {
+        rb->samples = (int)json_integer_value(v);
+        rb->ms = 0 ;
+    }
+    v = json_object_get( obj, "ms" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 1) ) {
+        rb->ms = (int)json_integer_value(v);
+        rb->samples = 0 ;
+    }
+}
+
+struct t_reblock* reblock_attach( struct t_rx_device *dev, int device_id, json_t *root ) {
+    json_t *conf = json_object_get( root, "push_block" );
+    char index[16] ;
+    if( !json_is_object(conf) ) {
+        return(NULL);
+    }
+    struct t_reblock *rb = (struct t_reblock *)calloc( 1, sizeof(struct t_reblock));
+    if( rb == NULL ) {
+        return(NULL);
+    }
+    parse( conf, rb );
+    json_t *devices = json_object_get( conf, "devices" );
+    if( json_is_object(devices) ) {
+        snprintf( index, sizeof(index), "%d", device_id );
+        json_t *d = json_object_get( devices, dev->device_serial_number );
+        parse( d != NULL ? d : json_object_get( devices, index ), rb );
+    }
+    if( (rb->samples == 0) && (rb->ms == 0) ) {
+        free(rb);
+        return(NULL);
+    }
+    return(rb);
+}
+
+// block size for the current rate
+static void resize( struct t_reblock *rb, unsigned int rate ) {
+    rb->rate = rate ;
+    if( rb->samples > 0 ) {
+        rb->size = rb->samples ;
+        return ;
+    }
+    int64_t size = (int64_t)rate * rb->ms / 1000 ;
+    rb->size = (int)(size < MIN_BLOCK ? MIN_BLOCK : (size > MAX_BLOCK ? MAX_BLOCK : size));
+}
+
+int reblock_room( struct t_rx_device *dev, TYPECPX **out ) {
+    struct t_reblock *rb = dev->reblock ;
+    uint32_t start = __atomic_load_n( &dev->hot->starts, __ATOMIC_RELAXED );
+
+    if( rb->fill > 0 ) {
+        if( start != rb->start ) {
+            // samples of a previous run
+            rb->fill = 0 ;
+        } else if( (dev->context.ctx_version != rb->ctx.ctx_version) || (dev->context.sample_rate != rb->rate) ) {
+            // tuned meanwhile : what we have goes with the old context
+            backpressure_push( dev, rb->pending, rb->fill, &rb->ctx );
+            rb->pending = NULL ;
+            rb->fill = 0 ;
+        }
+    }
+    rb->start = start ;
+    if( rb->fill == 0 ) {
+        rb->ctx = dev->context ;
+    }
+    if( (rb->size == 0) || (rb->rate != dev->context.sample_rate) ) {
+        free( rb->pending );
+        rb->pending = NULL ;
+        resize( rb, dev->context.sample_rate );
+    }
+    if( rb->pending == NULL ) {
+        rb->pending = (TYPECPX *)malloc( rb->size * sizeof(TYPECPX));
+        rb->fill = 0 ;
+        if( rb->pending == NULL ) {
+            return(0);
+        }
+    }
+    *out = rb->pending + rb->fill ;
+    return( rb->size - rb->fill );
+}
+
+void reblock_flush( struct t_rx_device *dev ) {
+    struct t_reblock *rb = dev->reblock ;
+    if( (rb == NULL) || (rb->fill == 0) ) {
+        return ;
+    }
+    if( __atomic_load_n( &dev->hot->starts, __ATOMIC_RELAXED ) != rb->start ) {
+        rb->fill = 0 ;
+        return ;
+    }
+    backpressure_push( dev, rb->pending, rb->fill, &rb->ctx );
+    rb->pending = NULL ;
+    rb->fill = 0 ;
+}
+
+void reblock_commit( struct t_rx_device *dev, int count ) {
+    struct t_reblock *rb = dev->reblock ;
+    rb->fill += count ;
+    if( rb->fill >= rb->size ) {
+        // SDRNode owns it now, or backpressure_push() frees it
+        backpressure_push( dev, rb->pending, rb->fill, &rb->ctx );
+        rb->pending = NULL ;
+        rb->fill = 0 ;
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef REBLOCK_H
+#define REBLOCK_H
+
+#include "rx_device.h"
+
+/*
+ * Push block size : the samples of the USB transfers are converted into blocks of a fixed size
+ * before being pushed to SDRNode, whatever buf_len is.
+ *
+ *   { "push_block" : { "samples" : 8192,              // fixed size...
+ *                      "ms" : 10,                     // ...or duration, follows the sample rate
+ *                      "devices" : { "00000001" : { "ms" : 2 } } } } // by serial or index
+ *
+ * Small transfers are coalesced (fewer calls at low rates), large ones are split and each part is
+ * pushed as soon as it is converted (lower latency at high rates). A partial block is pushed early
+ * when the context changes (frequency, rate) and dropped when the stream is restarted.
+ */
+
+struct t_reblock ;
+
+// per device state, NULL if disabled : each transfer is pushed as one block
+struct t_reblock* reblock_attach( struct t_rx_device *dev, int device_id, json_t *root );
+
+// room left in the block being filled and where to write, 0 if no memory
+int reblock_room( struct t_rx_device *dev, TYPECPX **out );
+
+// count samples were written where reblock_room() said : the block is pushed once full
+void reblock_commit( struct t_rx_device *dev, int count );
+
+// pushes the partial block now, before the context changes
+void reblock_flush( struct t_rx_device *dev );
+
+#endif // REBLOCK_H
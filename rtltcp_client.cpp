@@ -0,0 +1,523 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "rtltcp_client.h"
+
+// gain tables from librtlsdr (tuner_*.c), in tenth of dB
+static const int e4k_gains[] = { -10, 15, 40, 65, 90, 115, 140, 165, 190, 215, 240, 290, 340, 420 };
+static const int fc0012_gains[] = { -99, -40, 71, 179, 192 };
+static const int fc0013_gains[] = { -99, -73, -65, -63, -60, -58, -54, 58, 61, 63, 65, 67, 68, 70, 71,
+                                    179, 181, 182, 184, 186, 188, 191, 197 };
+static const int fc2580_gains[] = { 0 };
+static const int r82xx_gains[] = { 0, 9, 14, 27, 37, 77, 87, 125, 144, 157, 166, 197, 207, 229, 254,
+                                   280, 297, 328, 338, 364, 372, 386, 402, 421, 434, 439, 445, 480, 496 };
+static const int unknown_gains[] = { 0 };
+
+#define TABLE_LEN(t) ((int)(sizeof(t)/sizeof(t[0])))
+
+/**
+ * @brief rtltcp_tuner_gains same semantic as rtlsdr_get_tuner_gains() : returns the gain count and
+ *        fills the table if gains is not NULL
+ * @param type
+ * @param gains
+ * @return
+ */
+int rtltcp_tuner_gains( enum rtlsdr_tuner type, int *gains ) {
+    const int *table ;
+    int len ;
+    switch( type ) {
+    case RTLSDR_TUNER_E4000:  table = e4k_gains ;    len = TABLE_LEN(e4k_gains); break ;
+    case RTLSDR_TUNER_FC0012: table = fc0012_gains ; len = TABLE_LEN(fc0012_gains); break ;
+    case RTLSDR_TUNER_FC0013: table = fc0013_gains ; len = TABLE_LEN(fc0013_gains); break ;
+    case RTLSDR_TUNER_FC2580: table = fc2580_gains ; len = TABLE_LEN(fc2580_gains); break ;
+    case RTLSDR_TUNER_R820T:
+    case RTLSDR_TUNER_R828D:  table = r82xx_gains ;  len = TABLE_LEN(r82xx_gains); break ;
+    default:                  table = unknown_gains ; len = TABLE_LEN(unknown_gains); break ;
+    }
+    if( gains != NULL ) {
+        memcpy( gains, table, len * sizeof(int));
+    }
+    return( len );
+}
+
+#ifndef _WIN64
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define CONNECT_TIMEOUT_MS (3000)
+#define POLL_PERIOD_MS (100)
+
+struct t_rtltcp_client {
+    char host[256] ;
+    int port ;
+    int rcvbuf_size ;
+
+    int sock ;
+    pthread_mutex_t lock ; // serializes commands and (re)connections
+
+    enum rtlsdr_tuner tuner_type ;
+
+    // rtl_tcp has no getter, we keep what has been sent to replay it after a reconnection
+    uint32_t center_freq ;
+    uint32_t sample_rate ;
+    int gain_mode ;
+    int gain ;
+    int agc_mode ;
+    int ppm ;
+
+    volatile bool cancel ;
+    unsigned char *buffer ; // allocated once, reused for every block
+    uint32_t buffer_len ;
+};
+
+static struct t_rtltcp_client* client( struct t_rx_device *dev ) {
+    return( (struct t_rtltcp_client *)dev->backend_ctx );
+}
+
+// rtl_tcp header : "RTL0" + tuner type + gain count, big endian. The gains come from the tuner type
+static int read_header( struct t_rtltcp_client *c ) {
+    unsigned char header[12] ;
+    int got = 0 ;
+    struct pollfd pfd ;
+    pfd.fd = c->sock ;
+    pfd.events = POLLIN ;
+    while( got < 12 ) {
+        if( poll( &pfd, 1, CONNECT_TIMEOUT_MS ) <= 0 ) {
+            return(-1);
+        }
+        ssize_t n = recv( c->sock, header + got, 12 - got, 0 );
+        if( n <= 0 ) {
+            if( (n < 0) && ((errno == EAGAIN) || (errno == EINTR)) ) continue ;
+            return(-1);
+        }
+        got += n ;
+    }
+    if( memcmp( header, "RTL0", 4 ) != 0 ) {
+        return(-1);
+    }
+    c->tuner_type = (enum rtlsdr_tuner)((header[4]<<24) | (header[5]<<16) | (header[6]<<8) | header[7]);
+    return(0);
+}
+
+static int send_command_locked( struct t_rtltcp_client *c, unsigned char cmd, uint32_t param ) {
+    unsigned char frame[5] ;
+    int sent = 0 ;
+    struct pollfd pfd ;
+
+    if( c->sock < 0 ) {
+        return(-1);
+    }
+    frame[0] = cmd ;
+    frame[1] = (param >> 24) & 0xff ;
+    frame[2] = (param >> 16) & 0xff ;
+    frame[3] = (param >>  8) & 0xff ;
+    frame[4] = param & 0xff ;
+
+    pfd.fd = c->sock ;
+    pfd.events = POLLOUT ;
+    while( sent < 5 ) {
+        ssize_t n = send( c->sock, frame + sent, 5 - sent, MSG_NOSIGNAL );
+        if( n < 0 ) {
+            if( (errno == EAGAIN) || (errno == EINTR) ) {
+                if( poll( &pfd, 1, CONNECT_TIMEOUT_MS ) <= 0 ) return(-1);
+                continue ;
+            }
+            return(-1);
+        }
+        sent += n ;
+    }
+    return(0);
+}
+
+static int send_command( struct t_rtltcp_client *c, unsigned char cmd, uint32_t param ) {
+    pthread_mutex_lock( &c->lock );
+    int rc = send_command_locked( c, cmd, param );
+    pthread_mutex_unlock( &c->lock );
+    return(rc);
+}
+
+static void disconnect_locked( struct t_rtltcp_client *c ) {
+    if( c->sock >= 0 ) {
+        close( c->sock );
+        c->sock = -1 ;
+    }
+}
+
+/**
+ * @brief connect_locked opens the connection, reads the rtl_tcp header and replays the current settings
+ * @param c
+ * @return 0 if connected
+ */
+static int connect_locked( struct t_rtltcp_client *c ) {
+    struct addrinfo hints, *res, *ai ;
+    char port[16] ;
+
+    if( c->sock >= 0 ) {
+        return(0);
+    }
+    memset( &hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC ;
+    hints.ai_socktype = SOCK_STREAM ;
+    snprintf( port, sizeof(port), "%d", c->port );
+    if( getaddrinfo( c->host, port, &hints, &res ) != 0 ) {
+        return(-1);
+    }
+
+    for( ai = res ; ai != NULL ; ai = ai->ai_next ) {
+        int s = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol );
+        if( s < 0 ) continue ;
+
+        // large receive buffer : we must absorb scheduling hiccups without stalling the server
+        setsockopt( s, SOL_SOCKET, SO_RCVBUF, &c->rcvbuf_size, sizeof(c->rcvbuf_size));
+        int one = 1 ;
+        setsockopt( s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl( s, F_SETFL, fcntl( s, F_GETFL, 0 ) | O_NONBLOCK );
+
+        int rc = connect( s, ai->ai_addr, ai->ai_addrlen );
+        if( (rc < 0) && (errno == EINPROGRESS) ) {
+            struct pollfd pfd ;
+            int err = 0 ;
+            socklen_t len = sizeof(err);
+            pfd.fd = s ;
+            pfd.events = POLLOUT ;
+            rc = -1 ;
+            if( (poll( &pfd, 1, CONNECT_TIMEOUT_MS ) == 1) &&
+                (getsockopt( s, SOL_SOCKET, SO_ERROR, &err, &len ) == 0) && (err == 0) ) {
+                rc = 0 ;
+            }
+        }
+        if( rc == 0 ) {
+            c->sock = s ;
+            break ;
+        }
+        close(s);
+    }
+    freeaddrinfo(res);
+
+    if( c->sock < 0 ) {
+        return(-1);
+    }
+    if( read_header(c) != 0 ) {
+        disconnect_locked(c);
+        return(-1);
+    }
+
+    // replay settings : server may have been restarted
+    if( c->sample_rate > 0 ) send_command_locked( c, RTLTCP_CMD_SET_SAMPLE_RATE, c->sample_rate );
+    if( c->center_freq > 0 ) send_command_locked( c, RTLTCP_CMD_SET_FREQ, c->center_freq );
+    send_command_locked( c, RTLTCP_CMD_SET_AGC_MODE, c->agc_mode );
+    send_command_locked( c, RTLTCP_CMD_SET_GAIN_MODE, c->gain_mode );
+    if( c->gain_mode ) send_command_locked( c, RTLTCP_CMD_SET_GAIN, (uint32_t)c->gain );
+    if( c->ppm != 0 ) send_command_locked( c, RTLTCP_CMD_SET_FREQ_CORR, (uint32_t)c->ppm );
+    return(0);
+}
+
+//-------------------------------------------------------------------
+// backend operations
+//-------------------------------------------------------------------
+static enum rtlsdr_tuner rtltcp_get_tuner_type( struct t_rx_device *dev ) {
+    return( client(dev)->tuner_type );
+}
+
+static int rtltcp_get_tuner_gains( struct t_rx_device *dev, int *gains ) {
+    return( rtltcp_tuner_gains( client(dev)->tuner_type, gains ));
+}
+
+static int rtltcp_set_center_freq( struct t_rx_device *dev, uint32_t freq ) {
+    struct t_rtltcp_client *c = client(dev);
+    c->center_freq = freq ;
+    return( send_command( c, RTLTCP_CMD_SET_FREQ, freq ));
+}
+
+static uint32_t rtltcp_get_center_freq( struct t_rx_device *dev ) {
+    return( client(dev)->center_freq );
+}
+
+static int rtltcp_set_sample_rate( struct t_rx_device *dev, uint32_t rate ) {
+    struct t_rtltcp_client *c = client(dev);
+    c->sample_rate = rate ;
+    return( send_command( c, RTLTCP_CMD_SET_SAMPLE_RATE, rate ));
+}
+
+static uint32_t rtltcp_get_sample_rate( struct t_rx_device *dev ) {
+    return( client(dev)->sample_rate );
+}
+
+static int rtltcp_set_agc_mode( struct t_rx_device *dev, int on ) {
+    struct t_rtltcp_client *c = client(dev);
+    c->agc_mode = on ;
+    return( send_command( c, RTLTCP_CMD_SET_AGC_MODE, on ));
+}
+
+static int rtltcp_set_tuner_gain_mode( struct t_rx_device *dev, int manual ) {
+    struct t_rtltcp_client *c = client(dev);
+    c->gain_mode = manual ;
+    return( send_command( c, RTLTCP_CMD_SET_GAIN_MODE, manual ));
+}
+
+static int rtltcp_set_tuner_gain( struct t_rx_device *dev, int gain ) {
+    struct t_rtltcp_client *c = client(dev);
+    c->gain = gain ;
+    return( send_command( c, RTLTCP_CMD_SET_GAIN, (uint32_t)gain ));
+}
+
+static int rtltcp_get_tuner_gain( struct t_rx_device *dev ) {
+    return( client(dev)->gain );
+}
+
+static int rtltcp_set_freq_correction( struct t_rx_device *dev, int ppm ) {
+    struct t_rtltcp_client *c = client(dev);
+    c->ppm = ppm ;
+    return( send_command( c, RTLTCP_CMD_SET_FREQ_CORR, (uint32_t)ppm ));
+}
+
+/**
+ * @brief rtltcp_reset_buffer drops whatever the server sent while we were not streaming
+ * @param dev
+ * @return
+ */
+static int rtltcp_reset_buffer( struct t_rx_device *dev ) {
+    struct t_rtltcp_client *c = client(dev);
+    unsigned char scratch[16384] ;
+
+    pthread_mutex_lock( &c->lock );
+    c->cancel = false ; // armed : called before read_async(), a cancel from now on stops it
+    if( connect_locked(c) != 0 ) {
+        pthread_mutex_unlock( &c->lock );
+        return(-1);
+    }
+    for( ; ; ) {
+        ssize_t n = recv( c->sock, scratch, sizeof(scratch), MSG_DONTWAIT );
+        if( n > 0 ) continue ;
+        if( (n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ) break ;
+        if( (n < 0) && (errno == EINTR) ) continue ;
+        disconnect_locked(c); // closed by peer
+        break ;
+    }
+    pthread_mutex_unlock( &c->lock );
+    return(0);
+}
+
+/**
+ * @brief rtltcp_read_async same contract as rtlsdr_read_async() : blocks and calls cb with buf_len bytes
+ *        blocks until rtltcp_cancel_async() is called. The socket is non blocking and polled, so cancel
+ *        is honored within POLL_PERIOD_MS
+ * @return 0 if cancelled, -1 if the connection was lost
+ */
+static int rtltcp_read_async( struct t_rx_device *dev, rtlsdr_read_async_cb_t cb, void *ctx,
+                              uint32_t buf_num, uint32_t buf_len ) {
+    struct t_rtltcp_client *c = client(dev);
+    struct pollfd pfd ;
+    uint32_t fill = 0 ;
+    (void)buf_num ;
+
+    pthread_mutex_lock( &c->lock );
+    int rc = connect_locked(c);
+    pfd.fd = c->sock ;
+    pthread_mutex_unlock( &c->lock );
+    if( rc != 0 ) {
+        return(-1);
+    }
+
+    buf_len &= ~1u ; // keep I/Q pairs together
+    if( c->buffer_len != buf_len ) {
+        free( c->buffer );
+        c->buffer = (unsigned char *)malloc( buf_len );
+        c->buffer_len = (c->buffer != NULL) ? buf_len : 0 ;
+        if( c->buffer == NULL ) {
+            return(-1);
+        }
+    }
+
+    pfd.events = POLLIN ;
+    while( c->cancel == false ) {
+        // reset_buffer() or reopen() may have reconnected meanwhile
+        pthread_mutex_lock( &c->lock );
+        int sock = c->sock ;
+        pthread_mutex_unlock( &c->lock );
+        if( sock < 0 ) {
+            break ;
+        }
+        if( sock != pfd.fd ) {
+            pfd.fd = sock ;
+            fill = 0 ; // new stream, keep I/Q pairs aligned
+        }
+        rc = poll( &pfd, 1, POLL_PERIOD_MS );
+        if( rc == 0 ) {
+            continue ;
+        }
+        if( rc < 0 ) {
+            if( errno == EINTR ) continue ;
+            break ;
+        }
+        ssize_t n = recv( pfd.fd, c->buffer + fill, buf_len - fill, 0 );
+        if( n < 0 ) {
+            if( (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) ) continue ;
+            break ;
+        }
+        if( n == 0 ) {
+            break ; // server closed connection
+        }
+        fill += n ;
+        if( fill == buf_len ) {
+            cb( c->buffer, buf_len, ctx );
+            fill = 0 ;
+        }
+    }
+    if( c->cancel ) {
+        return(0);
+    }
+
+    pthread_mutex_lock( &c->lock );
+    if( c->sock == pfd.fd ) {
+        disconnect_locked(c); // not a connection made meanwhile
+    }
+    pthread_mutex_unlock( &c->lock );
+    return(-1);
+}
+
+static int rtltcp_cancel_async( struct t_rx_device *dev ) {
+    client(dev)->cancel = true ;
+    return(0);
+}
+
+// new connection, current settings are replayed by connect_locked()
+static int rtltcp_reopen( struct t_rx_device *dev ) {
+    struct t_rtltcp_client *c = client(dev);
+    pthread_mutex_lock( &c->lock );
+    disconnect_locked(c);
+    int rc = connect_locked(c);
+    pthread_mutex_unlock( &c->lock );
+    return(rc);
+}
+
+const struct t_rx_backend rtltcp_backend = {
+    "rtl_tcp",
+    rtltcp_get_tuner_type,
+    rtltcp_get_tuner_gains,
+    rtltcp_set_center_freq,
+    rtltcp_get_center_freq,
+    rtltcp_set_sample_rate,
+    rtltcp_get_sample_rate,
+    rtltcp_set_agc_mode,
+    rtltcp_set_tuner_gain_mode,
+    rtltcp_set_tuner_gain,
+    rtltcp_get_tuner_gain,
+    rtltcp_reset_buffer,
+    rtltcp_read_async,
+    rtltcp_cancel_async,
+    rtltcp_reopen,
+    rtltcp_set_freq_correction
+};
+
+//-------------------------------------------------------------------
+int rtltcp_count_servers( json_t *root ) {
+    if( root == NULL ) {
+        return(0);
+    }
+    json_t *servers = json_object_get( root, "rtl_tcp" );
+    if( !json_is_array(servers) ) {
+        return(0);
+    }
+    return( (int)json_array_size(servers) );
+}
+
+int rtltcp_open( struct t_rx_device *dev, json_t *root, int index ) {
+    json_t *entry = json_array_get( json_object_get( root, "rtl_tcp" ), index );
+    struct t_rtltcp_client *c ;
+    char msg[512] ;
+
+    if( entry == NULL ) {
+        return(-1);
+    }
+    c = (struct t_rtltcp_client *)calloc( 1, sizeof(struct t_rtltcp_client));
+    if( c == NULL ) {
+        return(-1);
+    }
+    c->sock = -1 ;
+    c->port = RTLTCP_DEFAULT_PORT ;
+    c->rcvbuf_size = RTLTCP_DEFAULT_RCVBUF_KB * 1024 ;
+    c->tuner_type = RTLSDR_TUNER_R820T ; // most common, until the server tells us
+    pthread_mutex_init( &c->lock, NULL );
+
+    if( json_is_string(entry) ) {
+        // "host:port"
+        snprintf( c->host, sizeof(c->host), "%s", json_string_value(entry));
+        char *sep = strrchr( c->host, ':' );
+        if( sep != NULL ) {
+            *sep = 0 ;
+            c->port = atoi( sep + 1 );
+        }
+    } else if( json_is_object(entry) ) {
+        json_t *v = json_object_get( entry, "host" );
+        if( json_is_string(v) ) {
+            snprintf( c->host, sizeof(c->host), "%s", json_string_value(v));
+        }
+        v = json_object_get( entry, "port" );
+        if( json_is_integer(v) ) {
+            c->port = (int)json_integer_value(v);
+        }
+        v = json_object_get( entry, "rcvbuf_kb" );
+        if( json_is_integer(v) ) {
+            c->rcvbuf_size = (int)json_integer_value(v) * 1024 ;
+        }
+    }
+    if( c->host[0] == 0 ) {
+        pthread_mutex_destroy( &c->lock );
+        free(c);
+        return(-1);
+    }
+
+    dev->backend = &rtltcp_backend ;
+    dev->backend_ctx = c ;
+    dev->rtlsdr_device = NULL ;
+    dev->device_serial_number = (char *)malloc( 300 * sizeof(char));
+    snprintf( dev->device_serial_number, 300, "%s:%d", c->host, c->port );
+
+    pthread_mutex_lock( &c->lock );
+    if( connect_locked(c) != 0 ) {
+        snprintf( msg, sizeof(msg), "rtl_tcp server %s not reachable, will retry at start", dev->device_serial_number );
+        log_class( (int)(dev - rx), 0, LOG_NETWORK, msg );
+    }
+    pthread_mutex_unlock( &c->lock );
+    return(0);
+}
+
+#else
+// rtl_tcp backend relies on POSIX sockets, not available in the Windows build
+const struct t_rx_backend rtltcp_backend = { "rtl_tcp" };
+
+int rtltcp_count_servers( json_t *root ) {
+    (void)root ;
+    return(0);
+}
+
+int rtltcp_open( struct t_rx_device *dev, json_t *root, int index ) {
+    (void)dev ; (void)root ; (void)index ;
+    return(-1);
+}
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RTLTCP_CLIENT_H
+#define RTLTCP_CLIENT_H
+
+#include "rx_device.h"
+
+/*
+ * rtl_tcp client backend : remote dongles served by rtl_tcp are exposed as regular boards.
+ * Servers are listed in json_init_params :
+ *
+ *   { "rtl_tcp" : [ "192.168.1.20:1234",
+ *                   { "host" : "pi-roof.local", "port" : 1234, "rcvbuf_kb" : 8192 } ] }
+ */
+
+// rtl_tcp command codes (see rtl_tcp.c)
+#define RTLTCP_CMD_SET_FREQ          (0x01)
+#define RTLTCP_CMD_SET_SAMPLE_RATE   (0x02)
+#define RTLTCP_CMD_SET_GAIN_MODE     (0x03)
+#define RTLTCP_CMD_SET_GAIN          (0x04)
+#define RTLTCP_CMD_SET_FREQ_CORR     (0x05)
+#define RTLTCP_CMD_SET_IF_GAIN       (0x06)
+#define RTLTCP_CMD_SET_TEST_MODE     (0x07)
+#define RTLTCP_CMD_SET_AGC_MODE      (0x08)
+#define RTLTCP_CMD_SET_DIRECT_SAMPL  (0x09)
+#define RTLTCP_CMD_SET_OFFSET_TUNING (0x0a)
+#define RTLTCP_CMD_SET_RTL_XTAL      (0x0b)
+#define RTLTCP_CMD_SET_TUNER_XTAL    (0x0c)
+#define RTLTCP_CMD_SET_GAIN_BY_INDEX (0x0d)
+
+#define RTLTCP_DEFAULT_PORT       (1234)
+#define RTLTCP_DEFAULT_RCVBUF_KB  (4096)
+
+extern const struct t_rx_backend rtltcp_backend ;
+
+// number of rtl_tcp servers declared in the init parameters
+int rtltcp_count_servers( json_t *root );
+
+// attach the index-th declared server to dev. Returns 0 if the board can be exposed
+// (an unreachable server is still exposed, connection is retried at stream start)
+int rtltcp_open( struct t_rx_device *dev, json_t *root, int index );
+
+// gain table (tenth of dB) for a tuner type, as published by librtlsdr
+int rtltcp_tuner_gains( enum rtlsdr_tuner type, int *gains );
+
+#endif // RTLTCP_CLIENT_H
@@ -0,0 +1,442 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "rtltcp_server.h"
+#include "rtltcp_client.h"
+#include "numa_placement.h"
+
+#ifndef _WIN64
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_PORT        (1234)
+#define DEFAULT_MAX_CLIENTS (8)
+#define DEFAULT_RING_KB     (8192)
+#define CLIENT_SNDBUF       (1024*1024)
+#define IDLE_POLL_MS        (500)
+
+struct t_client {
+    int sock ;
+    uint64_t cursor ;       // next ring byte to send to this client
+    unsigned char cmd[5] ;  // partial command being received
+    int cmd_len ;
+    char name[64] ;
+};
+
+struct t_rtltcp_server {
+    struct t_rx_device *dev ;
+    int device_id ;
+    int control ;
+
+    int listen_sock ;
+    int wake_pipe[2] ;
+    pthread_t thread ;
+
+    // single producer ring, shared by all clients
+    unsigned char *ring ;
+    uint64_t ring_size ;     // power of 2
+    uint64_t ring_mask ;
+    uint64_t slow_threshold ;
+    uint64_t head ;          // total bytes written, only grows
+    uint64_t tail ;          // lowest client cursor, published by the server thread
+    int waiting ;            // server thread is sleeping in poll()
+    int stalled ;            // producer skipped a block : the slowest clients must go
+    uint64_t skipped_blocks ;
+
+    // clients, kept in connection order : clients[0] is the oldest
+    struct t_client *clients ;
+    int max_clients ;
+    int client_count ;
+    uint64_t dropped_clients ;
+};
+
+/**
+ * @brief rtltcp_server_publish copies the raw block into the ring and wakes up the server thread
+ *        if it sleeps. Nothing is copied when no client is connected. The bytes between the slowest
+ *        client cursor and head are never overwritten : if the block does not fit, it is skipped and
+ *        the server thread drops the clients holding the ring back
+ * @param srv
+ * @param buf
+ * @param len
+ */
+void rtltcp_server_publish( struct t_rtltcp_server *srv, unsigned char *buf, uint32_t len ) {
+    if( (srv == NULL) || (__atomic_load_n( &srv->client_count, __ATOMIC_RELAXED ) == 0) ) {
+        return ;
+    }
+    if( len > srv->ring_size ) {
+        buf += len - srv->ring_size ;
+        len = srv->ring_size ;
+    }
+    uint64_t head = srv->head ;
+    uint64_t tail = __atomic_load_n( &srv->tail, __ATOMIC_ACQUIRE );
+    if( head + len - tail > srv->ring_size ) {
+        srv->skipped_blocks++ ;
+        __atomic_store_n( &srv->stalled, 1, __ATOMIC_RELEASE );
+    } else {
+        uint64_t off = head & srv->ring_mask ;
+        uint64_t first = srv->ring_size - off ;
+        if( first >= len ) {
+            memcpy( srv->ring + off, buf, len );
+        } else {
+            memcpy( srv->ring + off, buf, first );
+            memcpy( srv->ring, buf + first, len - first );
+        }
+        __atomic_store_n( &srv->head, head + len, __ATOMIC_SEQ_CST );
+    }
+
+    if( __atomic_exchange_n( &srv->waiting, 0, __ATOMIC_SEQ_CST ) ) {
+        char c = 0 ;
+        if( write( srv->wake_pipe[1], &c, 1 ) < 0 ) {
+            // pipe full : thread is already awake
+        }
+    }
+}
+
+static void drop_client( struct t_rtltcp_server *srv, int k, const char *reason ) {
+    char msg[256] ;
+    snprintf( msg, sizeof(msg), "rtl_tcp server: client %s dropped (%s)", srv->clients[k].name, reason );
+    log_class( srv->device_id, 0, LOG_NETWORK, msg );
+
+    close( srv->clients[k].sock );
+    memmove( &srv->clients[k], &srv->clients[k+1], (srv->client_count - k - 1) * sizeof(struct t_client));
+    __atomic_store_n( &srv->client_count, srv->client_count - 1, __ATOMIC_RELAXED );
+    srv->dropped_clients++ ;
+}
+
+/**
+ * @brief update_tail publishes the lowest client cursor. Cursors only grow, so the producer may
+ *        overwrite everything below it even if a client moved on since
+ */
+static void update_tail( struct t_rtltcp_server *srv ) {
+    uint64_t tail = __atomic_load_n( &srv->head, __ATOMIC_ACQUIRE );
+    for( int k=0 ; k < srv->client_count ; k++ ) {
+        if( srv->clients[k].cursor < tail ) {
+            tail = srv->clients[k].cursor ;
+        }
+    }
+    __atomic_store_n( &srv->tail, tail, __ATOMIC_RELEASE );
+}
+
+static void accept_client( struct t_rtltcp_server *srv ) {
+    struct sockaddr_storage addr ;
+    socklen_t len = sizeof(addr);
+    unsigned char header[12] ;
+    char msg[256] ;
+
+    int s = accept( srv->listen_sock, (struct sockaddr *)&addr, &len );
+    if( s < 0 ) {
+        return ;
+    }
+    if( srv->client_count >= srv->max_clients ) {
+        close(s);
+        return ;
+    }
+    int sndbuf = CLIENT_SNDBUF ;
+    int one = 1 ;
+    setsockopt( s, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    setsockopt( s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl( s, F_SETFL, fcntl( s, F_GETFL, 0 ) | O_NONBLOCK );
+
+    // rtl_tcp header : "RTL0" + tuner type + gain count, big endian
+    struct t_rx_device *dev = srv->dev ;
+    pthread_mutex_lock( &dev->ctl_lock );
+    uint32_t tuner = (uint32_t)dev->backend->get_tuner_type( dev );
+    pthread_mutex_unlock( &dev->ctl_lock );
+    uint32_t gains = (uint32_t)dev->gain_size ;
+    memcpy( header, "RTL0", 4 );
+    header[4] = tuner >> 24 ; header[5] = tuner >> 16 ; header[6] = tuner >> 8 ; header[7] = tuner ;
+    header[8] = gains >> 24 ; header[9] = gains >> 16 ; header[10] = gains >> 8 ; header[11] = gains ;
+    if( send( s, header, sizeof(header), MSG_NOSIGNAL ) != (ssize_t)sizeof(header) ) {
+        close(s);
+        return ;
+    }
+
+    struct t_client *c = &srv->clients[srv->client_count] ;
+    memset( c, 0, sizeof(struct t_client));
+    c->sock = s ;
+    c->cursor = __atomic_load_n( &srv->head, __ATOMIC_ACQUIRE ); // live stream, no backlog
+    if( addr.ss_family == AF_INET ) {
+        struct sockaddr_in *in = (struct sockaddr_in *)&addr ;
+        snprintf( c->name, sizeof(c->name), "%s:%d", inet_ntoa( in->sin_addr ), ntohs( in->sin_port ));
+    } else {
+        snprintf( c->name, sizeof(c->name), "#%d", s );
+    }
+    if( srv->client_count == 0 ) {
+        // tail may be stale from the last session : the producer is idle, cursor is the lowest
+        __atomic_store_n( &srv->tail, c->cursor, __ATOMIC_RELEASE );
+    }
+    __atomic_store_n( &srv->client_count, srv->client_count + 1, __ATOMIC_RELAXED );
+
+    snprintf( msg, sizeof(msg), "rtl_tcp server: client %s connected", c->name );
+    log_class( srv->device_id, 0, LOG_NETWORK, msg );
+}
+
+/**
+ * @brief apply_command forwards a client command to the device, through the regular entry points
+ *        so the device state and context stay coherent with what SDRNode sees
+ */
+static void apply_command( struct t_rtltcp_server *srv, unsigned char cmd, uint32_t param ) {
+    struct t_rx_device *dev = srv->dev ;
+    switch( cmd ) {
+    case RTLTCP_CMD_SET_FREQ:
+        setRxCenterFreq( srv->device_id, (int64_t)param );
+        break ;
+    case RTLTCP_CMD_SET_SAMPLE_RATE:
+        setRxSampleRate( srv->device_id, (int)param );
+        break ;
+    case RTLTCP_CMD_SET_GAIN_MODE:
+        pthread_mutex_lock( &dev->ctl_lock );
+        ctl_set_gain_mode( dev, (int)param );
+        pthread_mutex_unlock( &dev->ctl_lock );
+        break ;
+    case RTLTCP_CMD_SET_GAIN:
+        setRxGain( srv->device_id, 0, (int)param / 10.0f );
+        break ;
+    case RTLTCP_CMD_SET_AGC_MODE:
+        pthread_mutex_lock( &dev->ctl_lock );
+        ctl_set_agc_mode( dev, (int)param );
+        pthread_mutex_unlock( &dev->ctl_lock );
+        break ;
+    default:
+        break ; // not supported
+    }
+}
+
+// returns false if the client must be dropped
+static bool read_commands( struct t_rtltcp_server *srv, int k ) {
+    struct t_client *c = &srv->clients[k] ;
+    for( ; ; ) {
+        ssize_t n = recv( c->sock, c->cmd + c->cmd_len, 5 - c->cmd_len, 0 );
+        if( n == 0 ) {
+            return(false);
+        }
+        if( n < 0 ) {
+            return( (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) );
+        }
+        c->cmd_len += n ;
+        if( c->cmd_len < 5 ) {
+            continue ;
+        }
+        c->cmd_len = 0 ;
+        bool allowed = (srv->control == RTLTCP_CONTROL_ALL) ||
+                       ((srv->control == RTLTCP_CONTROL_FIRST) && (k == 0));
+        if( allowed ) {
+            uint32_t param = ((uint32_t)c->cmd[1]<<24) | (c->cmd[2]<<16) | (c->cmd[3]<<8) | c->cmd[4] ;
+            apply_command( srv, c->cmd[0], param );
+        }
+    }
+}
+
+/**
+ * @brief send_pending sends straight from the shared ring. A client lagging by more than the slow
+ *        threshold is dropped, so the producer never waits for anybody. The producer does not write
+ *        below the published tail, so the bytes handed to send() are stable
+ * @return false if the client must be dropped
+ */
+static bool send_pending( struct t_rtltcp_server *srv, int k, const char **reason ) {
+    struct t_client *c = &srv->clients[k] ;
+    uint64_t head = __atomic_load_n( &srv->head, __ATOMIC_ACQUIRE );
+    uint64_t start = c->cursor ;
+
+    if( head - start > srv->slow_threshold ) {
+        *reason = "too slow" ;
+        return(false);
+    }
+    while( c->cursor < head ) {
+        uint64_t off = c->cursor & srv->ring_mask ;
+        uint64_t n = head - c->cursor ;
+        if( n > srv->ring_size - off ) {
+            n = srv->ring_size - off ;
+        }
+        ssize_t sent = send( c->sock, srv->ring + off, n, MSG_DONTWAIT | MSG_NOSIGNAL );
+        if( sent < 0 ) {
+            if( (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) ) break ;
+            *reason = "connection lost" ;
+            return(false);
+        }
+        c->cursor += sent ;
+    }
+    return(true);
+}
+
+static void* server_thread( void *params ) {
+    struct t_rtltcp_server *srv = (struct t_rtltcp_server *)params ;
+    struct pollfd *pfd = (struct pollfd *)malloc( (srv->max_clients + 2) * sizeof(struct pollfd));
+    const char *reason ;
+    char scratch[64] ;
+
+    for( ; ; ) {
+        __atomic_store_n( &srv->waiting, 1, __ATOMIC_SEQ_CST );
+        uint64_t head = __atomic_load_n( &srv->head, __ATOMIC_SEQ_CST );
+
+        pfd[0].fd = srv->listen_sock ;
+        pfd[0].events = POLLIN ;
+        pfd[1].fd = srv->wake_pipe[0] ;
+        pfd[1].events = POLLIN ;
+        int n = srv->client_count ;
+        for( int k=0 ; k < n ; k++ ) {
+            pfd[k+2].fd = srv->clients[k].sock ;
+            pfd[k+2].events = POLLIN | ((srv->clients[k].cursor < head) ? POLLOUT : 0) ;
+        }
+        int rc = poll( pfd, n + 2, IDLE_POLL_MS );
+        __atomic_store_n( &srv->waiting, 0, __ATOMIC_SEQ_CST );
+        if( rc < 0 ) {
+            if( errno == EINTR ) continue ;
+            break ;
+        }
+        if( pfd[1].revents & POLLIN ) {
+            while( read( srv->wake_pipe[0], scratch, sizeof(scratch)) == (ssize_t)sizeof(scratch) ) ;
+        }
+
+        // the producer had to skip a block : drop the clients holding the tail
+        if( __atomic_exchange_n( &srv->stalled, 0, __ATOMIC_ACQ_REL ) ) {
+            uint64_t tail = __atomic_load_n( &srv->tail, __ATOMIC_ACQUIRE );
+            for( int k=n-1 ; k >= 0 ; k-- ) {
+                if( srv->clients[k].cursor == tail ) {
+                    drop_client( srv, k, "too slow" );
+                    memmove( &pfd[k+2], &pfd[k+3], (n - k - 1) * sizeof(struct pollfd));
+                    n-- ;
+                }
+            }
+        }
+
+        // walk backwards : dropping a client shifts the ones after it
+        for( int k=n-1 ; k >= 0 ; k-- ) {
+            short ev = pfd[k+2].revents ;
+            if( ev & (POLLERR | POLLHUP | POLLNVAL) ) {
+                drop_client( srv, k, "connection closed" );
+                continue ;
+            }
+            if( (ev & POLLIN) && !read_commands( srv, k )) {
+                drop_client( srv, k, "connection closed" );
+                continue ;
+            }
+            if( !send_pending( srv, k, &reason )) {
+                drop_client( srv, k, reason );
+            }
+        }
+
+        update_tail( srv );
+
+        if( pfd[0].revents & POLLIN ) {
+            accept_client( srv );
+        }
+    }
+    free(pfd);
+    return(NULL);
+}
+
+struct t_rtltcp_server* rtltcp_server_start( struct t_rx_device *dev, int device_id, json_t *root ) {
+    json_t *conf = json_object_get( root, "rtl_tcp_server" );
+    struct t_rtltcp_server *srv ;
+    struct sockaddr_in addr ;
+    const char *bind_addr = "0.0.0.0" ;
+    int port = DEFAULT_PORT ;
+    int ring_kb = DEFAULT_RING_KB ;
+    char msg[256] ;
+
+    if( !json_is_object(conf) ) {
+        return(NULL);
+    }
+    srv = (struct t_rtltcp_server *)calloc( 1, sizeof(struct t_rtltcp_server));
+    if( srv == NULL ) {
+        return(NULL);
+    }
+    srv->dev = dev ;
+    srv->device_id = device_id ;
+    srv->max_clients = DEFAULT_MAX_CLIENTS ;
+    srv->control = RTLTCP_CONTROL_NONE ;
+
+    json_t *v = json_object_get( conf, "port" );
+    if( json_is_integer(v) ) port = (int)json_integer_value(v);
+    v = json_object_get( conf, "bind" );
+    if( json_is_string(v) ) bind_addr = json_string_value(v);
+    v = json_object_get( conf, "max_clients" );
+    if( json_is_integer(v) && (json_integer_value(v) > 0) ) srv->max_clients = (int)json_integer_value(v);
+    v = json_object_get( conf, "ring_kb" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 256) ) ring_kb = (int)json_integer_value(v);
+    v = json_object_get( conf, "control" );
+    if( json_is_string(v) ) {
+        if( strcmp( json_string_value(v), "first" ) == 0 ) srv->control = RTLTCP_CONTROL_FIRST ;
+        if( strcmp( json_string_value(v), "all" ) == 0 ) srv->control = RTLTCP_CONTROL_ALL ;
+    }
+
+    // round ring up to a power of 2, so positions wrap with a mask
+    srv->ring_size = 1 ;
+    while( srv->ring_size < (uint64_t)ring_kb * 1024 ) {
+        srv->ring_size <<= 1 ;
+    }
+    srv->ring_mask = srv->ring_size - 1 ;
+    srv->slow_threshold = srv->ring_size / 4 * 3 ;
+    srv->ring = (unsigned char *)numa_buffer_alloc( srv->ring_size, dev->numa_node );
+    srv->clients = (struct t_client *)calloc( srv->max_clients, sizeof(struct t_client));
+    if( (srv->ring == NULL) || (srv->clients == NULL) || (pipe( srv->wake_pipe ) != 0) ) {
+        numa_buffer_free( srv->ring, srv->ring_size );
+        free( srv->clients );
+        free( srv );
+        return(NULL);
+    }
+    thread_tuning_lock_buffer( srv->ring, srv->ring_size );
+    fcntl( srv->wake_pipe[0], F_SETFL, O_NONBLOCK );
+    fcntl( srv->wake_pipe[1], F_SETFL, O_NONBLOCK );
+
+    srv->listen_sock = socket( AF_INET, SOCK_STREAM, 0 );
+    int one = 1 ;
+    setsockopt( srv->listen_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset( &addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET ;
+    addr.sin_port = htons( port + device_id );
+    addr.sin_addr.s_addr = inet_addr( bind_addr );
+    if( (bind( srv->listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+        (listen( srv->listen_sock, 4 ) != 0) ) {
+        snprintf( msg, sizeof(msg), "rtl_tcp server: cannot listen on %s:%d", bind_addr, port + device_id );
+        log( device_id, 0, msg );
+        close( srv->listen_sock );
+        close( srv->wake_pipe[0] );
+        close( srv->wake_pipe[1] );
+        numa_buffer_free( srv->ring, srv->ring_size );
+        free( srv->clients );
+        free( srv );
+        return(NULL);
+    }
+    fcntl( srv->listen_sock, F_SETFL, fcntl( srv->listen_sock, F_GETFL, 0 ) | O_NONBLOCK );
+
+    pthread_create( &srv->thread, NULL, server_thread, srv );
+    snprintf( msg, sizeof(msg), "rtl_tcp server listening on %s:%d", bind_addr, port + device_id );
+    log( device_id, 0, msg );
+    return(srv);
+}
+
+#else
+// embedded server relies on POSIX sockets, not available in the Windows build
+struct t_rtltcp_server* rtltcp_server_start( struct t_rx_device *dev, int device_id, json_t *root ) {
+    return(NULL);
+}
+
+void rtltcp_server_publish( struct t_rtltcp_server *srv, unsigned char *buf, uint32_t len ) {
+}
+#endif
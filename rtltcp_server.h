@@ -0,0 +1,49 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RTLTCP_SERVER_H
+#define RTLTCP_SERVER_H
+
+#include "rx_device.h"
+
+/*
+ * Embedded rtl_tcp server : shares the raw u8 stream of a device with any number of rtl_tcp clients.
+ * One thread per device, one ring per device, each client only owns a read cursor in the ring.
+ * Enabled from json_init_params :
+ *
+ *   { "rtl_tcp_server" : { "port" : 1234,          // device n listens on port+n
+ *                          "bind" : "0.0.0.0",
+ *                          "max_clients" : 8,
+ *                          "ring_kb" : 8192,
+ *                          "control" : "none" } }  // none | first | all
+ *
+ * Data flows while the device is streaming for SDRNode.
+ */
+
+#define RTLTCP_CONTROL_NONE  (0) // clients cannot change the device settings
+#define RTLTCP_CONTROL_FIRST (1) // only the oldest connected client can
+#define RTLTCP_CONTROL_ALL   (2) // every client can
+
+struct t_rtltcp_server ;
+
+// starts the server thread for the device if enabled in the init parameters, NULL otherwise
+struct t_rtltcp_server* rtltcp_server_start( struct t_rx_device *dev, int device_id, json_t *root );
+
+// called from the sample path with the raw u8 block, never blocks
+void rtltcp_server_publish( struct t_rtltcp_server *srv, unsigned char *buf, uint32_t len );
+
+#endif // RTLTCP_SERVER_H
@@ -0,0 +1,206 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RX_DEVICE_H
+#define RX_DEVICE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <rtl-sdr.h>
+
+#include "jansson/jansson.h"
+#include "entrypoint.h"
+#include "thread_tuning.h"
+#include "log_queue.h"
+#include "ctl_cache.h"
+
+struct t_rtltcp_server ;
+struct t_shm_ring ;
+struct t_udp_stream ;
+struct t_stream_queue ;
+struct t_watchdog ;
+struct t_backpressure ;
+struct t_reblock ;
+struct t_latency ;
+struct t_hop_schedule ;
+struct t_ppm_estimator ;
+
+#define DEBUG_DRIVER (0)
+#define EARLY_LOG_SIZE (16)
+#define CACHE_LINE_SIZE (64)
+
+typedef struct __attribute__ ((__packed__)) _sCplx
+{
+    float re;
+    float im;
+} TYPECPX;
+
+struct t_sample_rates {
+    unsigned int *sample_rates ;
+    int enum_length ;
+    int preffered_sr_index ;
+};
+
+struct t_rx_device ;
+
+// IQ imbalance correction, Q' = cq * Q + ci * I. The conversion kernels add the moments of the
+// samples they correct to the sums, iq_balance_update() turns them into the next coefficients
+struct t_iq_balance {
+    float ci ;
+    float cq ;
+    double si, sq, sii, sqq, siq ; // sums of I, Q, I*I, Q*Q, I*Q
+    uint32_t count ;               // samples in the sums
+    double ii, qq, iq ;            // smoothed covariance
+    uint32_t blocks ;              // estimates made since enabled
+    float gain_db ;                // Q amplitude relative to I
+    float phase_deg ;              // I/Q skew from quadrature
+    uint32_t seq ;                 // dev->iq_balance_seq the state was reset for
+};
+
+// state written by the sample path or used to start and stop it. Allocated apart from rx[], on the
+// device node and cache line aligned, so callbacks of devices running on different cores never write
+// to a shared line. Flags are accessed with the __atomic builtins
+struct t_rx_hot {
+    TYPECPX xn_1 ;          // DC removal
+    TYPECPX yn_1 ;
+    int state ;             // RX_STOPPED... samples are pushed in RX_STREAMING only
+    int running ;           // acquisition thread is inside read_async
+    int64_t idle_since ;    // ms, when finalizeRXEngine() put the stream in warm idle
+    int64_t last_block_ms ; // ms, last transfer received (stall watchdog)
+    uint32_t starts ;       // prepareRXEngine() calls, samples of a previous run are not pushed
+    // counters, read by the metrics endpoint
+    uint64_t received ;     // samples of the transfers processed
+    uint64_t clipped ;      // of which I or Q at 0 or 255 (metrics enabled only)
+    uint64_t pushed ;       // samples accepted by SDRNode
+    uint64_t push_blocks ;
+    uint64_t callback_ticks ; // time in rtlsdr_callback, latency_now() ticks (metrics or histograms enabled)
+    // residual crystal correction, see ppm_nco()
+    TYPECPX nco ;
+    TYPECPX nco_step ;
+    int32_t nco_ppb ;       // correction nco_step was computed for
+    int64_t nco_freq ;
+    uint32_t nco_rate ;
+    struct t_iq_balance iq ; // if dev->iq_balance
+    sem_t mutex ;           // posted by prepareRXEngine()
+} __attribute__ ((aligned (CACHE_LINE_SIZE)));
+
+#define RX_STOPPED   (0) // acquisition thread waits for prepareRXEngine()
+#define RX_STREAMING (1) // samples are pushed to SDRNode
+#define RX_IDLE      (2) // warm idle : USB transfers keep running, nothing is pushed
+#define RX_STOPPING  (3) // cancel_async requested
+
+// operations a device backend must provide. The signatures follow the librtlsdr API
+// so the local USB backend is a thin wrapper and remote backends (rtl_tcp...) look the same
+// to the rest of the driver. Functions return 0 on success, like librtlsdr does.
+struct t_rx_backend {
+    const char *name ;
+    enum rtlsdr_tuner (*get_tuner_type)( struct t_rx_device *dev );
+    int      (*get_tuner_gains)( struct t_rx_device *dev, int *gains );
+    int      (*set_center_freq)( struct t_rx_device *dev, uint32_t freq );
+    uint32_t (*get_center_freq)( struct t_rx_device *dev );
+    int      (*set_sample_rate)( struct t_rx_device *dev, uint32_t rate );
+    uint32_t (*get_sample_rate)( struct t_rx_device *dev );
+    int      (*set_agc_mode)( struct t_rx_device *dev, int on );
+    int      (*set_tuner_gain_mode)( struct t_rx_device *dev, int manual );
+    int      (*set_tuner_gain)( struct t_rx_device *dev, int gain );
+    int      (*get_tuner_gain)( struct t_rx_device *dev );
+    int      (*reset_buffer)( struct t_rx_device *dev );
+    int      (*read_async)( struct t_rx_device *dev, rtlsdr_read_async_cb_t cb, void *ctx,
+                            uint32_t buf_num, uint32_t buf_len );
+    int      (*cancel_async)( struct t_rx_device *dev );
+    int      (*reopen)( struct t_rx_device *dev );     // after a stall, settings are restored by the caller
+    int      (*set_freq_correction)( struct t_rx_device *dev, int ppm );
+};
+
+// this structure stores the device state
+struct t_rx_device {
+
+    const struct t_rx_backend *backend ;
+    rtlsdr_dev_t *rtlsdr_device ; // local USB dongles
+    int usb_index ;               // librtlsdr index of a local dongle, as last enumerated. -1 for remote ones
+    int present ;                 // 0 while a hot-plugged dongle is unplugged, its slot is kept
+    int resume ;                  // was streaming when unplugged
+    void *backend_ctx ;           // backend private data (remote dongles)
+    char *device_name ;
+    char *device_serial_number ;
+
+    struct t_sample_rates* rates;
+    int current_sample_rate ;
+
+    int64_t min_frq_hz ; // minimal frequency for this device
+    int64_t max_frq_hz ; // maximal frequency for this device
+    int64_t center_frq_hz ; // currently set frequency
+
+
+    float gain ;
+    float gain_min ;
+    float gain_max ;
+    int gain_size ;
+    int *gain_values;
+    int ppm ;       // crystal correction applied by the tuner
+    int32_t nco_ppb ; // remaining fraction, ppb, applied on the float samples (atomic)
+    int dc_block ;  // DC removal in the sample path, on by default
+    int iq_balance ; // IQ imbalance correction in the sample path, off by default
+    uint32_t iq_balance_seq ; // changed with iq_balance : the sample path restarts the estimate
+
+    char *uuid ;
+    struct t_rx_hot *hot ;
+    pthread_mutex_t ctl_lock ;           // device settings vs watchdog reopen
+    struct t_ctl_cache ctl ;             // settings written to the device, under ctl_lock
+    pthread_t receive_thread ;
+    struct t_thread_settings acq_settings ;
+    int numa_node ;                      // node of the USB controller, -1 if unknown
+
+    struct ext_Context context ;
+
+    struct t_rtltcp_server *tcp_server ; // embedded rtl_tcp server, NULL if disabled
+    struct t_shm_ring *shm ;             // shared memory transport, NULL if disabled
+    struct t_udp_stream *multicast ;     // UDP multicast sender, NULL if disabled
+    struct t_stream_queue *queue ;       // shared streaming engine, NULL in per device mode
+    struct t_watchdog *watchdog ;        // stall watchdog, NULL if disabled
+    struct t_backpressure *backpressure ; // push policy, NULL : push as it comes
+    struct t_reblock *reblock ;          // push block size, NULL : one block per transfer
+    struct t_latency *latency ;          // latency histograms, NULL if disabled
+    struct t_hop_schedule *hop ;         // frequency hopping, NULL until a schedule is loaded
+    struct t_ppm_estimator *ppm_estimator ; // crystal offset measure, NULL if disabled
+
+    // messages logged before SDRNode gave us the uuid, flushed by setBoardUUID()
+    char *early_log[EARLY_LOG_SIZE] ;
+    int early_log_level[EARLY_LOG_SIZE] ;
+    int early_log_count ;
+};
+
+extern int device_count ;
+extern int rx_capacity ;             // slots allocated in rx[], device_count <= rx_capacity
+extern struct t_rx_device *rx;
+extern json_t *root_json ;
+extern _pushSamplesFun *acqCbFunction ;
+
+extern const struct t_rx_backend usb_backend ;
+
+void log( int device_id, int level, char *msg ) ;
+void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx) ;
+bool rx_stream_gated( struct t_rx_device *dev ) ;
+int rx_device_setup( int d, int usb_index, int remote_index ) ;
+void rx_device_restore( struct t_rx_device *dev ) ;
+int64_t rx_now_ms() ;
+int64_t rx_now_us() ;
+
+#endif // RX_DEVICE_H
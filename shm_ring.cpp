@@ -0,0 +1,190 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "shm_ring.h"
+#include "numa_placement.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define DEFAULT_SIZE_KB (16384)
+
+struct t_shm_ring {
+    struct shm_ring_header *hdr ;
+    unsigned char *data ;
+    size_t map_size ;
+    uint64_t mask ;
+    int format ;
+    uint64_t seq ;
+    uint64_t sample_index ;
+};
+
+/**
+ * @brief shm_ring_publish appends one record. The record is reserved first (reserve_pos) so readers
+ *        working in place can detect that it overwrites them, then committed (write_pos). Readers
+ *        are woken up through the futex only if some of them sleep
+ */
+void shm_ring_publish( struct t_shm_ring *ring, int format, const void *payload, uint32_t bytes,
+                       uint32_t sample_count, struct ext_Context *ctx ) {
+    if( (ring == NULL) || (ring->format != format) ) {
+        return ;
+    }
+    struct shm_ring_header *hdr = ring->hdr ;
+    uint64_t need = sizeof(struct shm_block_header) + SHM_ALIGN8(bytes) ;
+    if( need > hdr->data_size / 2 ) {
+        ring->seq++ ; // cannot fit, readers see the gap
+        ring->sample_index += sample_count ;
+        return ;
+    }
+
+    uint64_t pos = hdr->write_pos ;
+    uint64_t off = pos & ring->mask ;
+    uint64_t left = hdr->data_size - off ;
+    if( left < need ) {
+        // skip to the start of the data area
+        __atomic_store_n( &hdr->reserve_pos, pos + left + need, __ATOMIC_RELEASE );
+        if( left >= sizeof(struct shm_block_header) ) {
+            struct shm_block_header *pad = (struct shm_block_header *)(ring->data + off);
+            pad->flags = SHM_BLOCK_PAD ;
+            pad->length = 0 ;
+        }
+        pos += left ;
+        off = 0 ;
+    } else {
+        __atomic_store_n( &hdr->reserve_pos, pos + need, __ATOMIC_RELEASE );
+    }
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+    struct shm_block_header *b = (struct shm_block_header *)(ring->data + off);
+    b->flags = 0 ;
+    b->length = bytes ;
+    b->seq = ring->seq++ ;
+    b->sample_index = ring->sample_index ;
+    b->ctx_version = ctx->ctx_version ;
+    b->center_freq = ctx->center_freq ;
+    b->sample_rate = ctx->sample_rate ;
+    b->sample_count = sample_count ;
+    memcpy( b + 1, payload, bytes );
+    ring->sample_index += sample_count ;
+
+    __atomic_store_n( &hdr->last_block_pos, pos, __ATOMIC_RELAXED );
+    __atomic_store_n( &hdr->write_pos, pos + need, __ATOMIC_RELEASE );
+    __atomic_add_fetch( &hdr->futex, 1, __ATOMIC_SEQ_CST );
+    if( __atomic_load_n( &hdr->waiters, __ATOMIC_SEQ_CST ) > 0 ) {
+        syscall( SYS_futex, &hdr->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+    }
+}
+
+int shm_ring_format( struct t_shm_ring *ring ) {
+    return( ring != NULL ? ring->format : -1 );
+}
+
+struct t_shm_ring* shm_ring_start( struct t_rx_device *dev, int device_id, json_t *root ) {
+    json_t *conf = json_object_get( root, "shm" );
+    struct t_shm_ring *ring ;
+    uint64_t data_size = 1 ;
+    int size_kb = DEFAULT_SIZE_KB ;
+    char name[128] ;
+    char msg[256] ;
+
+    if( !json_is_object(conf) ) {
+        return(NULL);
+    }
+    ring = (struct t_shm_ring *)calloc( 1, sizeof(struct t_shm_ring));
+    if( ring == NULL ) {
+        return(NULL);
+    }
+    ring->format = SHM_FORMAT_CF32 ;
+    json_t *v = json_object_get( conf, "format" );
+    if( json_is_string(v) && (strcmp( json_string_value(v), "u8" ) == 0) ) {
+        ring->format = SHM_FORMAT_U8 ;
+    }
+    v = json_object_get( conf, "size_kb" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 256) ) {
+        size_kb = (int)json_integer_value(v);
+    }
+    while( data_size < (uint64_t)size_kb * 1024 ) {
+        data_size <<= 1 ;
+    }
+
+    // name from the serial, '/' is not allowed after the leading one
+    snprintf( name, sizeof(name), "/cloudsdr_rtlsdr_%s", dev->device_serial_number );
+    for( char *p = name + 1 ; *p ; p++ ) {
+        if( (*p == '/') || (*p == ':') ) *p = '_' ;
+    }
+
+    size_t header_size = 4096 ;
+    ring->map_size = header_size + data_size ;
+    shm_unlink( name ); // stale ring from a previous run
+    int fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL, 0644 );
+    if( (fd < 0) || (ftruncate( fd, ring->map_size ) != 0) ) {
+        snprintf( msg, sizeof(msg), "shm: cannot create %s", name );
+        log( device_id, 0, msg );
+        if( fd >= 0 ) close(fd);
+        free(ring);
+        return(NULL);
+    }
+    void *p = mmap( NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close(fd);
+    if( p == MAP_FAILED ) {
+        shm_unlink( name );
+        free(ring);
+        return(NULL);
+    }
+
+    numa_bind_range( p, ring->map_size, dev->numa_node ); // before the first touch
+    thread_tuning_lock_buffer( p, ring->map_size );
+    ring->hdr = (struct shm_ring_header *)p ;
+    ring->data = (unsigned char *)p + header_size ;
+    ring->mask = data_size - 1 ;
+    memset( ring->hdr, 0, sizeof(struct shm_ring_header));
+    ring->hdr->version = SHM_RING_VERSION ;
+    ring->hdr->format = ring->format ;
+    ring->hdr->header_size = header_size ;
+    ring->hdr->data_size = data_size ;
+    __atomic_store_n( &ring->hdr->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE );
+
+    snprintf( msg, sizeof(msg), "shm: publishing %s samples in %s (%d KB)",
+              ring->format == SHM_FORMAT_U8 ? "u8" : "cf32", name, (int)(data_size/1024) );
+    log( device_id, 0, msg );
+    return(ring);
+}
+
+#else
+// shared memory transport relies on Linux futexes
+struct t_shm_ring* shm_ring_start( struct t_rx_device *dev, int device_id, json_t *root ) {
+    return(NULL);
+}
+
+void shm_ring_publish( struct t_shm_ring *ring, int format, const void *payload, uint32_t bytes,
+                       uint32_t sample_count, struct ext_Context *ctx ) {
+}
+
+int shm_ring_format( struct t_shm_ring *ring ) {
+    return(-1);
+}
+#endif
@@ -0,0 +1,36 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include "rx_device.h"
+#include "shm_ring_format.h"
+
+struct t_shm_ring ;
+
+// creates the ring of the device if enabled in the init parameters, NULL otherwise
+struct t_shm_ring* shm_ring_start( struct t_rx_device *dev, int device_id, json_t *root );
+
+// configured format of the ring, -1 if ring is NULL
+int shm_ring_format( struct t_shm_ring *ring );
+
+// publishes one block if format matches the configured one. Never blocks
+void shm_ring_publish( struct t_shm_ring *ring, int format, const void *payload, uint32_t bytes,
+                       uint32_t sample_count, struct ext_Context *ctx );
+
+#endif // SHM_RING_H
@@ -0,0 +1,142 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SHM_RING_FORMAT_H
+#define SHM_RING_FORMAT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Shared memory IQ transport : the driver publishes the stream of each device in a POSIX shared
+ * memory ring that any number of local processes can map read-only. Enabled from json_init_params :
+ *
+ *   { "shm" : { "format" : "cf32",     // cf32 : converted samples (as pushed to SDRNode), u8 : raw
+ *               "size_kb" : 16384 } }
+ *
+ * The ring of a device is named "/cloudsdr_rtlsdr_<serial>".
+ *
+ * Layout : struct shm_ring_header, then data_size bytes of records. Each record is a struct
+ * shm_block_header followed by the payload, padded to 8 bytes. Records never wrap : when a record
+ * does not fit before the end of the data area, the writer skips to offset 0 (a record with the
+ * SHM_BLOCK_PAD flag, or less than sizeof(struct shm_block_header) bytes left, means "go to 0").
+ *
+ * Reader protocol (see shm_ring_reader_* below) :
+ *  - start at header->last_block_pos, or any position previously returned
+ *  - a record at read_pos is available when read_pos < write_pos
+ *  - a record is valid as long as reserve_pos - read_pos <= data_size : check it AFTER using the
+ *    payload in place, a reader that fails the check has been lapped and must resync
+ *  - to sleep, increment waiters, FUTEX_WAIT on the futex word, decrement waiters
+ */
+
+#define SHM_RING_MAGIC   (0x534c5452) // "RTLS"
+#define SHM_RING_VERSION (1)
+
+#define SHM_FORMAT_U8    (0) // interleaved unsigned 8 bits I/Q, as read from the dongle
+#define SHM_FORMAT_CF32  (1) // interleaved float I/Q, DC removed
+
+#define SHM_BLOCK_PAD    (1)
+
+struct shm_ring_header {
+    uint32_t magic ;
+    uint32_t version ;
+    uint32_t format ;
+    uint32_t header_size ;    // offset of the data area from the start of the mapping
+    uint64_t data_size ;      // power of 2
+
+    uint64_t reserve_pos ;    // end of the record being written
+    uint64_t write_pos ;      // end of the last complete record
+    uint64_t last_block_pos ; // start of the last complete record
+
+    uint32_t futex ;          // incremented after each record
+    uint32_t waiters ;        // readers sleeping on futex
+};
+
+struct shm_block_header {
+    uint32_t flags ;
+    uint32_t length ;         // payload bytes
+    uint64_t seq ;            // record number, gaps mean the writer skipped data
+    uint64_t sample_index ;   // index of the first sample since the ring was created
+    int64_t  ctx_version ;    // ext_Context of the samples
+    int64_t  center_freq ;
+    uint32_t sample_rate ;
+    uint32_t sample_count ;
+};
+
+#define SHM_ALIGN8(x) (((x) + 7) & ~((uint64_t)7))
+
+#ifndef _WIN64
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// reader side helpers, header only so client programs just include this file
+
+static inline const struct shm_ring_header* shm_ring_reader_open( const char *name, size_t *map_size ) {
+    struct stat st ;
+    int fd = shm_open( name, O_RDONLY, 0 );
+    if( fd < 0 ) {
+        return(NULL);
+    }
+    if( fstat( fd, &st ) != 0 ) {
+        close(fd);
+        return(NULL);
+    }
+    void *p = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close(fd);
+    if( p == MAP_FAILED ) {
+        return(NULL);
+    }
+    const struct shm_ring_header *hdr = (const struct shm_ring_header *)p ;
+    if( (hdr->magic != SHM_RING_MAGIC) || (hdr->version != SHM_RING_VERSION) ) {
+        munmap( p, st.st_size );
+        return(NULL);
+    }
+    *map_size = st.st_size ;
+    return(hdr);
+}
+
+// returns the record at *read_pos and advances *read_pos, NULL if nothing new
+static inline const struct shm_block_header* shm_ring_reader_next( const struct shm_ring_header *hdr,
+                                                                   uint64_t *read_pos ) {
+    const unsigned char *data = (const unsigned char *)hdr + hdr->header_size ;
+    uint64_t mask = hdr->data_size - 1 ;
+    for( ; ; ) {
+        uint64_t pos = *read_pos ;
+        if( pos >= __atomic_load_n( &hdr->write_pos, __ATOMIC_ACQUIRE )) {
+            return(NULL);
+        }
+        uint64_t off = pos & mask ;
+        uint64_t left = hdr->data_size - off ;
+        const struct shm_block_header *b = (const struct shm_block_header *)(data + off);
+        if( (left < sizeof(struct shm_block_header)) || (b->flags & SHM_BLOCK_PAD) ) {
+            *read_pos = pos + left ;
+            continue ;
+        }
+        *read_pos = pos + sizeof(struct shm_block_header) + SHM_ALIGN8(b->length) ;
+        return(b);
+    }
+}
+
+// true if the record read at pos has not been overwritten meanwhile
+static inline bool shm_ring_reader_valid( const struct shm_ring_header *hdr, uint64_t pos ) {
+    return( __atomic_load_n( &hdr->reserve_pos, __ATOMIC_ACQUIRE ) - pos <= hdr->data_size );
+}
+#endif
+
+#endif // SHM_RING_FORMAT_H
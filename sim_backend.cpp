@@ -0,0 +1,349 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "sim_backend.h"
+#include "rtltcp_client.h"
+
+#define MAX_SLEEP_US (100000) // cancel is honored within this delay
+
+struct t_sim_device {
+    char file[256] ;   // empty : generated signal
+    bool loop ;
+    FILE *f ;
+
+    double tone_hz ;
+    double carrier_hz ; // > 0 : the tone is a carrier at this frequency, seen through the tuning
+    double xtal_ppm ;   // crystal error of the simulated dongle
+    double iq_gain_db ; // Q branch gain and phase relative to I
+    double iq_phase_deg ;
+    int noise ;
+    int dc ;
+    double speed ;
+    double phase ;
+    uint32_t seed ;
+
+    uint32_t center_freq ;
+    uint32_t sample_rate ;
+    int agc_mode ;
+    int gain_mode ;
+    int gain ;
+    int ppm ;
+
+    unsigned char *buffer ;
+    uint32_t buffer_len ;
+    volatile bool cancel ;
+};
+
+static struct t_sim_device* sim( struct t_rx_device *dev ) {
+    return( (struct t_sim_device *)dev->backend_ctx );
+}
+
+static enum rtlsdr_tuner sim_get_tuner_type( struct t_rx_device *dev ) {
+    (void)dev ;
+    return( RTLSDR_TUNER_R820T );
+}
+
+static int sim_get_tuner_gains( struct t_rx_device *dev, int *gains ) {
+    (void)dev ;
+    return( rtltcp_tuner_gains( RTLSDR_TUNER_R820T, gains ));
+}
+
+static int sim_set_center_freq( struct t_rx_device *dev, uint32_t freq ) {
+    sim(dev)->center_freq = freq ;
+    return(0);
+}
+
+static uint32_t sim_get_center_freq( struct t_rx_device *dev ) {
+    return( sim(dev)->center_freq );
+}
+
+static int sim_set_sample_rate( struct t_rx_device *dev, uint32_t rate ) {
+    sim(dev)->sample_rate = rate ;
+    return(0);
+}
+
+static uint32_t sim_get_sample_rate( struct t_rx_device *dev ) {
+    return( sim(dev)->sample_rate );
+}
+
+static int sim_set_agc_mode( struct t_rx_device *dev, int on ) {
+    sim(dev)->agc_mode = on ;
+    return(0);
+}
+
+static int sim_set_tuner_gain_mode( struct t_rx_device *dev, int manual ) {
+    sim(dev)->gain_mode = manual ;
+    return(0);
+}
+
+static int sim_set_tuner_gain( struct t_rx_device *dev, int gain ) {
+    sim(dev)->gain = gain ;
+    return(0);
+}
+
+static int sim_get_tuner_gain( struct t_rx_device *dev ) {
+    return( sim(dev)->gain );
+}
+
+static int sim_set_freq_correction( struct t_rx_device *dev, int ppm ) {
+    sim(dev)->ppm = ppm ;
+    return(0);
+}
+
+// called before read_async() : arms the cancel flag, a cancel from now on stops the stream
+static int sim_reset_buffer( struct t_rx_device *dev ) {
+    sim(dev)->cancel = false ;
+    return(0);
+}
+
+// tone amplitude follows the gain, 40 steps at 20 dB
+static void generate( struct t_sim_device *s, unsigned char *buf, uint32_t len ) {
+    double amp = 40.0 * pow( 10.0, (s->gain / 10.0 - 20.0) / 20.0 );
+    if( amp > 120.0 ) {
+        amp = 120.0 ;
+    }
+    double tone_hz = s->tone_hz ;
+    if( s->carrier_hz > 0 ) {
+        // the LO is off by the crystal error left after the correction
+        tone_hz = s->carrier_hz - s->center_freq * (1.0 + (s->xtal_ppm - s->ppm) * 1e-6) ;
+    }
+    double step = 2 * M_PI * tone_hz / (s->sample_rate > 0 ? s->sample_rate : 1) ;
+    // phasor rotation, renormalized once per block
+    double re = cos( s->phase ), im = sin( s->phase ) ;
+    double c = cos( step ), d = sin( step ) ;
+    // Q = g sin(wt + phi)
+    double qg = pow( 10.0, s->iq_gain_db / 20.0 ) ;
+    double qc = qg * cos( s->iq_phase_deg * M_PI / 180.0 ), qs = qg * sin( s->iq_phase_deg * M_PI / 180.0 ) ;
+    for( uint32_t i=0 ; i + 1 < len ; i += 2 ) {
+        int noise_i = 0, noise_q = 0 ;
+        if( s->noise > 0 ) {
+            s->seed = s->seed * 1664525u + 1013904223u ;
+            noise_i = (int)((s->seed >> 16) % (2 * s->noise + 1)) - s->noise ;
+            noise_q = (int)((s->seed >> 24) % (2 * s->noise + 1)) - s->noise ;
+        }
+        int I = 127 + s->dc + (int)lrint( amp * re ) + noise_i ;
+        int Q = 127 + s->dc + (int)lrint( amp * (im * qc + re * qs) ) + noise_q ;
+        buf[i]   = (unsigned char)(I < 0 ? 0 : (I > 255 ? 255 : I)) ;
+        buf[i+1] = (unsigned char)(Q < 0 ? 0 : (Q > 255 ? 255 : Q)) ;
+        double t = re * c - im * d ;
+        im = re * d + im * c ;
+        re = t ;
+    }
+    s->phase = fmod( s->phase + step * (len / 2), 2 * M_PI );
+}
+
+// false at the end of a capture played once
+static bool replay( struct t_sim_device *s, unsigned char *buf, uint32_t len ) {
+    uint32_t fill = 0 ;
+    while( fill < len ) {
+        size_t n = fread( buf + fill, 1, len - fill, s->f );
+        fill += (uint32_t)n ;
+        if( fill == len ) {
+            break ;
+        }
+        if( !s->loop || (ftell( s->f ) == 0) ) {
+            return(false);
+        }
+        rewind( s->f );
+    }
+    return(true);
+}
+
+/**
+ * @brief sim_read_async same contract as rtlsdr_read_async() : calls cb with buf_len bytes blocks,
+ *        paced at the sample rate, until sim_cancel_async() is called
+ * @return 0 if cancelled, -1 at the end of a capture
+ */
+static int sim_read_async( struct t_rx_device *dev, rtlsdr_read_async_cb_t cb, void *ctx,
+                           uint32_t buf_num, uint32_t buf_len ) {
+    struct t_sim_device *s = sim(dev);
+    (void)buf_num ;
+
+    buf_len &= ~1u ;
+    if( s->buffer_len != buf_len ) {
+        free( s->buffer );
+        s->buffer = (unsigned char *)malloc( buf_len );
+        s->buffer_len = (s->buffer != NULL) ? buf_len : 0 ;
+        if( s->buffer == NULL ) {
+            return(-1);
+        }
+    }
+    if( (s->file[0] != 0) && (s->f == NULL) ) {
+        s->f = fopen( s->file, "rb" );
+        if( s->f == NULL ) {
+            return(-1);
+        }
+    }
+
+    int64_t next_us = rx_now_us();
+    while( !s->cancel ) {
+        if( s->f != NULL ) {
+            if( !replay( s, s->buffer, buf_len )) {
+                fclose( s->f );
+                s->f = NULL ; // next start replays from the beginning
+                return(-1);
+            }
+        } else {
+            generate( s, s->buffer, buf_len );
+        }
+        if( s->speed > 0 ) {
+            next_us += (int64_t)(buf_len / 2 * 1e6 / s->sample_rate / s->speed) ;
+            for( int64_t now = rx_now_us() ; !s->cancel && (now < next_us) ; now = rx_now_us() ) {
+                int64_t wait = next_us - now ;
+                usleep( (useconds_t)(wait > MAX_SLEEP_US ? MAX_SLEEP_US : wait) );
+            }
+            if( rx_now_us() - next_us > 1000000 ) {
+                next_us = rx_now_us(); // driver was late by more than 1s, do not burst to catch up
+            }
+        }
+        if( !s->cancel ) {
+            cb( s->buffer, buf_len, ctx );
+        }
+    }
+    return(0);
+}
+
+static int sim_cancel_async( struct t_rx_device *dev ) {
+    sim(dev)->cancel = true ;
+    return(0);
+}
+
+static int sim_reopen( struct t_rx_device *dev ) {
+    struct t_sim_device *s = sim(dev);
+    if( s->f != NULL ) {
+        fclose( s->f );
+        s->f = NULL ;
+    }
+    return(0);
+}
+
+const struct t_rx_backend sim_backend = {
+    "simulated",
+    sim_get_tuner_type,
+    sim_get_tuner_gains,
+    sim_set_center_freq,
+    sim_get_center_freq,
+    sim_set_sample_rate,
+    sim_get_sample_rate,
+    sim_set_agc_mode,
+    sim_set_tuner_gain_mode,
+    sim_set_tuner_gain,
+    sim_get_tuner_gain,
+    sim_reset_buffer,
+    sim_read_async,
+    sim_cancel_async,
+    sim_reopen,
+    sim_set_freq_correction
+};
+
+//-------------------------------------------------------------------
+int sim_count_devices( json_t *root ) {
+    json_t *devices = json_object_get( root, "simulated" );
+    if( !json_is_array(devices) ) {
+        return(0);
+    }
+    return( (int)json_array_size(devices) );
+}
+
+int sim_open( struct t_rx_device *dev, json_t *root, int index ) {
+    json_t *entry = json_array_get( json_object_get( root, "simulated" ), index );
+    struct t_sim_device *s ;
+
+    if( entry == NULL ) {
+        return(-1);
+    }
+    s = (struct t_sim_device *)calloc( 1, sizeof(struct t_sim_device));
+    if( s == NULL ) {
+        return(-1);
+    }
+    s->loop = true ;
+    s->noise = 4 ;
+    s->dc = 3 ;
+    s->speed = 1.0 ;
+    s->tone_hz = -1 ;
+    s->seed = 12345 + index ;
+    s->sample_rate = 1024000 ;
+
+    if( json_is_string(entry) ) {
+        snprintf( s->file, sizeof(s->file), "%s", json_string_value(entry));
+    } else if( json_is_object(entry) ) {
+        json_t *v = json_object_get( entry, "file" );
+        if( json_is_string(v) ) {
+            snprintf( s->file, sizeof(s->file), "%s", json_string_value(v));
+        }
+        v = json_object_get( entry, "loop" );
+        if( json_is_boolean(v) ) {
+            s->loop = json_is_true(v);
+        }
+        v = json_object_get( entry, "tone_hz" );
+        if( json_is_number(v) ) {
+            s->tone_hz = json_number_value(v);
+        }
+        v = json_object_get( entry, "carrier_hz" );
+        if( json_is_number(v) ) {
+            s->carrier_hz = json_number_value(v);
+        }
+        v = json_object_get( entry, "xtal_ppm" );
+        if( json_is_number(v) ) {
+            s->xtal_ppm = json_number_value(v);
+        }
+        v = json_object_get( entry, "iq_gain_db" );
+        if( json_is_number(v) ) {
+            s->iq_gain_db = json_number_value(v);
+        }
+        v = json_object_get( entry, "iq_phase_deg" );
+        if( json_is_number(v) ) {
+            s->iq_phase_deg = json_number_value(v);
+        }
+        v = json_object_get( entry, "noise" );
+        if( json_is_integer(v) && (json_integer_value(v) >= 0) ) {
+            s->noise = (int)json_integer_value(v);
+        }
+        v = json_object_get( entry, "dc" );
+        if( json_is_integer(v) ) {
+            s->dc = (int)json_integer_value(v);
+        }
+        v = json_object_get( entry, "speed" );
+        if( json_is_number(v) && (json_number_value(v) >= 0) ) {
+            s->speed = json_number_value(v);
+        }
+    } else {
+        free(s);
+        return(-1);
+    }
+    if( s->tone_hz < 0 ) {
+        s->tone_hz = s->sample_rate / 8.0 ;
+    }
+
+    dev->backend = &sim_backend ;
+    dev->backend_ctx = s ;
+    dev->rtlsdr_device = NULL ;
+    dev->device_serial_number = (char *)malloc( 300 * sizeof(char));
+    if( s->file[0] != 0 ) {
+        const char *base = strrchr( s->file, '/' );
+        snprintf( dev->device_serial_number, 300, "SIM:%s", base != NULL ? base + 1 : s->file );
+    } else {
+        snprintf( dev->device_serial_number, 300, "SIM:%d", index );
+    }
+    return(0);
+}
@@ -0,0 +1,44 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SIM_BACKEND_H
+#define SIM_BACKEND_H
+
+#include "rx_device.h"
+
+/*
+ * Simulated backend : boards without hardware, for end to end tests and benchmarks. Each entry is
+ * a raw rtl_sdr capture (u8 IQ) replayed, or a generated tone with noise :
+ *
+ *   { "simulated" : [ "capture.u8",
+ *                     { "file" : "capture.u8", "loop" : false },
+ *                     { "tone_hz" : 100000, "noise" : 4, "dc" : 3, "speed" : 0 } ] }
+ *
+ * tone_hz is the offset from the tuned frequency, noise the peak noise and dc the offset, in
+ * u8 steps. Blocks are paced at the sample rate times speed (1 by default), 0 delivers them as
+ * fast as the driver takes them. A capture without loop ends the stream like a lost dongle.
+ */
+
+extern const struct t_rx_backend sim_backend ;
+
+// number of simulated boards declared in the init parameters
+int sim_count_devices( json_t *root );
+
+// attach the index-th simulated board to dev. Returns 0 if the board can be exposed
+int sim_open( struct t_rx_device *dev, json_t *root, int index );
+
+#endif // SIM_BACKEND_H
@@ -0,0 +1,216 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "stream_engine.h"
+#include "worker_pool.h"
+#include "numa_placement.h"
+#include "latency_hist.h"
+#include "trace.h"
+
+#define DEFAULT_BUF_LEN      (65536)
+#define DEFAULT_QUEUE_BLOCKS (32)
+#define BLOCKS_PER_TURN      (4) // blocks a worker processes before giving way to another device
+
+struct t_stream_engine_config stream_engine = {
+    STREAM_ENGINE_PER_DEVICE, 0, DEFAULT_BUF_LEN, DEFAULT_QUEUE_BLOCKS, 0
+};
+
+struct t_stream_block {
+    struct t_stream_block *next ;
+    uint32_t len ;
+    uint64_t ticks ;      // completion of the transfer, latency histograms
+    unsigned char *data ;
+};
+
+// per device queue : completed transfers waiting for a worker, and free blocks.
+// The queue is the worker pool task of the device. Written by the USB thread and the workers,
+// so it gets its own cache lines
+struct t_stream_queue {
+    struct t_pool_task task ;
+    pthread_mutex_t lock ;
+    struct t_stream_block *free_list ;
+    struct t_stream_block *pending_head ;
+    struct t_stream_block *pending_tail ;
+    bool scheduled ;                 // device is queued in the pool or being processed
+    struct t_rx_device *dev ;
+    uint64_t overruns ;              // transfers dropped because no block was free
+} __attribute__ ((aligned (CACHE_LINE_SIZE)));
+
+/**
+ * @brief shared_usb_callback runs in the USB thread of the device : copy and queue, nothing else.
+ *        When the workers are late and no block is free the transfer is dropped, USB never waits
+ */
+static void shared_usb_callback( unsigned char *buf, uint32_t len, void *ctx ) {
+    struct t_rx_device *dev = (struct t_rx_device *)ctx ;
+    struct t_stream_queue *q = dev->queue ;
+    struct t_stream_block *b ;
+
+    if( rx_stream_gated( dev ) ) {
+        return ;
+    }
+    uint64_t span = trace_begin();
+    uint64_t ticks = 0 ;
+    if( dev->latency != NULL ) {
+        ticks = latency_now();
+        latency_transfer( dev->latency, __atomic_load_n( &dev->hot->starts, __ATOMIC_RELAXED ), ticks );
+    }
+    pthread_mutex_lock( &q->lock );
+    b = q->free_list ;
+    if( b != NULL ) {
+        q->free_list = b->next ;
+    } else {
+        __atomic_store_n( &q->overruns, q->overruns + 1, __ATOMIC_RELAXED );
+    }
+    pthread_mutex_unlock( &q->lock );
+    if( b == NULL ) {
+        trace_instant( "overrun", (int)(dev - rx) );
+        return ;
+    }
+
+    if( len > stream_engine.buf_len ) {
+        len = stream_engine.buf_len ;
+    }
+    memcpy( b->data, buf, len );
+    b->len = len ;
+    b->ticks = ticks ;
+    b->next = NULL ;
+
+    pthread_mutex_lock( &q->lock );
+    if( q->pending_tail != NULL ) {
+        q->pending_tail->next = b ;
+    } else {
+        q->pending_head = b ;
+    }
+    q->pending_tail = b ;
+    bool wake = !q->scheduled ;
+    q->scheduled = true ;
+    pthread_mutex_unlock( &q->lock );
+
+    if( wake ) {
+        worker_pool_submit( &q->task );
+    }
+    trace_end( "queue_transfer", (int)(dev - rx), span );
+}
+
+/**
+ * @brief process_device worker pool task of a device. We own the device until scheduled is cleared,
+ *        so its blocks are processed in order even if another worker steals the task next time
+ */
+static void process_device( struct t_pool_task *task ) {
+    struct t_stream_queue *q = (struct t_stream_queue *)task ;
+    for( int turn=0 ; ; turn++ ) {
+        pthread_mutex_lock( &q->lock );
+        struct t_stream_block *b = q->pending_head ;
+        if( b == NULL ) {
+            q->scheduled = false ;
+            pthread_mutex_unlock( &q->lock );
+            return ;
+        }
+        if( turn == BLOCKS_PER_TURN ) {
+            // let other devices run, still scheduled so nobody else queues us
+            pthread_mutex_unlock( &q->lock );
+            worker_pool_submit( &q->task );
+            return ;
+        }
+        q->pending_head = b->next ;
+        if( q->pending_head == NULL ) {
+            q->pending_tail = NULL ;
+        }
+        pthread_mutex_unlock( &q->lock );
+
+        latency_set_reference( q->dev->latency, b->ticks );
+        rtlsdr_callback( b->data, b->len, q->dev );
+
+        pthread_mutex_lock( &q->lock );
+        b->next = q->free_list ;
+        q->free_list = b ;
+        pthread_mutex_unlock( &q->lock );
+    }
+}
+
+void stream_engine_setup( json_t *root ) {
+    json_t *conf = json_object_get( root, "stream_engine" );
+    if( json_is_object(conf) ) {
+        json_t *v = json_object_get( conf, "mode" );
+        if( json_is_string(v) && (strcmp( json_string_value(v), "shared" ) == 0) ) {
+            stream_engine.mode = STREAM_ENGINE_SHARED ;
+        }
+        v = json_object_get( conf, "buf_num" );
+        if( json_is_integer(v) && (json_integer_value(v) >= 0) ) stream_engine.buf_num = (uint32_t)json_integer_value(v);
+        v = json_object_get( conf, "buf_len" );
+        // librtlsdr wants a multiple of 512 bytes
+        if( json_is_integer(v) && (json_integer_value(v) >= 512) ) stream_engine.buf_len = (uint32_t)json_integer_value(v) & ~511u ;
+        v = json_object_get( conf, "queue_blocks" );
+        if( json_is_integer(v) && (json_integer_value(v) >= 2) ) stream_engine.queue_blocks = (int)json_integer_value(v);
+        v = json_object_get( conf, "warm_idle_ms" );
+        if( json_is_integer(v) && (json_integer_value(v) >= -1) ) stream_engine.warm_idle_ms = (int)json_integer_value(v);
+    }
+
+    if( stream_engine.mode == STREAM_ENGINE_SHARED ) {
+        worker_pool_setup( root );
+    }
+}
+
+void stream_engine_attach( struct t_rx_device *dev ) {
+    dev->queue = NULL ;
+    if( stream_engine.mode != STREAM_ENGINE_SHARED ) {
+        return ;
+    }
+    struct t_stream_queue *q = (struct t_stream_queue *)numa_buffer_alloc( sizeof(struct t_stream_queue), dev->numa_node );
+    if( q == NULL ) {
+        return ;
+    }
+    pthread_mutex_init( &q->lock, NULL );
+    q->dev = dev ;
+    q->task.run = process_device ;
+    q->task.home = (int)(dev - rx) ;
+    // one allocation for all the blocks of the device
+    struct t_stream_block *blocks = (struct t_stream_block *)calloc( stream_engine.queue_blocks, sizeof(struct t_stream_block));
+    size_t data_size = (size_t)stream_engine.queue_blocks * stream_engine.buf_len ;
+    unsigned char *data = (unsigned char *)numa_buffer_alloc( data_size, dev->numa_node );
+    if( (blocks == NULL) || (data == NULL) ) {
+        free( blocks );
+        numa_buffer_free( data, data_size );
+        numa_buffer_free( q, sizeof(struct t_stream_queue));
+        return ;
+    }
+    thread_tuning_lock_buffer( data, data_size );
+    for( int k=0 ; k < stream_engine.queue_blocks ; k++ ) {
+        blocks[k].data = data + (size_t)k * stream_engine.buf_len ;
+        blocks[k].next = q->free_list ;
+        q->free_list = &blocks[k] ;
+    }
+    dev->queue = q ;
+}
+
+rtlsdr_read_async_cb_t stream_engine_callback( struct t_rx_device *dev ) {
+    if( dev->queue != NULL ) {
+        return( shared_usb_callback );
+    }
+    return( rtlsdr_callback );
+}
+
+uint64_t stream_engine_overruns( struct t_rx_device *dev ) {
+    if( dev->queue == NULL ) {
+        return(0);
+    }
+    return( __atomic_load_n( &dev->queue->overruns, __ATOMIC_RELAXED ));
+}
@@ -0,0 +1,69 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STREAM_ENGINE_H
+#define STREAM_ENGINE_H
+
+#include "rx_device.h"
+
+/*
+ * Streaming engine : how USB transfers are read and where the sample processing runs.
+ *
+ *   { "stream_engine" : { "mode" : "shared",     // per_device (default) | shared
+ *                         "buf_num" : 8,         // USB transfers in flight per device (0 : librtlsdr default)
+ *                         "buf_len" : 65536,     // bytes per USB transfer
+ *                         "queue_blocks" : 32,   // shared mode : blocks buffered per device
+ *                         "warm_idle_ms" : 30000 } } // see below
+ *
+ * per_device : the USB thread of each device converts and pushes the samples itself (historical mode).
+ * shared     : the USB threads only copy the completed transfer into a preallocated block and queue it,
+ *              the DSP worker pool (worker_pool.h) converts and pushes for all the devices. Blocks of a
+ *              device are always processed in order, by one worker at a time.
+ *
+ * warm_idle_ms : after finalizeRXEngine() the USB stream keeps running for this long with the pushes
+ *                gated, so a prepareRXEngine() in the meantime restarts in microseconds instead of
+ *                rebuilding all the transfers. 0 (default) stops at once, -1 never stops.
+ */
+
+#define STREAM_ENGINE_PER_DEVICE (0)
+#define STREAM_ENGINE_SHARED     (1)
+
+struct t_stream_engine_config {
+    int mode ;
+    uint32_t buf_num ;
+    uint32_t buf_len ;
+    int queue_blocks ;
+    int warm_idle_ms ;
+};
+
+extern struct t_stream_engine_config stream_engine ;
+
+struct t_stream_queue ;
+
+// reads the configuration and starts the worker pool if needed
+void stream_engine_setup( json_t *root );
+
+// allocates the per device block pool (shared mode only)
+void stream_engine_attach( struct t_rx_device *dev );
+
+// the function to hand to read_async() for this device
+rtlsdr_read_async_cb_t stream_engine_callback( struct t_rx_device *dev );
+
+// transfers dropped because the workers were late (shared mode), 0 in per device mode
+uint64_t stream_engine_overruns( struct t_rx_device *dev );
+
+#endif // STREAM_ENGINE_H
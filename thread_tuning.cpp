@@ -0,0 +1,184 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+#ifndef _WIN64
+#include <sys/mman.h>
+#endif
+
+#include "thread_tuning.h"
+
+#define MLOCK_NONE    (0)
+#define MLOCK_BUFFERS (1)
+#define MLOCK_ALL     (2)
+
+static int mlock_mode = MLOCK_NONE ;
+
+void thread_settings_parse( json_t *obj, struct t_thread_settings *s ) {
+    if( !json_is_object(obj) ) {
+        return ;
+    }
+    json_t *v = json_object_get( obj, "cpus" );
+    if( json_is_array(v) ) {
+        s->cpu_count = 0 ;
+        for( size_t k=0 ; (k < json_array_size(v)) && (s->cpu_count < MAX_PINNED_CPUS) ; k++ ) {
+            json_t *cpu = json_array_get( v, k );
+            if( json_is_integer(cpu) ) {
+                s->cpus[s->cpu_count++] = (int)json_integer_value(cpu);
+            }
+        }
+    }
+    v = json_object_get( obj, "sched" );
+    if( json_is_string(v) ) {
+        const char *name = json_string_value(v);
+        if( strcmp( name, "fifo" ) == 0 ) s->policy = SCHED_FIFO ;
+        else if( strcmp( name, "rr" ) == 0 ) s->policy = SCHED_RR ;
+        else s->policy = SCHED_OTHER ;
+    }
+    v = json_object_get( obj, "priority" );
+    if( json_is_integer(v) ) {
+        s->priority = (int)json_integer_value(v);
+    }
+}
+
+void thread_settings_for_device( json_t *root, const char *serial, int device_id, struct t_thread_settings *s ) {
+    char index[16] ;
+    memset( s, 0, sizeof(struct t_thread_settings));
+    s->policy = SCHED_OTHER ;
+
+    json_t *conf = json_object_get( root, "threads" );
+    if( !json_is_object(conf) ) {
+        return ;
+    }
+    thread_settings_parse( json_object_get( conf, "default" ), s );
+    json_t *devices = json_object_get( conf, "devices" );
+    if( json_is_object(devices) ) {
+        snprintf( index, sizeof(index), "%d", device_id );
+        json_t *dev = (serial != NULL) ? json_object_get( devices, serial ) : NULL ;
+        if( dev == NULL ) {
+            dev = json_object_get( devices, index );
+        }
+        thread_settings_parse( dev, s );
+    }
+}
+
+static const char* policy_name( int policy ) {
+    switch( policy ) {
+    case SCHED_FIFO: return("fifo");
+    case SCHED_RR:   return("rr");
+    default:         return("other");
+    }
+}
+
+int thread_settings_apply( pthread_t thread, const struct t_thread_settings *s, int pick, char *report, size_t len ) {
+    int rc = 0 ;
+    int n = 0 ;
+    char errors[128] ;
+    errors[0] = 0 ;
+
+#ifdef __linux__
+    if( s->cpu_count > 0 ) {
+        cpu_set_t set ;
+        CPU_ZERO( &set );
+        if( pick >= 0 ) {
+            CPU_SET( s->cpus[ pick % s->cpu_count ], &set );
+        } else {
+            for( int k=0 ; k < s->cpu_count ; k++ ) CPU_SET( s->cpus[k], &set );
+        }
+        int err = pthread_setaffinity_np( thread, sizeof(set), &set );
+        if( err != 0 ) {
+            snprintf( errors, sizeof(errors), " affinity: %s", strerror(err) );
+            rc = -1 ;
+        }
+    }
+#endif
+    if( s->policy != SCHED_OTHER ) {
+        struct sched_param param ;
+        memset( &param, 0, sizeof(param));
+        param.sched_priority = s->priority ;
+        int err = pthread_setschedparam( thread, s->policy, &param );
+        if( err != 0 ) {
+            size_t used = strlen(errors);
+            snprintf( errors + used, sizeof(errors) - used, " sched: %s", strerror(err) );
+            rc = -1 ;
+        }
+    }
+
+    // report what is in effect, not what was asked
+    n = snprintf( report, len, "cpus=" );
+#ifdef __linux__
+    cpu_set_t effective ;
+    CPU_ZERO( &effective );
+    if( pthread_getaffinity_np( thread, sizeof(effective), &effective ) == 0 ) {
+        int shown = 0 ;
+        for( int cpu=0 ; (cpu < CPU_SETSIZE) && (n < (int)len) ; cpu++ ) {
+            if( CPU_ISSET( cpu, &effective )) {
+                n += snprintf( report + n, len - n, "%s%d", shown ? "," : "", cpu );
+                shown++ ;
+            }
+        }
+    }
+#else
+    n += snprintf( report + n, len - n, "any" );
+#endif
+    int policy = SCHED_OTHER ;
+    struct sched_param param ;
+    if( (n < (int)len) && (pthread_getschedparam( thread, &policy, &param ) == 0) ) {
+        n += snprintf( report + n, len - n, " sched=%s/%d", policy_name(policy), param.sched_priority );
+    }
+    if( (n < (int)len) && (errors[0] != 0) ) {
+        snprintf( report + n, len - n, " (failed%s)", errors );
+    }
+    return(rc);
+}
+
+void thread_tuning_setup( json_t *root, char *report, size_t len ) {
+    report[0] = 0 ;
+    json_t *conf = json_object_get( root, "threads" );
+    if( !json_is_object(conf) ) {
+        return ;
+    }
+    json_t *v = json_object_get( conf, "mlock" );
+    if( json_is_string(v) ) {
+        if( strcmp( json_string_value(v), "buffers" ) == 0 ) mlock_mode = MLOCK_BUFFERS ;
+        if( strcmp( json_string_value(v), "all" ) == 0 ) mlock_mode = MLOCK_ALL ;
+    }
+#ifndef _WIN64
+    if( mlock_mode == MLOCK_ALL ) {
+        if( mlockall( MCL_CURRENT | MCL_FUTURE ) == 0 ) {
+            snprintf( report, len, "mlockall: ok" );
+        } else {
+            snprintf( report, len, "mlockall: failed (%s)", strerror(errno) );
+        }
+    } else if( mlock_mode == MLOCK_BUFFERS ) {
+        snprintf( report, len, "mlock: streaming buffers" );
+    }
+#endif
+}
+
+int thread_tuning_lock_buffer( void *ptr, size_t size ) {
+#ifndef _WIN64
+    if( (mlock_mode == MLOCK_BUFFERS) && (ptr != NULL) ) {
+        return( mlock( ptr, size ));
+    }
+#endif
+    return(0);
+}
@@ -0,0 +1,64 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef THREAD_TUNING_H
+#define THREAD_TUNING_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "jansson/jansson.h"
+
+/*
+ * CPU affinity, scheduling policy and memory locking of the driver threads.
+ *
+ *   { "threads" : { "mlock" : "buffers",                 // none (default) | buffers | all
+ *                   "default" : { "cpus" : [ 2, 3 ], "sched" : "fifo", "priority" : 50 },
+ *                   "devices" : { "00000001" : { "cpus" : [ 4 ] },   // by serial...
+ *                                 "1" : { "cpus" : [ 5 ], "sched" : "rr", "priority" : 40 } } } } // ...or index
+ *
+ * Device settings apply to its acquisition thread : it runs the USB event handling, and the DSP too
+ * in the per_device stream engine. The shared DSP workers take the same keys in "dsp_pool".
+ * mlock "buffers" locks the streaming buffers of the driver, "all" calls mlockall() for the whole process.
+ */
+
+#define MAX_PINNED_CPUS (64)
+
+struct t_thread_settings {
+    int cpus[MAX_PINNED_CPUS] ;
+    int cpu_count ;              // 0 : not pinned
+    int policy ;                 // SCHED_OTHER, SCHED_FIFO, SCHED_RR
+    int priority ;
+};
+
+// reads cpus/sched/priority from obj on top of what s already contains
+void thread_settings_parse( json_t *obj, struct t_thread_settings *s );
+
+// settings of a device : "default" then "devices"/<serial> or "devices"/<index>
+void thread_settings_for_device( json_t *root, const char *serial, int device_id, struct t_thread_settings *s );
+
+// applies to the thread. pick < 0 : the whole cpu set, otherwise only cpus[pick % cpu_count].
+// Writes what is actually in effect into report
+int thread_settings_apply( pthread_t thread, const struct t_thread_settings *s, int pick, char *report, size_t len );
+
+// reads the "threads" section, mlockall() if asked
+void thread_tuning_setup( json_t *root, char *report, size_t len );
+
+// locks a streaming buffer in RAM when mlock is "buffers", returns 0 if locked or not asked
+int thread_tuning_lock_buffer( void *ptr, size_t size );
+
+#endif // THREAD_TUNING_H
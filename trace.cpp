@@ -0,0 +1,182 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "trace.h"
+#include "latency_hist.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#else
+static int next_tid ;
+#endif
+
+#define DEFAULT_EVENTS (16384)
+
+struct t_trace_event {
+    uint64_t start ;
+    uint64_t duration ;   // ticks, UINT64_MAX for an instant event
+    const char *name ;
+    int device ;
+};
+
+struct t_trace_buffer {
+    struct t_trace_buffer *next ; // list of all buffers, never freed so dumps see finished threads
+    uint64_t count ;              // events written since the start, the writer publishes with release
+    int tid ;
+    char thread_name[48] ;
+    struct t_trace_event events[] ;
+};
+
+bool trace_enabled = false ;
+static uint32_t capacity = DEFAULT_EVENTS ; // power of 2
+static struct t_trace_buffer *buffers ;
+static uint64_t origin ;
+static __thread struct t_trace_buffer *local ;
+
+void trace_setup( json_t *root ) {
+    json_t *conf = json_object_get( root, "trace" );
+    if( json_is_true(conf) ) {
+        trace_enabled = true ;
+    } else if( json_is_object(conf) ) {
+        trace_enabled = true ;
+        json_t *v = json_object_get( conf, "events" );
+        if( json_is_integer(v) && (json_integer_value(v) >= 256) && (json_integer_value(v) <= (1 << 24)) ) {
+            capacity = 1 ;
+            while( capacity < (uint32_t)json_integer_value(v) ) {
+                capacity <<= 1 ;
+            }
+        }
+    }
+    origin = latency_now();
+}
+
+static struct t_trace_buffer* local_buffer() {
+    if( local != NULL ) {
+        return(local);
+    }
+    struct t_trace_buffer *b = (struct t_trace_buffer *)calloc( 1, sizeof(struct t_trace_buffer) +
+                                                                   capacity * sizeof(struct t_trace_event));
+    if( b == NULL ) {
+        return(NULL);
+    }
+#ifdef __linux__
+    b->tid = (int)syscall( SYS_gettid );
+#else
+    b->tid = __atomic_add_fetch( &next_tid, 1, __ATOMIC_RELAXED );
+#endif
+    b->next = __atomic_load_n( &buffers, __ATOMIC_RELAXED );
+    while( !__atomic_compare_exchange_n( &buffers, &b->next, b, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED ))
+        ;
+    local = b ;
+    return(b);
+}
+
+void trace_thread_name( const char *name ) {
+    if( !trace_enabled ) {
+        return ;
+    }
+    struct t_trace_buffer *b = local_buffer();
+    if( b != NULL ) {
+        snprintf( b->thread_name, sizeof(b->thread_name), "%s", name );
+    }
+}
+
+uint64_t trace_begin( void ) {
+    return( trace_enabled ? latency_now() : 0 );
+}
+
+static void record( const char *name, int device, uint64_t start, uint64_t duration ) {
+    struct t_trace_buffer *b = local_buffer();
+    if( b == NULL ) {
+        return ;
+    }
+    struct t_trace_event *e = &b->events[b->count & (capacity - 1)] ;
+    e->start = start ;
+    e->duration = duration ;
+    e->name = name ;
+    e->device = device ;
+    __atomic_store_n( &b->count, b->count + 1, __ATOMIC_RELEASE );
+}
+
+void trace_end( const char *name, int device, uint64_t start ) {
+    if( !trace_enabled || (start == 0) ) {
+        return ;
+    }
+    record( name, device, start, latency_now() - start );
+}
+
+void trace_instant( const char *name, int device ) {
+    if( !trace_enabled ) {
+        return ;
+    }
+    record( name, device, latency_now(), UINT64_MAX );
+}
+
+int trace_dump( const char *filename ) {
+    if( !trace_enabled ) {
+        return(-1);
+    }
+    FILE *f = fopen( filename, "w" );
+    if( f == NULL ) {
+        return(-1);
+    }
+    double us_per_tick = latency_ns_per_tick() / 1000.0 ;
+#ifdef __linux__
+    int pid = (int)getpid();
+#else
+    int pid = 1 ;
+#endif
+    fprintf( f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" );
+    fprintf( f, "{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\",\"args\":{\"name\":\"CloudSDR_RTLSDR\"}}", pid );
+    for( struct t_trace_buffer *b = __atomic_load_n( &buffers, __ATOMIC_ACQUIRE ) ; b != NULL ; b = b->next ) {
+        if( b->thread_name[0] != 0 ) {
+            fprintf( f, ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                     pid, b->tid, b->thread_name );
+        }
+        uint64_t count = __atomic_load_n( &b->count, __ATOMIC_ACQUIRE );
+        uint64_t k = count > capacity ? count - capacity : 0 ;
+        for( ; k < count ; k++ ) {
+            struct t_trace_event e = b->events[k & (capacity - 1)] ;
+            // the writer may have wrapped over this event while it was copied
+            if( __atomic_load_n( &b->count, __ATOMIC_ACQUIRE ) >= k + capacity ) {
+                continue ;
+            }
+            if( e.start < origin ) {
+                continue ;
+            }
+            double ts = (e.start - origin) * us_per_tick ;
+            if( e.duration == UINT64_MAX ) {
+                fprintf( f, ",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"name\":\"%s\"", pid, b->tid, ts, e.name );
+            } else {
+                fprintf( f, ",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":\"%s\"",
+                         pid, b->tid, ts, e.duration * us_per_tick, e.name );
+            }
+            if( e.device >= 0 ) {
+                fprintf( f, ",\"args\":{\"device\":%d}", e.device );
+            }
+            fprintf( f, "}" );
+        }
+    }
+    fprintf( f, "\n]}\n" );
+    bool ok = (ferror(f) == 0) ;
+    return( (fclose(f) == 0) && ok ? 0 : -1 );
+}
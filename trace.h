@@ -0,0 +1,63 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "jansson/jansson.h"
+
+/*
+ * Event recorder for chrome://tracing and ui.perfetto.dev.
+ *
+ *   { "trace" : { "events" : 16384 } }   // events kept per thread, the oldest are overwritten
+ *
+ * Each thread writes to its own buffer, allocated at its first event, without locks. dumpTrace()
+ * writes the Chrome trace JSON of what the buffers hold. When disabled an event costs a test.
+ * Event names must be string literals, only their address is stored.
+ */
+
+extern bool trace_enabled ;
+
+void trace_setup( json_t *root );
+
+// names the calling thread in the trace
+void trace_thread_name( const char *name );
+
+// start of a span, 0 when tracing is disabled
+uint64_t trace_begin( void );
+
+// span started at start, device -1 if not related to a device
+void trace_end( const char *name, int device, uint64_t start );
+
+// event without duration
+void trace_instant( const char *name, int device );
+
+// writes the Chrome trace JSON, 0 on success
+int trace_dump( const char *filename );
+
+// span covering the rest of the enclosing scope, for the exported functions
+struct t_trace_scope {
+    const char *name ;
+    int device ;
+    uint64_t start ;
+    t_trace_scope( const char *n, int d ) : name(n), device(d), start(trace_begin()) {}
+    ~t_trace_scope() { trace_end( name, device, start ); }
+};
+#define TRACE_ENTRY(device) struct t_trace_scope trace_scope_( __func__, (device) )
+
+#endif // TRACE_H
@@ -0,0 +1,215 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "udp_stream.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <endian.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_PORT  (5000)
+#define DEFAULT_MTU   (1500)
+#define IP_UDP_HEADERS (28)
+
+struct t_udp_stream {
+    int sock ;
+    struct sockaddr_in dest ;
+    int format ;
+    uint32_t samples_per_datagram ;
+
+    uint32_t seq ;
+    uint64_t sample_index ;
+    uint64_t sent ;
+    uint64_t dropped ;
+
+    // preallocated batch, grown only when a larger block shows up
+    int batch_size ;
+    struct mmsghdr *msgs ;
+    struct iovec *iov ;
+    struct udp_iq_header *headers ;
+    int16_t *s16 ;
+};
+
+// s16 holds count full datagrams, so any block cut in count datagrams fits
+static bool grow_batch( struct t_udp_stream *st, int count ) {
+    if( count <= st->batch_size ) {
+        return(true);
+    }
+    free( st->msgs ); free( st->iov ); free( st->headers ); free( st->s16 );
+    st->msgs = (struct mmsghdr *)calloc( count, sizeof(struct mmsghdr));
+    st->iov = (struct iovec *)calloc( 2 * count, sizeof(struct iovec));
+    st->headers = (struct udp_iq_header *)calloc( count, sizeof(struct udp_iq_header));
+    st->s16 = (int16_t *)malloc( 2 * (size_t)count * st->samples_per_datagram * sizeof(int16_t));
+    if( !st->msgs || !st->iov || !st->headers || !st->s16 ) {
+        st->batch_size = 0 ;
+        return(false);
+    }
+    st->batch_size = count ;
+    return(true);
+}
+
+/**
+ * @brief udp_stream_publish cuts the block in datagrams and sends them with as few sendmmsg() as
+ *        possible. u8 payloads point straight into the USB buffer, s16 ones into a reused scratch buffer
+ */
+void udp_stream_publish( struct t_udp_stream *st, unsigned char *buf, uint32_t len, struct ext_Context *ctx ) {
+    if( st == NULL ) {
+        return ;
+    }
+    uint32_t sample_count = len / 2 ;
+    int count = (sample_count + st->samples_per_datagram - 1) / st->samples_per_datagram ;
+    if( !grow_batch( st, count )) {
+        return ;
+    }
+
+    unsigned char *payload = buf ;
+    uint32_t sample_bytes = 2 ;
+    if( st->format == UDP_IQ_FORMAT_S16 ) {
+        for( uint32_t i=0 ; i < 2*sample_count ; i++ ) {
+            st->s16[i] = (int16_t)htole16( (uint16_t)(((int)buf[i] - 127) << 8) );
+        }
+        payload = (unsigned char *)st->s16 ;
+        sample_bytes = 4 ;
+    }
+
+    uint32_t done = 0 ;
+    for( int k=0 ; k < count ; k++ ) {
+        uint32_t n = sample_count - done ;
+        if( n > st->samples_per_datagram ) {
+            n = st->samples_per_datagram ;
+        }
+        struct udp_iq_header *h = &st->headers[k] ;
+        h->magic = htole32( UDP_IQ_MAGIC );
+        h->version = UDP_IQ_VERSION ;
+        h->format = st->format ;
+        h->header_size = htole16( sizeof(struct udp_iq_header));
+        h->seq = htole32( st->seq++ );
+        h->sample_count = htole32( n );
+        h->sample_index = htole64( st->sample_index + done );
+        h->center_freq = htole64( (uint64_t)ctx->center_freq );
+        h->sample_rate = htole32( ctx->sample_rate );
+        h->ctx_version = htole32( (uint32_t)ctx->ctx_version );
+
+        st->iov[2*k].iov_base = h ;
+        st->iov[2*k].iov_len = sizeof(struct udp_iq_header);
+        st->iov[2*k+1].iov_base = payload + (size_t)done * sample_bytes ;
+        st->iov[2*k+1].iov_len = (size_t)n * sample_bytes ;
+
+        struct msghdr *m = &st->msgs[k].msg_hdr ;
+        m->msg_name = &st->dest ;
+        m->msg_namelen = sizeof(st->dest);
+        m->msg_iov = &st->iov[2*k] ;
+        m->msg_iovlen = 2 ;
+        m->msg_control = NULL ;
+        m->msg_controllen = 0 ;
+        m->msg_flags = 0 ;
+        done += n ;
+    }
+    st->sample_index += sample_count ;
+
+    int sent = 0 ;
+    while( sent < count ) {
+        int rc = sendmmsg( st->sock, st->msgs + sent, count - sent, MSG_DONTWAIT );
+        if( rc <= 0 ) {
+            if( (rc < 0) && (errno == EINTR) ) continue ;
+            break ; // socket buffer full : drop the rest, receivers see the gap
+        }
+        sent += rc ;
+    }
+    st->sent += sent ;
+    st->dropped += count - sent ;
+}
+
+struct t_udp_stream* udp_stream_start( struct t_rx_device *dev, int device_id, json_t *root ) {
+    json_t *conf = json_object_get( root, "multicast" );
+    struct t_udp_stream *st ;
+    int port = DEFAULT_PORT ;
+    int mtu = DEFAULT_MTU ;
+    int ttl = 1 ;
+    int loop = 1 ;
+    char msg[256] ;
+    (void)dev ;
+
+    if( !json_is_object(conf) || !json_is_string( json_object_get( conf, "group" ))) {
+        return(NULL);
+    }
+    st = (struct t_udp_stream *)calloc( 1, sizeof(struct t_udp_stream));
+    if( st == NULL ) {
+        return(NULL);
+    }
+    const char *group = json_string_value( json_object_get( conf, "group" ));
+    st->format = UDP_IQ_FORMAT_U8 ;
+    json_t *v = json_object_get( conf, "format" );
+    if( json_is_string(v) && (strcmp( json_string_value(v), "s16" ) == 0) ) st->format = UDP_IQ_FORMAT_S16 ;
+    v = json_object_get( conf, "port" );
+    if( json_is_integer(v) ) port = (int)json_integer_value(v);
+    v = json_object_get( conf, "mtu" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 576) ) mtu = (int)json_integer_value(v);
+    v = json_object_get( conf, "ttl" );
+    if( json_is_integer(v) ) ttl = (int)json_integer_value(v);
+    v = json_object_get( conf, "loopback" );
+    if( json_is_boolean(v) ) loop = json_is_true(v) ? 1 : 0 ;
+
+    uint32_t sample_bytes = (st->format == UDP_IQ_FORMAT_S16) ? 4 : 2 ;
+    st->samples_per_datagram = (mtu - IP_UDP_HEADERS - sizeof(struct udp_iq_header)) / sample_bytes ;
+
+    st->sock = socket( AF_INET, SOCK_DGRAM, 0 );
+    if( st->sock < 0 ) {
+        free(st);
+        return(NULL);
+    }
+    unsigned char c_ttl = ttl ;
+    unsigned char c_loop = loop ;
+    int sndbuf = 4 * 1024 * 1024 ;
+    setsockopt( st->sock, IPPROTO_IP, IP_MULTICAST_TTL, &c_ttl, sizeof(c_ttl));
+    setsockopt( st->sock, IPPROTO_IP, IP_MULTICAST_LOOP, &c_loop, sizeof(c_loop));
+    setsockopt( st->sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    v = json_object_get( conf, "interface" );
+    if( json_is_string(v) ) {
+        struct in_addr itf ;
+        itf.s_addr = inet_addr( json_string_value(v) );
+        setsockopt( st->sock, IPPROTO_IP, IP_MULTICAST_IF, &itf, sizeof(itf));
+    }
+
+    memset( &st->dest, 0, sizeof(st->dest));
+    st->dest.sin_family = AF_INET ;
+    st->dest.sin_port = htons( port + device_id );
+    st->dest.sin_addr.s_addr = inet_addr( group );
+
+    snprintf( msg, sizeof(msg), "multicast: sending %s samples to %s:%d, %u samples per datagram",
+              st->format == UDP_IQ_FORMAT_U8 ? "u8" : "s16", group, port + device_id, st->samples_per_datagram );
+    log( device_id, 0, msg );
+    return(st);
+}
+
+#else
+// relies on Linux sendmmsg()
+struct t_udp_stream* udp_stream_start( struct t_rx_device *dev, int device_id, json_t *root ) {
+    return(NULL);
+}
+
+void udp_stream_publish( struct t_udp_stream *st, unsigned char *buf, uint32_t len, struct ext_Context *ctx ) {
+}
+#endif
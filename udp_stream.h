@@ -0,0 +1,32 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UDP_STREAM_H
+#define UDP_STREAM_H
+
+#include "rx_device.h"
+#include "udp_stream_format.h"
+
+struct t_udp_stream ;
+
+// opens the multicast sender of the device if enabled in the init parameters, NULL otherwise
+struct t_udp_stream* udp_stream_start( struct t_rx_device *dev, int device_id, json_t *root );
+
+// sends one raw u8 block as a batch of datagrams. Never blocks, datagrams the socket cannot take are dropped
+void udp_stream_publish( struct t_udp_stream *st, unsigned char *buf, uint32_t len, struct ext_Context *ctx );
+
+#endif // UDP_STREAM_H
@@ -0,0 +1,59 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UDP_STREAM_FORMAT_H
+#define UDP_STREAM_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * UDP multicast IQ streaming : each device stream is cut in MTU sized datagrams sent to a multicast
+ * group. Enabled from json_init_params :
+ *
+ *   { "multicast" : { "group" : "239.255.10.1",
+ *                     "port" : 5000,              // device n sends to port+n
+ *                     "format" : "u8",            // u8 : raw dongle bytes, s16 : signed 16 bits I/Q
+ *                     "mtu" : 1500,
+ *                     "ttl" : 1,
+ *                     "interface" : "0.0.0.0",    // local address of the sending interface
+ *                     "loopback" : true } }
+ *
+ * Every datagram starts with struct udp_iq_header (little endian) followed by the samples.
+ * seq increments by one per datagram : a receiver detects losses from the gaps, and sample_index
+ * tells how many samples are missing.
+ */
+
+#define UDP_IQ_MAGIC    (0x55544c52) // "RTLU"
+#define UDP_IQ_VERSION  (1)
+
+#define UDP_IQ_FORMAT_U8   (0)
+#define UDP_IQ_FORMAT_S16  (1)
+
+struct __attribute__ ((__packed__)) udp_iq_header {
+    uint32_t magic ;
+    uint8_t  version ;
+    uint8_t  format ;
+    uint16_t header_size ;
+    uint32_t seq ;           // datagram counter, per device
+    uint32_t sample_count ;  // complex samples in this datagram
+    uint64_t sample_index ;  // index of the first sample since the driver started
+    uint64_t center_freq ;
+    uint32_t sample_rate ;
+    uint32_t ctx_version ;
+};
+
+#endif // UDP_STREAM_FORMAT_H
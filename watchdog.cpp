@@ -0,0 +1,204 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "watchdog.h"
+#include "stream_engine.h"
+#include "trace.h"
+
+#define PERIOD_MS         (100)  // monitoring period
+#define MAX_BACKOFF_MS    (5000) // between two failed recoveries
+
+struct t_watchdog_config {
+    bool enabled ;
+    int missed_transfers ;
+    int min_ms ;
+    int reopen_after ;
+};
+
+static struct t_watchdog_config config = { false, 8, 500, 2 };
+
+struct t_watchdog {
+    int restart ;             // set by the monitor, cleared by the acquisition thread
+    int failures ;            // consecutive recoveries without data
+    int reopened ;            // device was reopened during this outage
+    int64_t outage_start ;    // ms, last transfer before the stall, 0 when no outage
+    int64_t restart_ms ;      // ms, last restart
+};
+
+static pthread_t monitor_thread ;
+
+void watchdog_setup( json_t *root ) {
+    json_t *conf = json_object_get( root, "watchdog" );
+    if( !json_is_object(conf) ) {
+        return ;
+    }
+    config.enabled = true ;
+    json_t *v = json_object_get( conf, "missed_transfers" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 2) ) config.missed_transfers = (int)json_integer_value(v);
+    v = json_object_get( conf, "min_ms" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 50) ) config.min_ms = (int)json_integer_value(v);
+    v = json_object_get( conf, "reopen_after" );
+    if( json_is_integer(v) && (json_integer_value(v) >= 0) ) config.reopen_after = (int)json_integer_value(v);
+}
+
+struct t_watchdog* watchdog_attach( struct t_rx_device *dev ) {
+    (void)dev ;
+    if( !config.enabled ) {
+        return(NULL);
+    }
+    return( (struct t_watchdog *)calloc( 1, sizeof(struct t_watchdog)) );
+}
+
+// stall threshold of the device, in ms
+static int64_t stall_ms( struct t_rx_device *dev ) {
+    uint32_t buf_len = stream_engine.buf_len ;
+    int rate = dev->current_sample_rate > 0 ? dev->current_sample_rate : 1 ;
+    int64_t period_ms = (int64_t)(buf_len / 2) * 1000 / rate + 1 ;
+    int64_t limit = period_ms * config.missed_transfers ;
+    return( limit > config.min_ms ? limit : config.min_ms );
+}
+
+static void* monitor( void *params ) {
+    char msg[256] ;
+    (void)params ;
+    trace_thread_name( "watchdog" );
+    for( ; ; ) {
+        usleep( PERIOD_MS * 1000 );
+        int64_t now = rx_now_ms();
+        int count = __atomic_load_n( &device_count, __ATOMIC_ACQUIRE );
+        for( int d=0 ; d < count ; d++ ) {
+            struct t_rx_device *dev = &rx[d] ;
+            struct t_watchdog *wd = dev->watchdog ;
+            if( wd == NULL ) {
+                continue ;
+            }
+            int64_t last = __atomic_load_n( &dev->hot->last_block_ms, __ATOMIC_RELAXED );
+            int64_t outage = __atomic_load_n( &wd->outage_start, __ATOMIC_ACQUIRE );
+
+            if( (outage != 0) && (last > __atomic_load_n( &wd->restart_ms, __ATOMIC_ACQUIRE )) ) {
+                // samples are back
+                snprintf( msg, sizeof(msg), "watchdog: stream recovered, outage %d ms, %d restart(s)%s",
+                          (int)(last - outage), wd->failures, wd->reopened ? ", device reopened" : "" );
+                log_class( d, 0, LOG_STREAM, msg );
+                __atomic_store_n( &wd->outage_start, 0, __ATOMIC_RELEASE );
+                continue ;
+            }
+
+            int state = __atomic_load_n( &dev->hot->state, __ATOMIC_ACQUIRE );
+            if( ((state != RX_STREAMING) && (state != RX_IDLE)) ||
+                !__atomic_load_n( &dev->hot->running, __ATOMIC_ACQUIRE ) ||
+                __atomic_load_n( &wd->restart, __ATOMIC_ACQUIRE ) ) {
+                continue ;
+            }
+            if( now - last > stall_ms( dev ) ) {
+                snprintf( msg, sizeof(msg), "watchdog: no transfer for %d ms, restarting stream", (int)(now - last) );
+                log_class( d, 0, LOG_STREAM, msg );
+                __atomic_store_n( &wd->restart, 1, __ATOMIC_RELEASE );
+                trace_instant( "stall", d );
+                pthread_mutex_lock( &dev->ctl_lock );
+                dev->backend->cancel_async( dev );
+                pthread_mutex_unlock( &dev->ctl_lock );
+            }
+        }
+    }
+    return(NULL);
+}
+
+void watchdog_start( void ) {
+    if( !config.enabled ) {
+        return ;
+    }
+    pthread_create( &monitor_thread, NULL, monitor, NULL );
+}
+
+bool watchdog_should_restart( struct t_rx_device *dev, int read_rc ) {
+    struct t_watchdog *wd = dev->watchdog ;
+    char msg[256] ;
+    int device_id = (int)(dev - rx) ;
+
+    if( wd == NULL ) {
+        return(false);
+    }
+    bool requested = __atomic_exchange_n( &wd->restart, 0, __ATOMIC_ACQ_REL );
+    int state = __atomic_load_n( &dev->hot->state, __ATOMIC_ACQUIRE );
+    if( (state != RX_STREAMING) && (state != RX_IDLE) ) {
+        return(false); // stopped on purpose
+    }
+    if( !requested && (read_rc >= 0) ) {
+        return(false);
+    }
+
+    int64_t last = __atomic_load_n( &dev->hot->last_block_ms, __ATOMIC_RELAXED );
+    if( __atomic_load_n( &wd->outage_start, __ATOMIC_ACQUIRE ) == 0 ) {
+        // new outage. restart_ms first, so the monitor does not take the last transfer for a recovery
+        wd->failures = 0 ;
+        wd->reopened = 0 ;
+        __atomic_store_n( &wd->restart_ms, rx_now_ms(), __ATOMIC_RELEASE );
+        __atomic_store_n( &wd->outage_start, last, __ATOMIC_RELEASE );
+    }
+    if( !requested ) {
+        snprintf( msg, sizeof(msg), "watchdog: stream lost (rc=%d), restarting", read_rc );
+        log_class( device_id, 0, LOG_STREAM, msg );
+    }
+
+    for( ; ; ) {
+        wd->failures++ ;
+        if( wd->failures > 1 ) {
+            int backoff = 250 * (wd->failures - 1) ;
+            usleep( (backoff < MAX_BACKOFF_MS ? backoff : MAX_BACKOFF_MS) * 1000 );
+        }
+        int rc = 0 ;
+        pthread_mutex_lock( &dev->ctl_lock );
+        // checked under the lock : a dongle unplugged meanwhile is closed by the hot-plug monitor
+        state = __atomic_load_n( &dev->hot->state, __ATOMIC_ACQUIRE );
+        if( (state != RX_STREAMING) && (state != RX_IDLE) ) {
+            pthread_mutex_unlock( &dev->ctl_lock );
+            return(false);
+        }
+        if( wd->failures > config.reopen_after ) {
+            rc = dev->backend->reopen( dev );
+            if( rc == 0 ) {
+                rx_device_restore( dev );
+                wd->reopened = 1 ;
+            }
+        }
+        if( rc == 0 ) {
+            rc = dev->backend->reset_buffer( dev );
+        }
+        if( rc == 0 ) {
+            // samples were lost : tell the consumers
+            dev->context.discontinuity++ ;
+            dev->context.ctx_version++ ;
+        }
+        pthread_mutex_unlock( &dev->ctl_lock );
+        if( rc == 0 ) {
+            break ;
+        }
+        snprintf( msg, sizeof(msg), "watchdog: recovery attempt %d failed", wd->failures );
+        log_class( device_id, 0, LOG_STREAM, msg );
+    }
+
+    int64_t now = rx_now_ms();
+    __atomic_store_n( &wd->restart_ms, now, __ATOMIC_RELEASE );
+    __atomic_store_n( &dev->hot->last_block_ms, now, __ATOMIC_RELAXED );
+    return(true);
+}
@@ -0,0 +1,52 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include "rx_device.h"
+
+/*
+ * Stall watchdog : restarts the stream of a device when its transfers stop coming.
+ *
+ *   { "watchdog" : { "missed_transfers" : 8,   // stall when this many transfer periods passed without data
+ *                    "min_ms" : 500,           // but never less than this
+ *                    "reopen_after" : 2 } }    // failed restarts before the device is reopened
+ *
+ * The transfer period follows from the sample rate and the USB transfer size. A stalled stream is
+ * cancelled and read again, after reopen_after failed attempts the device is closed and opened again
+ * (USB : same serial, or same index if serials are not unique). Frequency, rate and gain are restored,
+ * the outage is logged when samples come back and ext_Context.discontinuity is incremented.
+ * Enabled when the "watchdog" object is present.
+ */
+
+struct t_watchdog ;
+
+// reads the configuration, before the devices are opened
+void watchdog_setup( json_t *root );
+
+// per device state, NULL if the watchdog is disabled
+struct t_watchdog* watchdog_attach( struct t_rx_device *dev );
+
+// starts the monitoring thread, once all the devices are set up
+void watchdog_start( void );
+
+// called by the acquisition thread when read_async returned. Recovers the device if the stream
+// was not stopped on purpose and returns true if read_async shall be called again
+bool watchdog_should_restart( struct t_rx_device *dev, int read_rc );
+
+#endif // WATCHDOG_H
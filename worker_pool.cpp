@@ -0,0 +1,187 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "worker_pool.h"
+#include "rx_device.h"
+#include "trace.h"
+
+#define DEFAULT_THREADS (2)
+#define DEQUE_SIZE      (256) // power of 2, tasks are devices so this is plenty
+#define IDLE_WAIT_MS    (100) // safety net, wake ups are normally explicit
+
+struct t_deque {
+    pthread_mutex_t lock ;
+    struct t_pool_task *tasks[DEQUE_SIZE] ;
+    unsigned int front ;       // next task to run by the owner
+    unsigned int back ;        // next free slot
+    pthread_t thread ;         // worker owning the deque
+    char pad[64] ;             // deques of neighbour workers on different cache lines
+};
+
+static struct t_deque *deques ;
+static int worker_count ;
+static struct t_thread_settings settings ;
+
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t sleep_cond = PTHREAD_COND_INITIALIZER ;
+static int idle_workers ;
+
+int worker_pool_size() {
+    return( worker_count );
+}
+
+pthread_t worker_pool_thread( int k ) {
+    return( deques[k].thread );
+}
+
+static bool push_back( struct t_deque *d, struct t_pool_task *task ) {
+    bool ok = false ;
+    pthread_mutex_lock( &d->lock );
+    if( d->back - d->front < DEQUE_SIZE ) {
+        d->tasks[ d->back & (DEQUE_SIZE-1) ] = task ;
+        d->back++ ;
+        ok = true ;
+    }
+    pthread_mutex_unlock( &d->lock );
+    return(ok);
+}
+
+static struct t_pool_task* pop_front( struct t_deque *d ) {
+    struct t_pool_task *task = NULL ;
+    pthread_mutex_lock( &d->lock );
+    if( d->front != d->back ) {
+        task = d->tasks[ d->front & (DEQUE_SIZE-1) ] ;
+        d->front++ ;
+    }
+    pthread_mutex_unlock( &d->lock );
+    return(task);
+}
+
+static struct t_pool_task* steal_back( struct t_deque *d ) {
+    struct t_pool_task *task = NULL ;
+    if( d->front == d->back ) {
+        return(NULL); // racy peek, avoids taking the lock of an empty deque
+    }
+    pthread_mutex_lock( &d->lock );
+    if( d->front != d->back ) {
+        d->back-- ;
+        task = d->tasks[ d->back & (DEQUE_SIZE-1) ] ;
+    }
+    pthread_mutex_unlock( &d->lock );
+    return(task);
+}
+
+static struct t_pool_task* find_task( int self ) {
+    struct t_pool_task *task = pop_front( &deques[self] );
+    for( int k=1 ; (task == NULL) && (k < worker_count) ; k++ ) {
+        task = steal_back( &deques[(self + k) % worker_count] );
+    }
+    return(task);
+}
+
+void worker_pool_submit( struct t_pool_task *task ) {
+    int home = task->home % worker_count ;
+    // home deque full can only happen with more devices than DEQUE_SIZE : use the next one
+    for( int k=0 ; k < worker_count ; k++ ) {
+        if( push_back( &deques[(home + k) % worker_count], task )) {
+            break ;
+        }
+    }
+    if( __atomic_load_n( &idle_workers, __ATOMIC_SEQ_CST ) > 0 ) {
+        pthread_mutex_lock( &sleep_lock );
+        pthread_cond_signal( &sleep_cond );
+        pthread_mutex_unlock( &sleep_lock );
+    }
+}
+
+static void* worker_thread( void *params ) {
+    int self = (int)(intptr_t)params ;
+    char name[32] ;
+    snprintf( name, sizeof(name), "dsp worker %d", self );
+    trace_thread_name( name );
+    for( ; ; ) {
+        struct t_pool_task *task = find_task( self );
+        if( task != NULL ) {
+            task->run( task );
+            continue ;
+        }
+
+        // nothing to do : announce we are idle, check again, then sleep
+        pthread_mutex_lock( &sleep_lock );
+        __atomic_add_fetch( &idle_workers, 1, __ATOMIC_SEQ_CST );
+        task = find_task( self );
+        if( task == NULL ) {
+            struct timespec ts ;
+            clock_gettime( CLOCK_REALTIME, &ts );
+            ts.tv_nsec += IDLE_WAIT_MS * 1000000L ;
+            if( ts.tv_nsec >= 1000000000L ) {
+                ts.tv_sec++ ;
+                ts.tv_nsec -= 1000000000L ;
+            }
+            pthread_cond_timedwait( &sleep_cond, &sleep_lock, &ts );
+        }
+        __atomic_sub_fetch( &idle_workers, 1, __ATOMIC_SEQ_CST );
+        pthread_mutex_unlock( &sleep_lock );
+        if( task != NULL ) {
+            task->run( task );
+        }
+    }
+    return(NULL);
+}
+
+void worker_pool_setup( json_t *root ) {
+    if( worker_count > 0 ) {
+        return ;
+    }
+    worker_count = DEFAULT_THREADS ;
+    settings.policy = SCHED_OTHER ;
+    json_t *conf = json_object_get( root, "dsp_pool" );
+    if( json_is_object(conf) ) {
+        json_t *v = json_object_get( conf, "threads" );
+        if( json_is_integer(v) && (json_integer_value(v) > 0) ) {
+            worker_count = (int)json_integer_value(v);
+        }
+        thread_settings_parse( conf, &settings );
+    }
+
+    deques = (struct t_deque *)calloc( worker_count, sizeof(struct t_deque));
+    for( int k=0 ; k < worker_count ; k++ ) {
+        pthread_mutex_init( &deques[k].lock, NULL );
+    }
+    for( int k=0 ; k < worker_count ; k++ ) {
+        pthread_t thread ;
+        char report[192] ;
+        char msg[256] ;
+        pthread_create( &thread, NULL, worker_thread, (void *)(intptr_t)k );
+        pthread_detach( thread );
+        deques[k].thread = thread ;
+        // worker k runs on one cpu of the set
+        thread_settings_apply( thread, &settings, k, report, sizeof(report) );
+        snprintf( msg, sizeof(msg), "dsp worker %d: %s", k, report );
+        log( 0, 0, msg );
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * Adds RTLSDR Dongles capability to SDRNode
+ * Copyright (C) 2016 Sylvain AZARIAN <sylvain.azarian@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+
+#include "jansson/jansson.h"
+
+/*
+ * Process wide DSP worker pool, shared by all the devices.
+ *
+ *   { "dsp_pool" : { "threads" : 4,            // default : 2
+ *                    "cpus" : [ 2, 3, 4, 5 ],   // worker k runs on cpus[k % count], default : not pinned
+ *                    "sched" : "fifo", "priority" : 40 } } // see thread_tuning.h
+ *
+ * Each worker owns a deque. A task is queued at the back of the deque of its home worker, the owner
+ * takes from the front, an idle worker steals from the back of the other deques. A task is queued
+ * at most once at a time : the caller guarantees it (see stream_engine.cpp), which is what keeps the
+ * blocks of a device in order whatever the worker running them.
+ */
+
+struct t_pool_task {
+    void (*run)( struct t_pool_task *task );
+    int home ;                 // preferred worker, keeps the device state in the same cache
+};
+
+// reads the configuration and starts the workers, once
+void worker_pool_setup( json_t *root );
+
+// number of workers
+int worker_pool_size();
+
+// thread of worker k, k < worker_pool_size()
+pthread_t worker_pool_thread( int k );
+
+// queues the task on its home worker and wakes up an idle worker if any
+void worker_pool_submit( struct t_pool_task *task );
+
+#endif // WORKER_POOL_H